@@ -0,0 +1,46 @@
+#include "animation_atlas.hpp"
+#include "animation_baker.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+std::size_t add_clip(animation_atlas & atlas, skeleton const & skeleton, gltf_model::animation const & animation, float frame_rate)
+{
+    std::size_t const bone_count = skeleton.bone_count();
+    if (animation.bones.size() != bone_count)
+        throw std::runtime_error("Animation doesn't match the skeleton");
+
+    if (atlas.clips.empty())
+        atlas.bone_count = bone_count;
+    else if (atlas.bone_count != bone_count)
+        throw std::runtime_error("All clips of an animation atlas must share the skeleton");
+
+    animation_atlas::clip clip;
+    clip.first_frame = atlas.frame_count();
+    clip.frame_count = std::max<std::size_t>(2, std::ceil(animation.max_time * frame_rate) + 1);
+    clip.frame_rate = (animation.max_time > 0.f) ? (clip.frame_count - 1) / animation.max_time : 0.f;
+    clip.duration = animation.max_time;
+
+    std::size_t const frame_size = bone_count * animation_atlas::floats_per_matrix;
+    atlas.texels.resize(atlas.texels.size() + clip.frame_count * frame_size);
+
+    pose pose(bone_count);
+    skeleton_workspace workspace;
+    std::vector<glm::mat4> matrices(bone_count);
+
+    for (std::size_t f = 0; f < clip.frame_count; ++f)
+    {
+        float const time = std::min(animation.max_time, f / std::max(clip.frame_rate, 1.f));
+        sample(animation, time, pose);
+        compute_bone_matrices(skeleton, pose, workspace, matrices.data());
+
+        float * row = atlas.texels.data() + (clip.first_frame + f) * frame_size;
+        for (auto const & matrix : matrices)
+            for (int r = 0; r < 3; ++r)
+                for (int c = 0; c < 4; ++c)
+                    *row++ = matrix[c][r];
+    }
+
+    atlas.clips.push_back(clip);
+    return atlas.clips.size() - 1;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "skeleton.hpp"
+
+// Skinning matrices of whole clips, precomputed at a fixed frame rate. Every frame is one row of
+// bone_count * 3 RGBA texels (the rows of the upper 3x4 part of each bone matrix), and the frames
+// of all clips are stacked one after another, ready to be uploaded as a single float texture.
+struct animation_atlas
+{
+    static constexpr std::size_t texels_per_matrix = 3;
+    static constexpr std::size_t floats_per_matrix = 4 * texels_per_matrix;
+
+    struct clip
+    {
+        std::size_t first_frame = 0;
+        std::size_t frame_count = 0;
+        float frame_rate = 0.f;
+        float duration = 0.f;
+    };
+
+    std::size_t bone_count = 0;
+    std::vector<clip> clips;
+    std::vector<float> texels;
+
+    std::size_t row_width() const { return bone_count * texels_per_matrix; }
+    std::size_t frame_count() const { return texels.size() / (bone_count * floats_per_matrix); }
+
+    float const * frame(std::size_t index) const
+    {
+        return texels.data() + index * bone_count * floats_per_matrix;
+    }
+};
+
+// Appends all frames of the animation to the atlas and returns the index of the new clip;
+// as in bake_animation, the frame rate is adjusted so that the frames exactly cover [0, duration]
+std::size_t add_clip(animation_atlas & atlas, skeleton const & skeleton, gltf_model::animation const & animation, float frame_rate = 30.f);
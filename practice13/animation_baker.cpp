@@ -0,0 +1,162 @@
+#include "animation_baker.hpp"
+
+#include <cmath>
+
+template <typename T>
+static T sample_or(gltf_model::spline<T> const & spline, float time, T const & fallback)
+{
+    if (spline.values.empty())
+        return fallback;
+    return spline(time);
+}
+
+void sample(gltf_model::animation const & animation, float time, pose & result)
+{
+    if (result.bone_count != animation.bones.size())
+        result.resize(animation.bones.size());
+
+    for (std::size_t i = 0; i < animation.bones.size(); ++i)
+    {
+        auto const & bone = animation.bones[i];
+        result.set(i,
+            sample_or(bone.translation, time, glm::vec3(0.f)),
+            sample_or(bone.rotation, time, glm::quat(1.f, 0.f, 0.f, 0.f)),
+            sample_or(bone.scale, time, glm::vec3(1.f)));
+    }
+}
+
+static baked_animation bake_at(gltf_model::animation const & animation, float frame_rate)
+{
+    baked_animation result;
+    result.bone_count = animation.bones.size();
+    result.stride = simd::padded(result.bone_count);
+    result.duration = animation.max_time;
+
+    // At least two frames, so that sampling never has to special-case the last one;
+    // the rate is then adjusted so that the frames exactly cover [0, duration]
+    result.frame_count = std::max<std::size_t>(2, std::ceil(animation.max_time * frame_rate) + 1);
+    result.frame_rate = (animation.max_time > 0.f) ? (result.frame_count - 1) / animation.max_time : 0.f;
+
+    std::size_t const frame_size = pose::channel_count * result.stride;
+    result.frames.resize(result.frame_count * frame_size);
+
+    pose frame(result.bone_count);
+    for (std::size_t f = 0; f < result.frame_count; ++f)
+    {
+        float const time = std::min(animation.max_time, f / std::max(result.frame_rate, 1.f));
+        sample(animation, time, frame);
+
+        // Keep consecutive rotations in the same hemisphere so that nlerp never needs a sign check
+        if (f > 0)
+        {
+            float const * previous = result.frame(f - 1);
+            for (std::size_t i = 0; i < result.bone_count; ++i)
+            {
+                float dot = 0.f;
+                for (std::size_t c = pose::rx; c <= pose::rw; ++c)
+                    dot += frame.channel(c)[i] * previous[c * result.stride + i];
+                if (dot < 0.f)
+                    for (std::size_t c = pose::rx; c <= pose::rw; ++c)
+                        frame.channel(c)[i] = -frame.channel(c)[i];
+            }
+        }
+
+        std::copy(frame.data.begin(), frame.data.end(), result.frames.begin() + f * frame_size);
+    }
+
+    return result;
+}
+
+void sample(baked_animation const & animation, float time, pose & result)
+{
+    if (result.bone_count != animation.bone_count)
+        result.resize(animation.bone_count);
+
+    float const position = std::clamp(time * animation.frame_rate, 0.f, float(animation.frame_count - 1));
+    std::size_t const index = std::min<std::size_t>(position, animation.frame_count - 2);
+
+    float const * a = animation.frame(index);
+    float const * b = animation.frame(index + 1);
+    float * out = result.data.data();
+
+    auto const t = simd::splat(position - index);
+    std::size_t const frame_size = pose::channel_count * animation.stride;
+    for (std::size_t k = 0; k < frame_size; k += simd::width)
+        simd::store(out + k, simd::lerp(simd::load(a + k), simd::load(b + k), t));
+
+    float * x = result.channel(pose::rx);
+    float * y = result.channel(pose::ry);
+    float * z = result.channel(pose::rz);
+    float * w = result.channel(pose::rw);
+    for (std::size_t k = 0; k < animation.stride; k += simd::width)
+    {
+        auto qx = simd::load(x + k);
+        auto qy = simd::load(y + k);
+        auto qz = simd::load(z + k);
+        auto qw = simd::load(w + k);
+        auto length = simd::sqrt(qx * qx + qy * qy + qz * qz + qw * qw);
+        simd::store(x + k, qx / length);
+        simd::store(y + k, qy / length);
+        simd::store(z + k, qz / length);
+        simd::store(w + k, qw / length);
+    }
+}
+
+baked_animation::error measure_error(baked_animation const & baked, gltf_model::animation const & animation)
+{
+    std::vector<float> times;
+    for (auto const & bone : animation.bones)
+    {
+        times.insert(times.end(), bone.translation.timestamps.begin(), bone.translation.timestamps.end());
+        times.insert(times.end(), bone.rotation.timestamps.begin(), bone.rotation.timestamps.end());
+        times.insert(times.end(), bone.scale.timestamps.begin(), bone.scale.timestamps.end());
+    }
+    // Midpoints between baked frames are where the interpolation error peaks
+    for (std::size_t f = 0; f + 1 < baked.frame_count; ++f)
+        times.push_back((f + 0.5f) / baked.frame_rate);
+
+    std::sort(times.begin(), times.end());
+    times.erase(std::unique(times.begin(), times.end()), times.end());
+
+    baked_animation::error result;
+
+    pose exact, approximate;
+    for (float time : times)
+    {
+        sample(animation, time, exact);
+        sample(baked, time, approximate);
+
+        for (std::size_t i = 0; i < baked.bone_count; ++i)
+        {
+            // Chord length between unit quaternions is 2 sin(angle / 4), which unlike acos(dot) stays accurate for tiny angles
+            auto const q = exact.rotation(i);
+            auto const p = approximate.rotation(i);
+            float const chord = std::min(glm::length(q - p), glm::length(q + p));
+            float const angle = 4.f * std::asin(std::min(1.f, chord / 2.f));
+
+            result.translation = std::max(result.translation, glm::distance(exact.translation(i), approximate.translation(i)));
+            result.rotation = std::max(result.rotation, angle);
+            result.scale = std::max(result.scale, glm::distance(exact.scale(i), approximate.scale(i)));
+        }
+    }
+
+    return result;
+}
+
+baked_animation bake_animation(gltf_model::animation const & animation, bake_settings const & settings)
+{
+    auto const & budget = settings.error_budget;
+
+    for (float frame_rate = settings.min_frame_rate;; frame_rate = std::min(frame_rate * 2.f, settings.max_frame_rate))
+    {
+        auto result = bake_at(animation, frame_rate);
+        result.max_error = measure_error(result, animation);
+
+        bool const fits = result.max_error.translation <= budget.translation
+            && result.max_error.rotation <= budget.rotation
+            && result.max_error.scale <= budget.scale;
+
+        if (fits || frame_rate >= settings.max_frame_rate)
+            return result;
+    }
+}
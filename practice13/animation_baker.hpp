@@ -0,0 +1,52 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "pose.hpp"
+
+// An animation resampled at a uniform frame rate. Every frame stores the local TRS of all
+// bones with the same layout as pose::data, so sampling only touches two contiguous frames.
+struct baked_animation
+{
+    struct error
+    {
+        float translation = 0.f;
+        float rotation = 0.f; // radians
+        float scale = 0.f;
+    };
+
+    std::size_t bone_count = 0;
+    std::size_t stride = 0;
+    std::size_t frame_count = 0;
+    float frame_rate = 0.f;
+    float duration = 0.f;
+
+    std::vector<float> frames;
+
+    // Largest deviation from the exact sampler, measured at bake time
+    error max_error;
+
+    float const * frame(std::size_t index) const
+    {
+        return frames.data() + index * pose::channel_count * stride;
+    }
+};
+
+struct bake_settings
+{
+    float min_frame_rate = 30.f;
+    float max_frame_rate = 240.f;
+
+    // The frame rate is doubled, starting from min_frame_rate, until
+    // all errors fit into these bounds or max_frame_rate is reached
+    baked_animation::error error_budget = {1e-3f, 1e-3f, 1e-3f};
+};
+
+baked_animation bake_animation(gltf_model::animation const & animation, bake_settings const & settings = {});
+
+// Exact sampling of the source splines; bones without a track get the identity transform
+void sample(gltf_model::animation const & animation, float time, pose & result);
+
+// Branchless sampling of the baked frames: time is clamped to [0, duration]
+void sample(baked_animation const & animation, float time, pose & result);
+
+baked_animation::error measure_error(baked_animation const & baked, gltf_model::animation const & animation);
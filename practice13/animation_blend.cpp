@@ -0,0 +1,321 @@
+#include "animation_blend.hpp"
+
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+pose_pool::pose_pool(std::size_t bone_count, std::size_t capacity)
+    : poses(capacity, pose(bone_count))
+{
+    free_poses.reserve(capacity);
+    for (std::size_t i = capacity; i --> 0;)
+        free_poses.push_back(&poses[i]);
+}
+
+pose * pose_pool::acquire()
+{
+    if (free_poses.empty())
+        throw std::runtime_error("Pose pool is exhausted");
+
+    pose * result = free_poses.back();
+    free_poses.pop_back();
+    return result;
+}
+
+void pose_pool::release(pose * pose)
+{
+    assert(pose >= poses.data() && pose < poses.data() + poses.size());
+    assert(free_poses.size() < poses.size());
+    free_poses.push_back(pose);
+}
+
+void animation_clip::sample(float time, pose & result) const
+{
+    if (baked_clip)
+        ::sample(*baked_clip, time, result);
+    else
+        ::sample(*compressed_clip, time, result);
+}
+
+bone_mask make_bone_mask(skeleton const & skeleton, std::uint32_t root)
+{
+    bone_mask result;
+    result.weights.assign(simd::padded(skeleton.bone_count()), 0.f);
+
+    // Parents precede their children, so a single pass marks the whole subtree
+    for (std::size_t i = root; i < skeleton.bone_count(); ++i)
+    {
+        std::uint32_t const parent = skeleton.parents[i];
+        if (i == root || (parent != skeleton::no_parent && result.weights[parent] != 0.f))
+            result.weights[i] = 1.f;
+    }
+
+    return result;
+}
+
+namespace
+{
+
+    bool is_full_body(animation_layer const & layer)
+    {
+        return layer.mode == animation_layer::blend && !layer.mask;
+    }
+
+    float advance(animation_layer const & layer, float dt)
+    {
+        float time = layer.time + layer.speed * dt;
+        if (float const duration = layer.clip.duration(); layer.loop && duration > 0.f)
+        {
+            time = std::fmod(time, duration);
+            if (time < 0.f)
+                time += duration;
+        }
+        return time;
+    }
+
+}
+
+void animation_blender::play(animation_clip clip, float fade_duration, float time)
+{
+    // Full-body layers form the bottom of the stack and the new clip goes on top of them. Layers below
+    // stop fading, so that an interrupted crossfade continues smoothly from what is currently visible.
+    std::size_t position = 0;
+    for (std::size_t i = count; i --> 0;)
+    {
+        if (!is_full_body(layers[i]))
+            continue;
+
+        if (fade_duration > 0.f)
+        {
+            layers[i].target_weight = layers[i].weight;
+            position = std::max(position, i + 1);
+        }
+        else
+            remove_layer(i);
+    }
+
+    // Make room by dropping the bottom clip
+    if (count == max_layers)
+    {
+        if (position == 0)
+            throw std::runtime_error("All animation layers are in use");
+        remove_layer(0);
+        --position;
+    }
+
+    animation_layer layer;
+    layer.clip = clip;
+    layer.time = time;
+    if (position > 0)
+    {
+        layer.weight = 0.f;
+        layer.fade_speed = 1.f / fade_duration;
+    }
+
+    for (std::size_t i = count; i > position; --i)
+        layers[i] = layers[i - 1];
+    layers[position] = layer;
+    ++count;
+}
+
+std::size_t animation_blender::add_layer(animation_layer const & layer)
+{
+    if (count == max_layers)
+        throw std::runtime_error("All animation layers are in use");
+
+    layers[count] = layer;
+    return count++;
+}
+
+void animation_blender::update(float dt)
+{
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto & layer = layers[i];
+
+        layer.time = advance(layer, dt);
+
+        float const step = (layer.fade_speed > 0.f) ? layer.fade_speed * dt : std::numeric_limits<float>::infinity();
+        if (layer.weight < layer.target_weight)
+            layer.weight = std::min(layer.target_weight, layer.weight + step);
+        else
+            layer.weight = std::max(layer.target_weight, layer.weight - step);
+    }
+
+    // A full-body layer at full weight hides every full-body layer below it
+    for (std::size_t i = count; i --> 0;)
+    {
+        if (!is_full_body(layers[i]) || layers[i].weight < 1.f)
+            continue;
+
+        for (std::size_t j = i; j --> 0;)
+            if (is_full_body(layers[j]))
+                remove_layer(j);
+        break;
+    }
+}
+
+void animation_blender::remove_layer(std::size_t index)
+{
+    for (std::size_t i = index; i + 1 < count; ++i)
+        layers[i] = layers[i + 1];
+    --count;
+}
+
+namespace
+{
+
+    simd::floatv layer_weights(animation_layer const & layer, std::size_t k)
+    {
+        auto weight = simd::splat(layer.weight);
+        if (layer.mask)
+            weight = weight * simd::load(layer.mask->weights.data() + k);
+        return weight;
+    }
+
+    void normalize(simd::floatv & x, simd::floatv & y, simd::floatv & z, simd::floatv & w)
+    {
+        auto const length = simd::sqrt(x * x + y * y + z * z + w * w);
+        x = x / length;
+        y = y / length;
+        z = z / length;
+        w = w / length;
+    }
+
+    // result = lerp(result, source, weight) per bone, with nlerp along the shortest arc for rotations
+    void blend_layer(animation_layer const & layer, pose const & source, pose & result)
+    {
+        for (std::size_t k = 0; k < result.stride; k += simd::width)
+        {
+            auto const weight = layer_weights(layer, k);
+
+            for (std::size_t c : {pose::tx, pose::ty, pose::tz, pose::sx, pose::sy, pose::sz})
+                simd::store(result.channel(c) + k, simd::lerp(simd::load(result.channel(c) + k), simd::load(source.channel(c) + k), weight));
+
+            auto ax = simd::load(result.channel(pose::rx) + k);
+            auto ay = simd::load(result.channel(pose::ry) + k);
+            auto az = simd::load(result.channel(pose::rz) + k);
+            auto aw = simd::load(result.channel(pose::rw) + k);
+
+            auto bx = simd::load(source.channel(pose::rx) + k);
+            auto by = simd::load(source.channel(pose::ry) + k);
+            auto bz = simd::load(source.channel(pose::rz) + k);
+            auto bw = simd::load(source.channel(pose::rw) + k);
+
+            auto const dot = ax * bx + ay * by + az * bz + aw * bw;
+
+            auto x = simd::lerp(ax, simd::mulsign(bx, dot), weight);
+            auto y = simd::lerp(ay, simd::mulsign(by, dot), weight);
+            auto z = simd::lerp(az, simd::mulsign(bz, dot), weight);
+            auto w = simd::lerp(aw, simd::mulsign(bw, dot), weight);
+            normalize(x, y, z, w);
+
+            simd::store(result.channel(pose::rx) + k, x);
+            simd::store(result.channel(pose::ry) + k, y);
+            simd::store(result.channel(pose::rz) + k, z);
+            simd::store(result.channel(pose::rw) + k, w);
+        }
+    }
+
+    // Applies the difference between `source` and the first frame of the layer's clip on top of result
+    void add_additive_layer(animation_layer const & layer, pose const & source, pose & result)
+    {
+        float const * reference = layer.clip.first_frame();
+        std::size_t const stride = simd::padded(layer.clip.bone_count());
+        auto channel = [&](std::size_t c, std::size_t k){ return simd::load(reference + c * stride + k); };
+
+        auto const one = simd::splat(1.f);
+
+        for (std::size_t k = 0; k < result.stride; k += simd::width)
+        {
+            auto const weight = layer_weights(layer, k);
+
+            for (std::size_t c : {pose::tx, pose::ty, pose::tz})
+                simd::store(result.channel(c) + k, simd::load(result.channel(c) + k) + weight * (simd::load(source.channel(c) + k) - channel(c, k)));
+
+            for (std::size_t c : {pose::sx, pose::sy, pose::sz})
+                simd::store(result.channel(c) + k, simd::load(result.channel(c) + k) * simd::lerp(one, simd::load(source.channel(c) + k) / channel(c, k), weight));
+
+            // delta = source * conjugate(reference)
+            auto const sx = simd::load(source.channel(pose::rx) + k);
+            auto const sy = simd::load(source.channel(pose::ry) + k);
+            auto const sz = simd::load(source.channel(pose::rz) + k);
+            auto const sw = simd::load(source.channel(pose::rw) + k);
+
+            auto const rx = channel(pose::rx, k);
+            auto const ry = channel(pose::ry, k);
+            auto const rz = channel(pose::rz, k);
+            auto const rw = channel(pose::rw, k);
+
+            auto dw = sw * rw + sx * rx + sy * ry + sz * rz;
+            auto dx = sx * rw - sw * rx - sy * rz + sz * ry;
+            auto dy = sy * rw - sw * ry - sz * rx + sx * rz;
+            auto dz = sz * rw - sw * rz - sx * ry + sy * rx;
+
+            // Scale the delta by the weight: nlerp from identity along the shortest arc
+            dx = weight * simd::mulsign(dx, dw);
+            dy = weight * simd::mulsign(dy, dw);
+            dz = weight * simd::mulsign(dz, dw);
+            dw = simd::lerp(one, simd::mulsign(dw, dw), weight);
+
+            // result = delta * result
+            auto const ax = simd::load(result.channel(pose::rx) + k);
+            auto const ay = simd::load(result.channel(pose::ry) + k);
+            auto const az = simd::load(result.channel(pose::rz) + k);
+            auto const aw = simd::load(result.channel(pose::rw) + k);
+
+            auto x = dw * ax + dx * aw + dy * az - dz * ay;
+            auto y = dw * ay - dx * az + dy * aw + dz * ax;
+            auto z = dw * az + dx * ay - dy * ax + dz * aw;
+            auto w = dw * aw - dx * ax - dy * ay - dz * az;
+            normalize(x, y, z, w);
+
+            simd::store(result.channel(pose::rx) + k, x);
+            simd::store(result.channel(pose::ry) + k, y);
+            simd::store(result.channel(pose::rz) + k, z);
+            simd::store(result.channel(pose::rw) + k, w);
+        }
+    }
+
+}
+
+void evaluate(animation_blender const & blender, pose & scratch, pose & result, float time_offset)
+{
+    bool first = true;
+    for (std::size_t i = 0; i < blender.layer_count(); ++i)
+    {
+        auto const & layer = blender.layer(i);
+        if (layer.weight <= 0.f)
+            continue;
+
+        assert(!layer.mask || layer.mask->weights.size() == simd::padded(layer.clip.bone_count()));
+
+        // The bottom full-body layer is the base pose; any other bottom layer is applied over the identity pose
+        if (first)
+        {
+            first = false;
+            if (is_full_body(layer))
+            {
+                layer.clip.sample(advance(layer, time_offset), result);
+                continue;
+            }
+            result.resize(layer.clip.bone_count());
+        }
+
+        layer.clip.sample(advance(layer, time_offset), scratch);
+        if (layer.mode == animation_layer::blend)
+            blend_layer(layer, scratch, result);
+        else
+            add_additive_layer(layer, scratch, result);
+    }
+}
+
+void evaluate(animation_blender const * blenders, std::size_t count, thread_pool & pool, pose * const * results)
+{
+    pool.parallel_for(count, 8, [&](std::size_t begin, std::size_t end)
+    {
+        thread_local pose scratch;
+        for (std::size_t i = begin; i < end; ++i)
+            evaluate(blenders[i], scratch, *results[i]);
+    });
+}
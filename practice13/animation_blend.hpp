@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "animation_baker.hpp"
+#include "animation_compression.hpp"
+#include "skeleton.hpp"
+#include "thread_pool.hpp"
+
+// Poses for one skeleton allocated up front; acquiring and releasing them never touches the heap
+class pose_pool
+{
+public:
+    pose_pool(std::size_t bone_count, std::size_t capacity);
+
+    pose_pool(pose_pool const &) = delete;
+    pose_pool & operator = (pose_pool const &) = delete;
+
+    // Throws once all poses are in use
+    pose * acquire();
+    void release(pose * pose);
+
+    std::size_t capacity() const { return poses.size(); }
+    std::size_t available() const { return free_poses.size(); }
+
+private:
+    std::vector<pose> poses;
+    std::vector<pose *> free_poses;
+};
+
+// Per-bone layer weights, padded like pose channels (padding lanes are zero)
+struct bone_mask
+{
+    std::vector<float> weights;
+};
+
+// Weight 1 for `root` and all its descendants, 0 for the rest of the skeleton
+bone_mask make_bone_mask(skeleton const & skeleton, std::uint32_t root);
+
+// Clip played by a layer: baked frames, or a compressed clip that takes several times less memory
+// and samples slower (benchmark.cpp reports both)
+class animation_clip
+{
+public:
+    animation_clip() = default;
+    animation_clip(baked_animation const & clip) : baked_clip(&clip) {}
+    animation_clip(compressed_animation const & clip) : compressed_clip(&clip) {}
+
+    explicit operator bool() const { return baked_clip || compressed_clip; }
+
+    baked_animation const * baked() const { return baked_clip; }
+    compressed_animation const * compressed() const { return compressed_clip; }
+
+    float duration() const { return baked_clip ? baked_clip->duration : compressed_clip->duration; }
+    std::size_t bone_count() const { return baked_clip ? baked_clip->bone_count : compressed_clip->bone_count(); }
+
+    // First frame with the layout of pose::data, the reference of additive layers
+    float const * first_frame() const { return baked_clip ? baked_clip->frame(0) : compressed_clip->first_frame.data.data(); }
+
+    void sample(float time, pose & result) const;
+
+private:
+    baked_animation const * baked_clip = nullptr;
+    compressed_animation const * compressed_clip = nullptr;
+};
+
+struct animation_layer
+{
+    enum mode_type
+    {
+        // Interpolates from the result of the layers below towards this clip
+        blend,
+        // Adds the clip's difference from its first frame on top of the layers below
+        additive,
+    };
+
+    animation_clip clip;
+    bone_mask const * mask = nullptr;
+    mode_type mode = blend;
+
+    float time = 0.f;
+    float speed = 1.f;
+    bool loop = true;
+
+    // The weight moves towards target_weight by fade_speed per second (or jumps to it when fade_speed is zero)
+    float weight = 1.f;
+    float target_weight = 1.f;
+    float fade_speed = 0.f;
+};
+
+// Blend stack of one character: layers are applied bottom to top, so evaluation costs one clip sample
+// and one blend per active layer, whatever the number of clips in the model. Layers are kept in a
+// fixed-size array, so playback never allocates.
+class animation_blender
+{
+public:
+    static constexpr std::size_t max_layers = 8;
+
+    // Crossfades from the current full-body clips to `clip` over `fade_duration` seconds (or switches
+    // immediately when it's zero); masked and additive layers keep playing on top
+    void play(animation_clip clip, float fade_duration = 0.f, float time = 0.f);
+
+    // Returns the index of the new layer, which may later shift as play() inserts clips below it;
+    // throws when all layers are in use
+    std::size_t add_layer(animation_layer const & layer);
+
+    animation_layer & layer(std::size_t index) { return layers[index]; }
+    animation_layer const & layer(std::size_t index) const { return layers[index]; }
+    std::size_t layer_count() const { return count; }
+
+    // Indices of the layers above shift down by one
+    void remove_layer(std::size_t index);
+
+    // Advances layer times and fades, and drops full-body layers hidden by a full-body layer at full weight above them
+    void update(float dt);
+
+private:
+
+    std::array<animation_layer, max_layers> layers;
+    std::size_t count = 0;
+};
+
+// `scratch` holds the sample of each layer before it's blended into `result`; layers are sampled
+// `time_offset` seconds ahead of their current time, without fading their weights
+void evaluate(animation_blender const & blender, pose & scratch, pose & result, float time_offset = 0.f);
+
+// Evaluates `count` characters across the pool; results[i] receives the pose of blenders[i]
+void evaluate(animation_blender const * blenders, std::size_t count, thread_pool & pool, pose * const * results);
@@ -0,0 +1,469 @@
+#include "animation_compression.hpp"
+#include "skeleton.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <glm/ext/matrix_transform.hpp>
+
+namespace
+{
+
+    using quantized_vec3 = compressed_animation::quantized_vec3;
+    using quantized_quat = compressed_animation::quantized_quat;
+
+    constexpr float max_u16 = 65535.f;
+    constexpr std::uint32_t max_u20 = (1u << 20) - 1;
+
+    // Smallest-three components lie within [-1/sqrt(2), 1/sqrt(2)]
+    constexpr float smallest_three_range = 0.70710678f;
+
+    std::uint16_t quantize_unit(float x, float max)
+    {
+        return static_cast<std::uint16_t>(std::lround(std::clamp(x, 0.f, 1.f) * max));
+    }
+
+    quantized_vec3 quantize(glm::vec3 const & v, compressed_animation::track const & track)
+    {
+        auto unit = [&](int i)
+        {
+            return (track.extent[i] > 0.f) ? (v[i] - track.min[i]) / track.extent[i] : 0.f;
+        };
+        return {quantize_unit(unit(0), max_u16), quantize_unit(unit(1), max_u16), quantize_unit(unit(2), max_u16)};
+    }
+
+    glm::vec3 dequantize(quantized_vec3 const & q, compressed_animation::track const & track)
+    {
+        return track.min + glm::vec3(q.x, q.y, q.z) * (track.extent / max_u16);
+    }
+
+    quantized_quat quantize(glm::quat const & q)
+    {
+        float const c[4] = {q.x, q.y, q.z, q.w};
+
+        int largest = 0;
+        for (int i = 1; i < 4; ++i)
+            if (std::abs(c[i]) > std::abs(c[largest]))
+                largest = i;
+
+        // q and -q are the same rotation, so the dropped component can always be made positive
+        float const sign = (c[largest] < 0.f) ? -1.f : 1.f;
+
+        std::uint64_t bits = std::uint64_t(largest) << 60;
+        for (int i = 0, shift = 40; i < 4; ++i)
+            if (i != largest)
+            {
+                float const unit = std::clamp((sign * c[i] / smallest_three_range + 1.f) * 0.5f, 0.f, 1.f);
+                bits |= std::uint64_t(std::llround(double(unit) * max_u20)) << shift;
+                shift -= 20;
+            }
+
+        return {bits};
+    }
+
+    glm::quat dequantize(quantized_quat const & q)
+    {
+        int const largest = int(q.bits >> 60);
+
+        auto component = [&](int shift)
+        {
+            return (float((q.bits >> shift) & max_u20) / max_u20 * 2.f - 1.f) * smallest_three_range;
+        };
+
+        float v[4] = {component(40), component(20), component(0), 0.f};
+        v[3] = std::sqrt(std::max(0.f, 1.f - v[0] * v[0] - v[1] * v[1] - v[2] * v[2]));
+
+        // Where x, y, z, w are found in v, depending on which component was dropped
+        static constexpr int order[4][4] =
+        {
+            {3, 0, 1, 2},
+            {0, 3, 1, 2},
+            {0, 1, 3, 2},
+            {0, 1, 2, 3},
+        };
+
+        auto const & o = order[largest];
+        return glm::quat(v[o[3]], v[o[0]], v[o[1]], v[o[2]]);
+    }
+
+    glm::vec3 interpolate(glm::vec3 const & a, glm::vec3 const & b, float t)
+    {
+        return a + (b - a) * t;
+    }
+
+    glm::quat interpolate(glm::quat const & a, glm::quat b, float t)
+    {
+        if (glm::dot(a, b) < 0.f)
+            b = -b;
+        return glm::normalize(glm::quat(a.w + (b.w - a.w) * t, a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t));
+    }
+
+    float difference(glm::vec3 const & a, glm::vec3 const & b)
+    {
+        return glm::distance(a, b);
+    }
+
+    float difference(glm::quat const & a, glm::quat const & b)
+    {
+        // Rotation angle between a and b; the chord between unit quaternions is 2 sin(angle / 4)
+        float const chord = std::min(glm::length(a - b), glm::length(a + b));
+        return 4.f * std::asin(std::min(1.f, chord / 2.f));
+    }
+
+    // Largest angle between the nlerp and the slerp of two rotations `angle` apart
+    float nlerp_deviation(float angle)
+    {
+        // In terms of the angle between the quaternions, which is half the rotation angle
+        float const half = 0.5f * angle;
+        float result = 0.f;
+        for (int k = 1; k < 32; ++k)
+        {
+            float const t = k / 32.f;
+            result = std::max(result, std::abs(std::atan2(t * std::sin(half), (1.f - t) + t * std::cos(half)) - t * half));
+        }
+        return 2.f * result;
+    }
+
+    // The exact sampler slerps between rotation keys while sampling nlerps, which strays from the arc
+    // between keys far apart; such intervals get evenly spaced keys on the arc until nlerp stays within
+    // `tolerance` of it
+    gltf_model::spline<glm::quat> refine_rotations(gltf_model::spline<glm::quat> const & spline, float time_step, float tolerance)
+    {
+        gltf_model::spline<glm::quat> result;
+        for (std::size_t i = 0; i < spline.values.size(); ++i)
+        {
+            if (i > 0)
+            {
+                glm::quat const & a = spline.values[i - 1];
+                glm::quat const & b = spline.values[i];
+                float const angle = 2.f * std::acos(std::min(1.f, std::abs(glm::dot(a, b))));
+
+                // Keys closer than the quantized time step would collapse
+                float const begin = spline.timestamps[i - 1];
+                float const end = spline.timestamps[i];
+                int const max_parts = std::max(1, static_cast<int>((end - begin) / time_step));
+
+                int parts = 1;
+                while (parts < max_parts && nlerp_deviation(angle / parts) > tolerance)
+                    ++parts;
+
+                // On the grid of quantized times, so that the keys keep their values exactly where sampling puts them
+                for (int k = 1; k < parts; ++k)
+                {
+                    float const time = std::round((begin + (end - begin) * k / parts) / time_step) * time_step;
+                    if (time <= result.timestamps.back() || time >= end)
+                        continue;
+                    result.timestamps.push_back(time);
+                    result.values.push_back(glm::slerp(a, b, (time - begin) / (end - begin)));
+                }
+            }
+            result.timestamps.push_back(spline.timestamps[i]);
+            result.values.push_back(spline.values[i]);
+        }
+        return result;
+    }
+
+    // Seconds per unit of quantized key time. Exported clips usually have all keys on a grid of frames,
+    // which are then split into a whole number of units, so that source key times stay exact; other clips
+    // get their duration split into 65535 units
+    float time_step(gltf_model::animation const & animation)
+    {
+        float frame = std::numeric_limits<float>::infinity();
+        for (auto const & bone : animation.bones)
+            for (auto const * timestamps : {&bone.translation.timestamps, &bone.rotation.timestamps, &bone.scale.timestamps})
+                for (std::size_t i = 1; i < timestamps->size(); ++i)
+                    if (float const interval = (*timestamps)[i] - (*timestamps)[i - 1]; interval > 1e-6f)
+                        frame = std::min(frame, interval);
+
+        // Rounding errors of the key times add up in the shortest interval, the clip duration averages them out
+        if (frame < animation.max_time)
+            frame = animation.max_time / std::round(animation.max_time / frame);
+
+        bool on_grid = frame < std::numeric_limits<float>::infinity() && animation.max_time / frame < max_u16;
+        for (auto const & bone : animation.bones)
+            for (auto const * timestamps : {&bone.translation.timestamps, &bone.rotation.timestamps, &bone.scale.timestamps})
+                for (std::size_t i = 0; i < timestamps->size() && on_grid; ++i)
+                    on_grid = std::abs((*timestamps)[i] / frame - std::round((*timestamps)[i] / frame)) < 1e-3f;
+
+        if (on_grid)
+            return frame / std::floor(max_u16 / std::ceil(animation.max_time / frame - 1e-3f));
+        return (animation.max_time > 0.f) ? animation.max_time / max_u16 : 1.f;
+    }
+
+    std::uint16_t quantize_time(float time, float time_step)
+    {
+        return static_cast<std::uint16_t>(std::clamp(std::lround(time / time_step), 0l, long(max_u16)));
+    }
+
+    // Greedily extends every interpolated segment as long as all source keys it spans, including the kept
+    // ones at its ends, stay within tolerance. The error is measured with quantized values at the source key
+    // times, i.e. exactly what sampling will see, so that quantization counts against the tolerance too
+    template <typename T, typename Key, typename Quantize, typename Dequantize>
+    void compress_track(gltf_model::spline<T> const & spline, T const & fallback, float time_step, float tolerance,
+        compressed_animation::channel<Key> & channel, compressed_animation::track track, Quantize && quantize, Dequantize && dequantize)
+    {
+        track.first_key = channel.keys.size();
+
+        auto add_key = [&](std::uint16_t time, T const & value)
+        {
+            channel.times.push_back(time);
+            channel.keys.push_back(quantize(value));
+        };
+
+        if (spline.values.empty())
+        {
+            add_key(0, fallback);
+            track.key_count = 1;
+            channel.tracks.push_back(track);
+            return;
+        }
+
+        std::size_t const count = spline.values.size();
+
+        std::vector<std::uint16_t> times(count);
+        for (std::size_t i = 0; i < count; ++i)
+            times[i] = quantize_time(spline.timestamps[i], time_step);
+
+        auto reconstructs = [&](std::size_t begin, std::size_t end)
+        {
+            auto const a = dequantize(quantize(spline.values[begin]));
+            auto const b = dequantize(quantize(spline.values[end]));
+            for (std::size_t k = begin; k <= end; ++k)
+            {
+                float const time = spline.timestamps[k] / time_step;
+                float const t = (times[end] > times[begin]) ? std::clamp((time - times[begin]) / (times[end] - times[begin]), 0.f, 1.f) : 0.f;
+                if (difference(interpolate(a, b, t), spline.values[k]) > tolerance)
+                    return false;
+            }
+            return true;
+        };
+
+        // A track that never leaves the tolerance of its first key collapses to a single key
+        bool constant = true;
+        for (std::size_t k = 0; k < count && constant; ++k)
+            constant = difference(dequantize(quantize(spline.values[0])), spline.values[k]) <= tolerance;
+
+        if (constant)
+        {
+            add_key(times[0], spline.values[0]);
+        }
+        else
+        {
+            std::size_t anchor = 0;
+            add_key(times[0], spline.values[0]);
+            for (std::size_t end = 2; end < count; ++end)
+            {
+                if (!reconstructs(anchor, end))
+                {
+                    anchor = end - 1;
+                    add_key(times[anchor], spline.values[anchor]);
+                }
+            }
+            if (count > 1)
+                add_key(times[count - 1], spline.values[count - 1]);
+        }
+
+        track.key_count = channel.keys.size() - track.first_key;
+        channel.tracks.push_back(track);
+    }
+
+    compressed_animation::track value_range(std::vector<glm::vec3> const & values)
+    {
+        compressed_animation::track track;
+        if (values.empty())
+            return track;
+
+        glm::vec3 min = values[0];
+        glm::vec3 max = values[0];
+        for (auto const & v : values)
+        {
+            min = glm::min(min, v);
+            max = glm::max(max, v);
+        }
+
+        track.min = min;
+        track.extent = max - min;
+        return track;
+    }
+
+    // Finds the pair of keys around `time` and the interpolation factor between them
+    std::pair<std::uint32_t, float> locate(std::uint16_t const * times, std::uint32_t count, float time)
+    {
+        if (count == 1)
+            return {0, 0.f};
+
+        auto const it = std::upper_bound(times + 1, times + count - 1, time, [](float t, std::uint16_t v){ return t < v; });
+        std::uint32_t const i = it - times - 1;
+        float const t = (time - times[i]) / std::max(1, times[i + 1] - times[i]);
+        return {i, std::clamp(t, 0.f, 1.f)};
+    }
+
+}
+
+compressed_animation compress_animation(gltf_model::animation const & animation, std::vector<gltf_model::bone> const & bones,
+    compression_settings const & settings)
+{
+    assert(animation.bones.size() == bones.size());
+
+    std::size_t const bone_count = bones.size();
+
+    // The skeleton at the first key of every track. Tolerances apply in the space of the tracks, which
+    // the bind matrices don't give, as they may include a scale of the mesh
+    std::vector<glm::mat4> global(bone_count);
+    std::vector<glm::vec3> positions(bone_count);
+    glm::vec3 min(std::numeric_limits<float>::infinity());
+    glm::vec3 max(-std::numeric_limits<float>::infinity());
+    for (std::size_t i = 0; i < bone_count; ++i)
+    {
+        auto first = [](auto const & spline, auto const & fallback){ return spline.values.empty() ? fallback : spline.values[0]; };
+        auto const & bone = animation.bones[i];
+        glm::mat4 const local = glm::translate(glm::mat4(1.f), first(bone.translation, glm::vec3(0.f)))
+            * glm::toMat4(first(bone.rotation, glm::quat(1.f, 0.f, 0.f, 0.f)))
+            * glm::scale(glm::mat4(1.f), first(bone.scale, glm::vec3(1.f)));
+        global[i] = (bones[i].parent != skeleton::no_parent) ? global[bones[i].parent] * local : local;
+
+        positions[i] = glm::vec3(global[i][3]);
+        min = glm::min(min, positions[i]);
+        max = glm::max(max, positions[i]);
+    }
+
+    float const size = (bone_count > 0) ? std::max(1e-6f, glm::distance(min, max)) : 1.f;
+
+    // Parents precede children, so depth is computed top-down and reach/height bottom-up
+    std::vector<std::size_t> depth(bone_count, 1), height(bone_count, 1);
+    std::vector<float> reach(bone_count, 0.f);
+    for (std::size_t i = 0; i < bone_count; ++i)
+        if (bones[i].parent != skeleton::no_parent)
+            depth[i] = depth[bones[i].parent] + 1;
+    for (std::size_t i = bone_count; i-- > 0;)
+    {
+        reach[i] = std::max(reach[i], settings.shell_distance * size);
+        if (bones[i].parent != skeleton::no_parent)
+        {
+            auto const parent = bones[i].parent;
+            height[parent] = std::max(height[parent], height[i] + 1);
+            reach[parent] = std::max(reach[parent], glm::distance(positions[parent], positions[i]) + reach[i]);
+        }
+    }
+
+    // Largest and smallest factor by which a joint's transform stretches lengths along its axes
+    auto stretch = [&](std::size_t i, auto const & select)
+    {
+        if (i >= bone_count)
+            return 1.f;
+        return select(glm::length(glm::vec3(global[i][0])), select(glm::length(glm::vec3(global[i][1])), glm::length(glm::vec3(global[i][2]))));
+    };
+    auto const larger = [](float a, float b){ return std::max(a, b); };
+    auto const smaller = [](float a, float b){ return std::min(a, b); };
+
+    compressed_animation result;
+    result.duration = animation.max_time;
+    result.time_step = time_step(animation);
+    result.error_bound = settings.tolerance * size;
+
+    for (std::size_t i = 0; i < bone_count; ++i)
+    {
+        auto const & bone = animation.bones[i];
+        auto const parent = bones[i].parent;
+
+        // Each bone of the longest chain through it gets an equal share of the error bound, split evenly
+        // between its rotation and those of its translation and scale that change, as constant ones are
+        // quantized exactly. A translation error moves the joint and all its descendants, scaled by the
+        // parent's transform; rotation and scale errors move the descendants within `reach` of the joint.
+        auto varies = [](auto const & spline)
+        {
+            return std::any_of(spline.values.begin(), spline.values.end(), [&](auto const & v){ return v != spline.values[0]; });
+        };
+        float const shares = 1.f + varies(bone.translation) + varies(bone.scale);
+        float const error = result.error_bound / (depth[i] + height[i] - 1) / shares;
+        float const parent_stretch = stretch(parent, larger);
+        float const translation_tolerance = error / parent_stretch;
+        float const angle_tolerance = error * stretch(parent, smaller) / (parent_stretch * reach[i]);
+        float const scale_tolerance = error * stretch(i, smaller) / (parent_stretch * reach[i]);
+
+        auto translation_track = value_range(bone.translation.values);
+        compress_track(bone.translation, glm::vec3(0.f), result.time_step, translation_tolerance, result.translation, translation_track,
+            [&](glm::vec3 const & v){ return quantize(v, translation_track); },
+            [&](quantized_vec3 const & q){ return dequantize(q, translation_track); });
+
+        // A quarter of the rotation error goes to the difference between nlerp and slerp
+        compress_track(refine_rotations(bone.rotation, result.time_step, angle_tolerance / 4.f), glm::quat(1.f, 0.f, 0.f, 0.f), result.time_step,
+            angle_tolerance * 3.f / 4.f, result.rotation, {},
+            [](glm::quat const & q){ return quantize(q); },
+            [](quantized_quat const & q){ return dequantize(q); });
+
+        auto scale_track = value_range(bone.scale.values);
+        if (bone.scale.values.empty())
+            scale_track.min = glm::vec3(1.f);
+        compress_track(bone.scale, glm::vec3(1.f), result.time_step, scale_tolerance, result.scale, scale_track,
+            [&](glm::vec3 const & v){ return quantize(v, scale_track); },
+            [&](quantized_vec3 const & q){ return dequantize(q, scale_track); });
+    }
+
+    sample(result, 0.f, result.first_frame);
+
+    return result;
+}
+
+void sample(compressed_animation const & animation, float time, pose & result)
+{
+    std::size_t const bone_count = animation.bone_count();
+    if (result.bone_count != bone_count)
+        result.resize(bone_count);
+
+    // Time in the units of the quantized key times
+    float const qtime = std::clamp(time, 0.f, animation.duration) / animation.time_step;
+
+    for (std::size_t i = 0; i < bone_count; ++i)
+    {
+        auto sample_vec3 = [&](compressed_animation::channel<quantized_vec3> const & channel)
+        {
+            auto const & track = channel.tracks[i];
+            auto [k, t] = locate(channel.times.data() + track.first_key, track.key_count, qtime);
+            auto const * keys = channel.keys.data() + track.first_key;
+            if (track.key_count == 1)
+                return dequantize(keys[0], track);
+            return interpolate(dequantize(keys[k], track), dequantize(keys[k + 1], track), t);
+        };
+
+        glm::quat rotation;
+        {
+            auto const & track = animation.rotation.tracks[i];
+            auto [k, t] = locate(animation.rotation.times.data() + track.first_key, track.key_count, qtime);
+            auto const * keys = animation.rotation.keys.data() + track.first_key;
+            rotation = (track.key_count == 1) ? dequantize(keys[0]) : interpolate(dequantize(keys[k]), dequantize(keys[k + 1]), t);
+        }
+
+        result.set(i, sample_vec3(animation.translation), rotation, sample_vec3(animation.scale));
+    }
+}
+
+std::size_t compressed_animation::size_in_bytes() const
+{
+    std::size_t result = sizeof(*this);
+    auto add = [&](auto const & channel)
+    {
+        result += channel.tracks.size() * sizeof(channel.tracks[0]);
+        result += channel.times.size() * sizeof(channel.times[0]);
+        result += channel.keys.size() * sizeof(channel.keys[0]);
+    };
+    add(translation);
+    add(rotation);
+    add(scale);
+    result += first_frame.data.size() * sizeof(float);
+    return result;
+}
+
+std::size_t size_in_bytes(gltf_model::animation const & animation)
+{
+    std::size_t result = sizeof(animation);
+    for (auto const & bone : animation.bones)
+    {
+        result += sizeof(bone);
+        result += bone.translation.timestamps.size() * sizeof(float) + bone.translation.values.size() * sizeof(glm::vec3);
+        result += bone.rotation.timestamps.size() * sizeof(float) + bone.rotation.values.size() * sizeof(glm::quat);
+        result += bone.scale.timestamps.size() * sizeof(float) + bone.scale.values.size() * sizeof(glm::vec3);
+    }
+    return result;
+}
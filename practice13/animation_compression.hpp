@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+
+#include "gltf_loader.hpp"
+#include "pose.hpp"
+
+// Lossy compressed animation clip. Keys that linear interpolation can reconstruct are dropped,
+// key times are stored as 16-bit multiples of time_step, rotations as smallest-three
+// quaternions (2-bit index + 3 x 20-bit components = 62 bits) and translations/scales as
+// 16-bit values quantized to the per-track range.
+struct compressed_animation
+{
+    struct quantized_vec3
+    {
+        std::uint16_t x, y, z;
+    };
+
+    struct quantized_quat
+    {
+        // Index of the dropped component in the top bits, then three 20-bit components
+        std::uint64_t bits;
+    };
+
+    struct track
+    {
+        std::uint32_t first_key = 0;
+        std::uint32_t key_count = 0;
+
+        // Range of the quantized values, unused for rotations
+        glm::vec3 min{0.f};
+        glm::vec3 extent{0.f};
+    };
+
+    template <typename Key>
+    struct channel
+    {
+        // One track per bone, each referencing a range of times and keys
+        std::vector<track> tracks;
+        std::vector<std::uint16_t> times;
+        std::vector<Key> keys;
+    };
+
+    float duration = 0.f;
+
+    // Seconds per unit of key time
+    float time_step = 1.f;
+
+    // Largest joint position error the compression allowed, i.e. compression_settings::tolerance times the skeleton size
+    float error_bound = 0.f;
+
+    channel<quantized_vec3> translation;
+    channel<quantized_quat> rotation;
+    channel<quantized_vec3> scale;
+
+    // Decompressed pose at time zero, kept for additive layers that play the clip
+    pose first_frame;
+
+    std::size_t bone_count() const { return rotation.tracks.size(); }
+    std::size_t size_in_bytes() const;
+};
+
+struct compression_settings
+{
+    // Largest allowed position error of any joint, as a fraction of the size of the skeleton at the first
+    // key of the clip. It is split evenly along the longest bone chain and checked at every source key
+    // including quantization, so errors of ancestors add up to at most this much, up to first order
+    // terms and as long as the clip keeps bone lengths close to those of its first key
+    float tolerance = 1e-4f;
+
+    // Distance (as a fraction of the skeleton size) at which rotation and scale errors of leaf bones
+    // are measured, standing in for the skinned vertices around them
+    float shell_distance = 0.05f;
+};
+
+compressed_animation compress_animation(gltf_model::animation const & animation, std::vector<gltf_model::bone> const & bones,
+    compression_settings const & settings = {});
+
+void sample(compressed_animation const & animation, float time, pose & result);
+
+std::size_t size_in_bytes(gltf_model::animation const & animation);
@@ -0,0 +1,133 @@
+#include "animation_lod.hpp"
+
+#include <cmath>
+#include <array>
+
+animation_scheduler::animation_scheduler(std::size_t bone_count, std::size_t instance_count, animation_lod_settings const & settings)
+    : bones(bone_count)
+    , settings(settings)
+    , max_level(std::log2(std::max<std::size_t>(1, settings.max_interval)))
+    , max_budget_level(std::max<std::size_t>(max_level, std::log2(std::max<std::size_t>(1, settings.max_budget_interval))))
+    , instances(instance_count)
+    , keys(2 * instance_count * bone_count)
+{
+    assert(max_budget_level < 16);
+    updates.reserve(instance_count);
+}
+
+glm::mat4 * animation_scheduler::key(std::size_t instance, std::size_t index)
+{
+    return keys.data() + (2 * instance + index) * bones;
+}
+
+glm::mat4 const * animation_scheduler::key(std::size_t instance, std::size_t index) const
+{
+    return keys.data() + (2 * instance + index) * bones;
+}
+
+glm::mat4 * animation_scheduler::next_key(std::size_t instance)
+{
+    return key(instance, instances[instance].key);
+}
+
+std::vector<animation_scheduler::update> const & animation_scheduler::schedule(float const * projected_sizes)
+{
+    ++frame;
+
+    std::array<std::size_t, 16> histogram{};
+    for (std::size_t i = 0; i < instances.size(); ++i)
+    {
+        float const size = projected_sizes[i];
+        std::size_t level = max_level;
+        if (size > 0.f)
+            level = std::clamp<float>(std::ceil(std::log2(settings.full_rate_size / size)), 0.f, max_level);
+        instances[i].level = level;
+        ++histogram[level];
+    }
+
+    // Smallest uniform bias of the levels that keeps the expected number of updates within the budget
+    std::size_t bias = 0;
+    for (;; ++bias)
+    {
+        expected_load = 0.f;
+        for (std::size_t level = 0; level <= max_level; ++level)
+            expected_load += histogram[level] / float(std::size_t(1) << std::min(level + bias, max_budget_level));
+
+        if (settings.update_budget <= 0.f || expected_load <= settings.update_budget || bias >= max_budget_level)
+            break;
+    }
+
+    updates.clear();
+    for (std::size_t i = 0; i < instances.size(); ++i)
+    {
+        auto & instance = instances[i];
+        instance.level = std::min(instance.level + bias, max_budget_level);
+
+        if (frame < instance.next_update)
+            continue;
+
+        // The next update falls on the first frame aligned to the interval, shifted by the instance index
+        std::size_t const interval = std::size_t(1) << instance.level;
+        std::size_t const frames = interval - (frame + i) % interval;
+
+        instance.initialized = (instance.last_update != 0);
+        instance.last_update = frame;
+        instance.next_update = frame + frames;
+        instance.key ^= 1;
+
+        updates.push_back({i, frames});
+    }
+
+    return updates;
+}
+
+void animation_scheduler::interpolate(thread_pool & pool, glm::mat4 * result) const
+{
+    std::size_t const key_size = bones * 16;
+
+    pool.parallel_for(instances.size(), 16, [&](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            auto const & instance = instances[i];
+            float const * from = &key(i, instance.key ^ 1)[0][0][0];
+            float const * to = &key(i, instance.key)[0][0][0];
+            float * out = &result[i * bones][0][0];
+
+            // Until its second key arrives, an instance just shows the first one
+            float alpha = 1.f;
+            if (instance.initialized)
+                alpha = float(frame - instance.last_update) / float(instance.next_update - instance.last_update);
+
+            auto const t = simd::splat(alpha);
+            for (std::size_t k = 0; k < key_size; k += simd::width)
+                simd::store(out + k, simd::lerp(simd::load(from + k), simd::load(to + k), t));
+        }
+    });
+}
+
+float projected_size(glm::vec3 const & center, float radius, glm::mat4 const & view, float fov_y)
+{
+    float const depth = -(view * glm::vec4(center, 1.f)).z;
+    if (depth + radius <= 0.f)
+        return 0.f;
+    return std::min(1.f, radius / (std::max(depth, radius) * std::tan(fov_y / 2.f)));
+}
+
+void animate(animation_scheduler & scheduler, skeleton const & skeleton, animation_blender const * blenders, float frame_time, thread_pool & pool)
+{
+    auto const & updates = scheduler.scheduled();
+
+    pool.parallel_for(updates.size(), 4, [&](std::size_t begin, std::size_t end)
+    {
+        thread_local pose scratch, result;
+        thread_local skeleton_workspace workspace;
+
+        for (std::size_t u = begin; u < end; ++u)
+        {
+            auto const & update = updates[u];
+            evaluate(blenders[update.instance], scratch, result, update.frames * frame_time);
+            compute_bone_matrices(skeleton, result, workspace, scheduler.next_key(update.instance));
+        }
+    });
+}
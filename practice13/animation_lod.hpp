@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+
+#include "animation_blend.hpp"
+#include "skeleton.hpp"
+#include "thread_pool.hpp"
+
+struct animation_lod_settings
+{
+    // Instances whose projected height is at least this fraction of the viewport update every frame;
+    // each halving of the size doubles the update interval, up to max_interval frames
+    float full_rate_size = 0.25f;
+    std::size_t max_interval = 8;
+
+    // Upper bound on the average number of instances evaluated per frame (0 = unlimited): when exceeded,
+    // all intervals are scaled up by the same power of two, up to max_budget_interval frames
+    float update_budget = 0.f;
+    std::size_t max_budget_interval = 64;
+};
+
+// Updates distant characters every Nth frame instead of every frame. An instance due for an update
+// is evaluated ahead, at the time of its next update, and the frames in between interpolate the
+// skinning matrices of the previous key towards it. Updates are staggered by instance index, so
+// that with power-of-two intervals every frame evaluates about the same number of instances.
+class animation_scheduler
+{
+public:
+    struct update
+    {
+        std::size_t instance;
+
+        // Frames until the next update of the instance: the new key should be evaluated this far ahead
+        std::size_t frames;
+    };
+
+    animation_scheduler(std::size_t bone_count, std::size_t instance_count, animation_lod_settings const & settings = {});
+
+    // Starts a new frame: picks update intervals from the projected sizes (fraction of the viewport height,
+    // zero for invisible instances) and returns the instances that need a new key this frame
+    std::vector<update> const & schedule(float const * projected_sizes);
+
+    std::vector<update> const & scheduled() const { return updates; }
+
+    // Where to write the new key of an instance returned by schedule()
+    glm::mat4 * next_key(std::size_t instance);
+
+    // Writes the skinning matrices of all instances for the current frame, instance after instance
+    void interpolate(thread_pool & pool, glm::mat4 * result) const;
+
+    std::size_t bone_count() const { return bones; }
+    std::size_t instance_count() const { return instances.size(); }
+    std::size_t interval(std::size_t instance) const { return std::size_t(1) << instances[instance].level; }
+
+    // Expected number of updates per frame with the current intervals
+    float load() const { return expected_load; }
+
+private:
+    struct instance_state
+    {
+        std::uint64_t last_update = 0;
+        std::uint64_t next_update = 0;
+        std::uint8_t level = 0;
+        std::uint8_t key = 0;
+        // Set once the instance has two keys to interpolate between
+        bool initialized = false;
+    };
+
+    glm::mat4 * key(std::size_t instance, std::size_t index);
+    glm::mat4 const * key(std::size_t instance, std::size_t index) const;
+
+    std::size_t bones;
+    animation_lod_settings settings;
+    std::size_t max_level;
+    std::size_t max_budget_level;
+
+    std::uint64_t frame = 0;
+    float expected_load = 0.f;
+
+    std::vector<instance_state> instances;
+    std::vector<glm::mat4> keys;
+    std::vector<update> updates;
+};
+
+// Fraction of the viewport height covered by a sphere, for a perspective projection with vertical field of view fov_y
+float projected_size(glm::vec3 const & center, float radius, glm::mat4 const & view, float fov_y);
+
+// Evaluates the instances returned by the last schedule() call across the pool, each one
+// `frames * frame_time` seconds ahead, and stores their skinning matrices as new keys
+void animate(animation_scheduler & scheduler, skeleton const & skeleton, animation_blender const * blenders, float frame_time, thread_pool & pool);
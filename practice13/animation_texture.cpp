@@ -0,0 +1,25 @@
+#include "animation_texture.hpp"
+
+#include <stdexcept>
+#include <string>
+
+animation_texture::animation_texture(animation_atlas const & atlas)
+{
+    GLint max_size;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    if (atlas.row_width() > static_cast<std::size_t>(max_size) || atlas.frame_count() > static_cast<std::size_t>(max_size))
+        throw std::runtime_error("Animation atlas exceeds GL_MAX_TEXTURE_SIZE = " + std::to_string(max_size));
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, atlas.row_width(), atlas.frame_count(), 0, GL_RGBA, GL_FLOAT, atlas.texels.data());
+}
+
+animation_texture::~animation_texture()
+{
+    glDeleteTextures(1, &texture);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "animation_atlas.hpp"
+
+// An animation atlas uploaded as an RGBA32F texture: x is bone_index * 3 + matrix row, y is the frame.
+// Instances that play the same clip at the same time fetch the very same texels, so a crowd costs
+// no per-frame CPU work and its texture traffic shrinks with the number of distinct clip times.
+class animation_texture
+{
+public:
+    explicit animation_texture(animation_atlas const & atlas);
+    ~animation_texture();
+
+    animation_texture(animation_texture const &) = delete;
+    animation_texture & operator = (animation_texture const &) = delete;
+
+    GLuint texture_handle() const { return texture; }
+
+private:
+    GLuint texture;
+};
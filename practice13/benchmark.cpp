@@ -0,0 +1,359 @@
+// Measures the CPU animation pipeline on the practice models, without creating a window
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include "gltf_loader.hpp"
+#include "animation_baker.hpp"
+#include "animation_compression.hpp"
+#include "skeleton.hpp"
+#include "cpu_skinning.hpp"
+#include "thread_pool.hpp"
+#include "animation_atlas.hpp"
+#include "animation_blend.hpp"
+#include "animation_lod.hpp"
+#include "morph_targets.hpp"
+#include "render_queue.hpp"
+
+template <typename F>
+double measure_ms(int repetitions, F && f)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < repetitions; ++i)
+        f();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / repetitions;
+}
+
+// Largest distance between the model-space joint positions given by the exact sampler and by the
+// compressed clip, over the clip sampled at 240 Hz
+float max_joint_error(skeleton const & rig, gltf_model::animation const & source, compressed_animation const & compressed)
+{
+    skeleton_workspace workspace;
+    pose exact_pose, compressed_pose;
+    std::vector<glm::mat4> exact_matrices(rig.bone_count()), compressed_matrices(rig.bone_count());
+
+    // Skinning matrices map bind-pose positions, so a joint is its skinning matrix applied to its bind position
+    std::vector<glm::vec4> joints(rig.bone_count());
+    for (std::size_t b = 0; b < rig.bone_count(); ++b)
+        joints[b] = glm::inverse(rig.inverse_bind_matrices[b])[3];
+
+    float result = 0.f;
+    for (float time = 0.f; time <= compressed.duration; time += 1.f / 240.f)
+    {
+        sample(source, time, exact_pose);
+        sample(compressed, time, compressed_pose);
+        compute_bone_matrices(rig, exact_pose, workspace, exact_matrices.data());
+        compute_bone_matrices(rig, compressed_pose, workspace, compressed_matrices.data());
+        for (std::size_t b = 0; b < rig.bone_count(); ++b)
+            result = std::max(result, glm::distance(glm::vec3(exact_matrices[b] * joints[b]), glm::vec3(compressed_matrices[b] * joints[b])));
+    }
+    return result;
+}
+
+void benchmark_model(std::string const & path, std::size_t instance_count)
+{
+    auto const model = load_gltf(path);
+
+    auto const & [animation_name, source_animation] = *model.animations.begin();
+    auto const animation = bake_animation(source_animation);
+    skeleton const rig(model.bones);
+
+    std::vector<skinning_source> sources;
+    std::size_t vertex_count = 0;
+    for (auto const & mesh : model.meshes)
+        for (auto const & primitive : mesh.primitives)
+        {
+            sources.emplace_back(model, primitive);
+            vertex_count += sources.back().vertex_count;
+        }
+
+    std::cout << path << ": " << rig.bone_count() << " bones, " << vertex_count << " vertices, clip \"" << animation_name << "\", "
+        << instance_count << " instances" << std::endl;
+
+    std::vector<pose> poses(instance_count);
+    double const sample_ms = measure_ms(20, [&]{
+        for (std::size_t i = 0; i < instance_count; ++i)
+            sample(animation, std::fmod(i * 0.037f, animation.duration), poses[i]);
+    });
+
+    auto const compressed = compress_animation(source_animation, model.bones);
+    double const compressed_sample_ms = measure_ms(20, [&]{
+        for (std::size_t i = 0; i < instance_count; ++i)
+            sample(compressed, std::fmod(i * 0.037f, compressed.duration), poses[i]);
+    });
+    std::cout << "    sampling: " << sample_ms << " ms baked, " << compressed_sample_ms << " ms compressed" << std::endl;
+
+    for (auto const & [name, clip] : model.animations)
+    {
+        auto const compressed_clip = (name == animation_name) ? compressed : compress_animation(clip, model.bones);
+        float const error = max_joint_error(rig, clip, compressed_clip);
+        std::cout << "    compressed \"" << name << "\": " << compressed_clip.size_in_bytes() / 1024.0 << " KB of " << size_in_bytes(clip) / 1024.0
+            << " KB source tracks, max joint error " << error << " of " << compressed_clip.error_bound
+            << " allowed" << std::endl;
+        if (error > compressed_clip.error_bound)
+            throw std::runtime_error("Compressed clip \"" + name + "\" exceeds its error bound");
+    }
+
+    // Blend stacks alternating masked and additive layers on top of the base clip
+    {
+        thread_pool single_thread(1);
+        pose_pool blend_poses(rig.bone_count(), instance_count);
+        std::vector<pose *> blended(instance_count);
+        for (auto & pose : blended)
+            pose = blend_poses.acquire();
+
+        bone_mask const mask = make_bone_mask(rig, rig.bone_count() / 2);
+
+        for (std::size_t layer_count = 1; layer_count <= 4; layer_count *= 2)
+        {
+            std::vector<animation_blender> blenders(instance_count);
+            for (std::size_t i = 0; i < instance_count; ++i)
+            {
+                blenders[i].play(animation, 0.f, std::fmod(i * 0.037f, animation.duration));
+                for (std::size_t l = 1; l < layer_count; ++l)
+                {
+                    animation_layer layer;
+                    layer.clip = animation;
+                    layer.mask = (l % 2) ? &mask : nullptr;
+                    layer.mode = (l % 2) ? animation_layer::blend : animation_layer::additive;
+                    layer.time = std::fmod(i * 0.053f * l, animation.duration);
+                    layer.weight = 0.5f;
+                    blenders[i].add_layer(layer);
+                }
+            }
+
+            double const blend_ms = measure_ms(20, [&]{ evaluate(blenders.data(), instance_count, single_thread, blended.data()); });
+            std::cout << "    blending " << layer_count << " layer(s): " << blend_ms << " ms" << std::endl;
+        }
+    }
+
+    animation_atlas atlas;
+    double const atlas_ms = measure_ms(1, [&]{
+        for (auto const & [name, clip] : model.animations)
+            add_clip(atlas, rig, clip);
+    });
+    std::cout << "    animation texture: " << atlas.clips.size() << " clips, " << atlas.row_width() << " x " << atlas.frame_count() << " texels, "
+        << atlas.texels.size() * sizeof(float) / (1024.0 * 1024.0) << " MB, baked in " << atlas_ms << " ms" << std::endl;
+
+    std::vector<glm::mat4> bone_matrices(instance_count * rig.bone_count());
+    std::vector<skinned_vertex> output(instance_count * vertex_count);
+
+    for (std::size_t threads = 1; threads <= std::max(1u, std::thread::hardware_concurrency()); threads *= 2)
+    {
+        thread_pool pool(threads);
+
+        double const skeleton_ms = measure_ms(20, [&]{
+            compute_bone_matrices(rig, poses.data(), instance_count, pool, bone_matrices.data());
+        });
+
+        skinning_batch batch;
+        for (std::size_t i = 0, offset = 0; i < instance_count; ++i)
+            for (auto const & source : sources)
+            {
+                batch.add({&source, bone_matrices.data() + i * rig.bone_count(), output.data() + offset});
+                offset += source.vertex_count;
+            }
+
+        double const skinning_ms = measure_ms(10, [&]{ batch.run(pool); });
+
+        std::cout << "    " << threads << " thread(s): skeletons " << skeleton_ms << " ms, skinning " << skinning_ms << " ms = "
+            << (instance_count * vertex_count) / (skinning_ms * 1e3) << " M vertices/s" << std::endl;
+    }
+}
+
+// Crowds of growing size seen from the middle of their edge: with an update budget,
+// the number of evaluated characters per frame stays flat while the crowd grows
+void benchmark_animation_lod(std::string const & path)
+{
+    auto const model = load_gltf(path);
+    auto const animation = bake_animation(model.animations.begin()->second);
+    skeleton const rig(model.bones);
+    thread_pool pool(1);
+
+    std::cout << path << ": update-rate LOD" << std::endl;
+
+    float const frame_time = 1.f / 60.f;
+    float const fov_y = glm::pi<float>() / 2.f;
+    int const frame_count = 64;
+
+    for (std::size_t instance_count = 256; instance_count <= 4096; instance_count *= 4)
+    {
+        // Characters spread over a square whose area grows with their count, one per square meter
+        float const side = std::sqrt(float(instance_count));
+        std::default_random_engine rng;
+        std::uniform_real_distribution<float> distribution(0.f, side);
+
+        glm::mat4 const view = glm::translate(glm::mat4(1.f), glm::vec3(-side / 2.f, -1.f, -1.f));
+
+        std::vector<float> sizes(instance_count);
+        std::vector<animation_blender> blenders(instance_count);
+        for (std::size_t i = 0; i < instance_count; ++i)
+        {
+            glm::vec3 const position(distribution(rng), 1.f, -distribution(rng));
+            sizes[i] = projected_size(position, 1.f, view, fov_y);
+            blenders[i].play(animation, 0.f, std::fmod(i * 0.037f, animation.duration));
+        }
+        std::vector<float> const full_sizes(instance_count, 1.f);
+
+        std::vector<glm::mat4> bone_matrices(instance_count * rig.bone_count());
+
+        for (float budget : {0.f, 128.f})
+        {
+            animation_lod_settings settings;
+            settings.update_budget = budget;
+
+            for (bool lod : {false, true})
+            {
+                if (!lod && budget > 0.f)
+                    continue;
+
+                animation_scheduler scheduler(rig.bone_count(), instance_count, settings);
+                std::size_t updates = 0;
+                double const frame_ms = measure_ms(frame_count, [&]{
+                    for (auto & blender : blenders)
+                        blender.update(frame_time);
+                    updates += scheduler.schedule(lod ? sizes.data() : full_sizes.data()).size();
+                    animate(scheduler, rig, blenders.data(), frame_time, pool);
+                    scheduler.interpolate(pool, bone_matrices.data());
+                });
+
+                std::cout << "    " << instance_count << " instances, " << (lod ? "LOD" : "full rate");
+                if (budget > 0.f)
+                    std::cout << ", budget " << budget;
+                std::cout << ": " << float(updates) / frame_count << " updates/frame, " << frame_ms << " ms/frame" << std::endl;
+            }
+        }
+    }
+}
+
+// The practice models have no morph targets, so this one makes up a facial rig: 64 sparse targets
+// on the first primitive, each moving a random 2% of its vertices
+void benchmark_morph_targets(std::string const & path)
+{
+    auto const model = load_gltf(path);
+    auto const & primitive = model.meshes.front().primitives.front();
+    skinning_source const source(model, primitive);
+
+    std::size_t const target_count = 64;
+    std::default_random_engine rng;
+    std::uniform_real_distribution<float> distribution(-0.01f, 0.01f);
+
+    std::vector<gltf_model::morph_target> targets(target_count);
+    std::vector<glm::vec4> dense_deltas(target_count * source.vertex_count, glm::vec4(0.f));
+    for (std::size_t t = 0; t < target_count; ++t)
+    {
+        for (std::uint32_t v = 0; v < source.vertex_count; ++v)
+        {
+            if (rng() % 50 != 0)
+                continue;
+
+            glm::vec4 const delta(distribution(rng), distribution(rng), distribution(rng), 0.f);
+            targets[t].vertices.push_back(v);
+            targets[t].position_deltas.push_back(delta);
+            targets[t].normal_deltas.push_back(delta);
+            dense_deltas[t * source.vertex_count + v] = delta;
+        }
+    }
+
+    std::vector<float> positions(source.vertex_count * 3);
+    std::vector<float> normals(source.vertex_count * 3);
+
+    std::cout << path << ": " << target_count << " morph targets, " << source.vertex_count << " vertices" << std::endl;
+
+    for (std::size_t active : {4, 16, 64})
+    {
+        std::vector<float> weights(target_count, 0.f);
+        for (std::size_t t = 0; t < active; ++t)
+            weights[t * target_count / active] = 0.5f;
+
+        double const sparse_ms = measure_ms(256, [&]{
+            blend_morph_targets(source, targets, weights.data(), positions.data(), normals.data());
+        });
+
+        // Dense reference: every target visits every vertex, whatever its weight
+        double const dense_ms = measure_ms(16, [&]{
+            for (std::size_t v = 0; v < source.vertex_count * 3; ++v)
+            {
+                positions[v] = source.positions[v];
+                normals[v] = source.normals[v];
+            }
+            for (std::size_t t = 0; t < target_count; ++t)
+            {
+                for (std::size_t v = 0; v < source.vertex_count; ++v)
+                {
+                    auto const & delta = dense_deltas[t * source.vertex_count + v];
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        positions[v * 3 + c] += weights[t] * delta[c];
+                        normals[v * 3 + c] += weights[t] * delta[c];
+                    }
+                }
+            }
+        });
+
+        std::cout << "    " << active << " active: sparse " << sparse_ms << " ms, dense " << dense_ms << " ms" << std::endl;
+    }
+}
+
+// Sorting a frame's worth of draw items: the radix sort against std::sort on the same keys
+void benchmark_render_queue()
+{
+    std::default_random_engine rng;
+    std::uniform_int_distribution<std::uint32_t> texture_distribution(0, 63);
+    std::uniform_real_distribution<float> depth_distribution(0.f, 1.f);
+
+    std::cout << "render queue" << std::endl;
+
+    for (std::size_t count : {1024, 16384, 131072})
+    {
+        std::vector<std::uint64_t> keys(count);
+        for (auto & key : keys)
+        {
+            auto const pass = (rng() % 8 == 0) ? render_queue::transparent : render_queue::opaque;
+            key = render_queue::make_key(pass, rng() % 4, texture_distribution(rng), rng() % 2, depth_distribution(rng));
+        }
+
+        render_queue queue;
+        double const radix_ms = measure_ms(32, [&]{
+            queue.clear();
+            for (std::size_t i = 0; i < count; ++i)
+                queue.push(keys[i], i);
+            queue.sort();
+        });
+
+        std::vector<render_queue::item> items(count);
+        double const std_ms = measure_ms(32, [&]{
+            for (std::size_t i = 0; i < count; ++i)
+                items[i] = {keys[i], std::uint32_t(i)};
+            std::sort(items.begin(), items.end(), [](auto const & a, auto const & b){ return a.key < b.key; });
+        });
+
+        bool const sorted = std::is_sorted(queue.items().begin(), queue.items().end(), [](auto const & a, auto const & b){ return a.key < b.key; });
+        std::cout << "    " << count << " items: radix sort " << radix_ms << " ms, std::sort " << std_ms << " ms" << (sorted ? "" : " (NOT SORTED)") << std::endl;
+    }
+}
+
+int main() try
+{
+    const std::string project_root = PROJECT_ROOT;
+
+    benchmark_model(project_root + "/dancing/dancing.gltf", 256);
+    benchmark_model(project_root + "/wolf/Wolf-Blender-2.82a.gltf", 256);
+    benchmark_animation_lod(project_root + "/dancing/dancing.gltf");
+    benchmark_morph_targets(project_root + "/dancing/dancing.gltf");
+    benchmark_render_queue();
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,70 @@
+#include "bone_buffer.hpp"
+
+#include <stdexcept>
+#include <string>
+
+bone_buffer::bone_buffer(std::size_t capacity, std::size_t frame_count)
+    : slot_capacity(capacity)
+    , frame_count(frame_count)
+    , fences(frame_count, nullptr)
+{
+    GLint max_texels;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+    if (capacity * frame_count * texels_per_matrix > static_cast<std::size_t>(max_texels))
+        throw std::runtime_error("Bone buffer needs more than GL_MAX_TEXTURE_BUFFER_SIZE = " + std::to_string(max_texels) + " texels");
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, capacity * frame_count * floats_per_matrix * sizeof(float), nullptr, GL_STREAM_DRAW);
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+}
+
+bone_buffer::~bone_buffer()
+{
+    for (auto fence : fences)
+        if (fence)
+            glDeleteSync(fence);
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &buffer);
+}
+
+float * bone_buffer::map()
+{
+    slot = (slot + 1) % frame_count;
+
+    if (auto & fence = fences[slot])
+    {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            ;
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+
+    std::size_t const slot_size = slot_capacity * floats_per_matrix * sizeof(float);
+
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    return static_cast<float *>(glMapBufferRange(GL_TEXTURE_BUFFER, slot * slot_size, slot_size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+}
+
+GLint bone_buffer::unmap()
+{
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glUnmapBuffer(GL_TEXTURE_BUFFER);
+    return slot * slot_capacity;
+}
+
+void bone_buffer::fence()
+{
+    fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void bone_buffer::write(float * destination, glm::mat4 const & matrix)
+{
+    for (int row = 0; row < 3; ++row)
+        for (int column = 0; column < 4; ++column)
+            *destination++ = matrix[column][row];
+}
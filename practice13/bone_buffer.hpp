@@ -0,0 +1,50 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+#include <cstddef>
+
+#include <glm/mat4x4.hpp>
+
+// Bone palettes of all instances, stored in a texture buffer as the upper 3x4 part of each matrix,
+// one row per RGBA32F texel. The buffer holds frame_count slots of `capacity` matrices that are
+// written round-robin; fences keep the CPU from overwriting a slot the GPU is still reading,
+// so an upload neither stalls nor needs a synchronizing map.
+class bone_buffer
+{
+public:
+    static constexpr std::size_t texels_per_matrix = 3;
+    static constexpr std::size_t floats_per_matrix = 4 * texels_per_matrix;
+
+    explicit bone_buffer(std::size_t capacity, std::size_t frame_count = 3);
+    ~bone_buffer();
+
+    bone_buffer(bone_buffer const &) = delete;
+    bone_buffer & operator = (bone_buffer const &) = delete;
+
+    std::size_t capacity() const { return slot_capacity; }
+
+    // Waits for the next slot to be released by the GPU and maps it for writing
+    float * map();
+
+    // Unmaps the slot and returns the index of its first matrix, to be added to matrix indices in the shader
+    GLint unmap();
+
+    // Marks the current slot as used by the draw calls issued since unmap()
+    void fence();
+
+    // Bound with gl_state::bind_texture, which tracks the bindings of every texture unit
+    GLuint texture_handle() const { return texture; }
+
+    static void write(float * destination, glm::mat4 const & matrix);
+
+private:
+    std::size_t slot_capacity;
+    std::size_t frame_count;
+    std::size_t slot = 0;
+
+    GLuint buffer;
+    GLuint texture;
+    std::vector<GLsync> fences;
+};
@@ -0,0 +1,122 @@
+#include "cpu_skinning.hpp"
+#include "simd.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+
+namespace
+{
+
+    template <typename Joint>
+    void skin_range(skinning_job const & job, std::size_t begin, std::size_t end)
+    {
+        auto const & source = *job.source;
+        auto const * joints = static_cast<Joint const *>(source.joints);
+        float const * positions = job.positions ? job.positions : source.positions;
+        float const * normals = job.normals ? job.normals : source.normals;
+
+        for (std::size_t v = begin; v < end; ++v)
+        {
+            float const * w = source.weights + 4 * v;
+            Joint const * j = joints + 4 * v;
+
+            // Blend the bone matrices column by column; zero weights cost the same as any other
+            // weight, which keeps the loop free of data-dependent branches
+            float const * m = &job.bone_matrices[j[0]][0][0];
+            auto weight = simd::splat4(w[0]);
+            auto c0 = simd::load4(m + 0) * weight;
+            auto c1 = simd::load4(m + 4) * weight;
+            auto c2 = simd::load4(m + 8) * weight;
+            auto c3 = simd::load4(m + 12) * weight;
+
+            for (int k = 1; k < 4; ++k)
+            {
+                m = &job.bone_matrices[j[k]][0][0];
+                weight = simd::splat4(w[k]);
+                c0 = c0 + simd::load4(m + 0) * weight;
+                c1 = c1 + simd::load4(m + 4) * weight;
+                c2 = c2 + simd::load4(m + 8) * weight;
+                c3 = c3 + simd::load4(m + 12) * weight;
+            }
+
+            float const * p = positions + 3 * v;
+            float const * n = normals + 3 * v;
+
+            // Normals are transformed by the blended matrix itself and left unnormalized, like in vertex-shader skinning
+            auto position = c0 * simd::splat4(p[0]) + c1 * simd::splat4(p[1]) + c2 * simd::splat4(p[2]) + c3;
+            auto normal = c0 * simd::splat4(n[0]) + c1 * simd::splat4(n[1]) + c2 * simd::splat4(n[2]);
+
+            simd::store3(&job.output[v].position.x, position);
+            simd::store3(&job.output[v].normal.x, normal);
+        }
+    }
+
+}
+
+skinning_source::skinning_source(gltf_model const & model, gltf_model::primitive const & primitive)
+{
+    auto data = [&](gltf_model::accessor const & accessor)
+    {
+        return model.buffer.data() + accessor.view.offset;
+    };
+
+    auto floats = [&](gltf_model::accessor const & accessor, std::shared_ptr<std::vector<float> const> & storage) -> float const *
+    {
+        bool const packed = accessor.view.stride == 0 || accessor.view.stride == accessor.size * sizeof(float);
+        if (accessor.type == 0x1406 && packed) // GL_FLOAT
+            return reinterpret_cast<float const *>(data(accessor));
+
+        storage = std::make_shared<std::vector<float> const>(read_floats(model, accessor));
+        return storage->data();
+    };
+
+    vertex_count = primitive.position.count;
+    positions = floats(primitive.position, positions_storage);
+    normals = floats(primitive.normal, normals_storage);
+    weights = floats(primitive.weights, weights_storage);
+    joints = data(primitive.joints);
+
+    if (primitive.joints.view.stride != 0 && primitive.joints.view.stride != 4 * component_size(primitive.joints.type))
+        throw std::runtime_error("Interleaved joints are not supported");
+    joints_type = primitive.joints.type;
+
+    if (joints_type != 0x1401 && joints_type != 0x1403) // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT
+        throw std::runtime_error("Unsupported joints component type: " + std::to_string(joints_type));
+}
+
+void skin_vertices(skinning_job const & job, std::size_t begin, std::size_t end)
+{
+    if (job.source->joints_type == 0x1401) // GL_UNSIGNED_BYTE
+        skin_range<std::uint8_t>(job, begin, end);
+    else
+        skin_range<std::uint16_t>(job, begin, end);
+}
+
+void skinning_batch::clear()
+{
+    jobs.clear();
+    offsets.clear();
+}
+
+void skinning_batch::add(skinning_job const & job)
+{
+    jobs.push_back(job);
+    offsets.push_back(vertex_count() + job.source->vertex_count);
+}
+
+void skinning_batch::run(thread_pool & pool, std::size_t chunk_size) const
+{
+    pool.parallel_for(vertex_count(), chunk_size, [this](std::size_t begin, std::size_t end)
+    {
+        // A chunk may span several jobs
+        std::size_t job = std::upper_bound(offsets.begin(), offsets.end(), begin) - offsets.begin();
+        while (begin < end)
+        {
+            std::size_t const job_begin = offsets[job] - jobs[job].source->vertex_count;
+            std::size_t const job_end = std::min(end, offsets[job]);
+            skin_vertices(jobs[job], begin - job_begin, job_end - job_begin);
+            begin = job_end;
+            ++job;
+        }
+    });
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "gltf_loader.hpp"
+#include "thread_pool.hpp"
+
+#include <memory>
+
+// Output vertex format of CPU skinning, laid out for a streaming vertex buffer
+struct skinned_vertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+};
+
+// Bind-pose vertex data of one primitive, pointing straight into the model buffer
+struct skinning_source
+{
+    std::size_t vertex_count = 0;
+    float const * positions = nullptr;
+    float const * normals = nullptr;
+    float const * weights = nullptr;
+    void const * joints = nullptr;
+    unsigned int joints_type = 0;
+
+    // Float copies of quantized or interleaved attributes; plain float data is used in place
+    std::shared_ptr<std::vector<float> const> positions_storage;
+    std::shared_ptr<std::vector<float> const> normals_storage;
+    std::shared_ptr<std::vector<float> const> weights_storage;
+
+    skinning_source() = default;
+    skinning_source(gltf_model const & model, gltf_model::primitive const & primitive);
+};
+
+// One primitive of one instance: source vertices, the instance's bone palette and where to write the result
+struct skinning_job
+{
+    skinning_source const * source;
+    glm::mat4 const * bone_matrices;
+    skinned_vertex * output;
+
+    // Replace the source positions and normals when set, e.g. with the result of blend_morph_targets
+    float const * positions = nullptr;
+    float const * normals = nullptr;
+};
+
+void skin_vertices(skinning_job const & job, std::size_t begin, std::size_t end);
+
+// All primitives of all instances skinned in a frame, split into fixed-size vertex chunks across a thread pool.
+// Storage is reused between frames, so steady-state use does not allocate
+struct skinning_batch
+{
+    void clear();
+    void add(skinning_job const & job);
+    void run(thread_pool & pool, std::size_t chunk_size = 1024) const;
+
+    std::size_t vertex_count() const { return offsets.empty() ? 0 : offsets.back(); }
+
+private:
+    std::vector<skinning_job> jobs;
+    // offsets[i] is the number of vertices in jobs [0, i]
+    std::vector<std::size_t> offsets;
+};
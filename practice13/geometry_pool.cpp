@@ -0,0 +1,91 @@
+#include "geometry_pool.hpp"
+
+#include <stdexcept>
+#include <string>
+
+geometry_pool::geometry_pool(std::size_t vertex_size, std::vector<attribute> const & attributes, std::size_t vertex_capacity, std::size_t index_capacity)
+    : stride(vertex_size)
+    , vertex_capacity(vertex_capacity)
+    , index_capacity(index_capacity)
+{
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glGenBuffers(1, &vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertex_capacity * vertex_size, nullptr, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_capacity * sizeof(std::uint32_t), nullptr, GL_STATIC_DRAW);
+
+    for (auto const & attribute : attributes)
+    {
+        glEnableVertexAttribArray(attribute.index);
+        if (attribute.integer)
+            glVertexAttribIPointer(attribute.index, attribute.size, attribute.type, vertex_size, reinterpret_cast<void *>(attribute.offset));
+        else
+            glVertexAttribPointer(attribute.index, attribute.size, attribute.type, attribute.normalized ? GL_TRUE : GL_FALSE, vertex_size,
+                reinterpret_cast<void *>(attribute.offset));
+    }
+}
+
+geometry_pool::~geometry_pool()
+{
+    glDeleteBuffers(1, &ebo);
+    glDeleteBuffers(1, &vbo);
+    glDeleteVertexArrays(1, &vao);
+}
+
+geometry_pool::range geometry_pool::add(void const * vertices, std::size_t vertex_count, std::uint32_t const * indices, std::size_t index_count)
+{
+    if (vertices_used + vertex_count > vertex_capacity || indices_used + index_count > index_capacity)
+        throw std::runtime_error("Geometry pool is full: " + std::to_string(vertex_count) + " vertices and " + std::to_string(index_count)
+            + " indices don't fit");
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, vertices_used * stride, vertex_count * stride, vertices);
+
+    // The element buffer binding is VAO state, so the index buffer is uploaded through another target
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, indices_used * sizeof(std::uint32_t), index_count * sizeof(std::uint32_t), indices);
+
+    range result;
+    result.base_vertex = vertices_used;
+    result.index_count = index_count;
+    result.first_index = indices_used;
+
+    vertices_used += vertex_count;
+    indices_used += index_count;
+    return result;
+}
+
+void geometry_pool::bind() const
+{
+    glBindVertexArray(vao);
+}
+
+void geometry_pool::draw(range const & range, GLsizei instance_count) const
+{
+    auto const offset = reinterpret_cast<void *>(range.first_index * sizeof(std::uint32_t));
+    if (instance_count == 1)
+        glDrawElementsBaseVertex(GL_TRIANGLES, range.index_count, GL_UNSIGNED_INT, offset, range.base_vertex);
+    else
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.index_count, GL_UNSIGNED_INT, offset, instance_count, range.base_vertex);
+}
+
+void geometry_pool::draw(range const * ranges, std::size_t count)
+{
+    counts.clear();
+    offsets.clear();
+    base_vertices.clear();
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        counts.push_back(ranges[i].index_count);
+        offsets.push_back(reinterpret_cast<void const *>(ranges[i].first_index * sizeof(std::uint32_t)));
+        base_vertices.push_back(ranges[i].base_vertex);
+    }
+
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT, const_cast<void * const *>(offsets.data()), count, base_vertices.data());
+}
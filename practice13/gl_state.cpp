@@ -0,0 +1,185 @@
+#include "gl_state.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+bool gl_state::count(bool changed)
+{
+    if (changed)
+        ++stats.issued;
+    else
+        ++stats.elided;
+    return changed;
+}
+
+void gl_state::use_program(GLuint program)
+{
+    if (count(this->program != program))
+    {
+        glUseProgram(program);
+        this->program = program;
+    }
+}
+
+void gl_state::bind_vertex_array(GLuint vao)
+{
+    if (count(this->vao != vao))
+    {
+        glBindVertexArray(vao);
+        this->vao = vao;
+    }
+}
+
+void gl_state::bind_framebuffer(GLenum target, GLuint framebuffer)
+{
+    bool const draw = (target != GL_READ_FRAMEBUFFER);
+    bool const read = (target != GL_DRAW_FRAMEBUFFER);
+    if (count((draw && draw_framebuffer != framebuffer) || (read && read_framebuffer != framebuffer)))
+    {
+        glBindFramebuffer(target, framebuffer);
+        if (draw)
+            draw_framebuffer = framebuffer;
+        if (read)
+            read_framebuffer = framebuffer;
+    }
+}
+
+void gl_state::bind_texture(GLuint unit, GLenum target, GLuint texture)
+{
+    auto it = std::find_if(textures.begin(), textures.end(), [&](auto const & binding){ return binding.unit == unit && binding.target == target; });
+    if (!count(it == textures.end() || it->texture != texture))
+        return;
+
+    if (active_unit != unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        active_unit = unit;
+        ++stats.issued;
+    }
+    glBindTexture(target, texture);
+
+    if (it == textures.end())
+        textures.push_back({unit, target, texture});
+    else
+        it->texture = texture;
+}
+
+void gl_state::set_enabled(GLenum capability, bool enabled)
+{
+    auto it = std::find_if(capabilities.begin(), capabilities.end(), [&](auto const & entry){ return entry.first == capability; });
+    if (!count(it == capabilities.end() || it->second != enabled))
+        return;
+
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+
+    if (it == capabilities.end())
+        capabilities.emplace_back(capability, enabled);
+    else
+        it->second = enabled;
+}
+
+void gl_state::depth_mask(bool enabled)
+{
+    if (count(depth_write != std::uint64_t(enabled)))
+    {
+        glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+        depth_write = enabled;
+    }
+}
+
+void gl_state::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    std::array<GLint, 4> const value{x, y, width, height};
+    if (count(current_viewport != value))
+    {
+        glViewport(x, y, width, height);
+        current_viewport = value;
+    }
+}
+
+void gl_state::clear_color(float r, float g, float b, float a)
+{
+    std::array<float, 4> const value{r, g, b, a};
+    if (count(!clear_color_known || current_clear_color != value))
+    {
+        glClearColor(r, g, b, a);
+        current_clear_color = value;
+        clear_color_known = true;
+    }
+}
+
+bool gl_state::uniform_changed(GLint location, void const * data, std::size_t size)
+{
+    // Location -1 is silently ignored by GL, so there's nothing to send
+    if (location < 0 || program == unknown)
+        return count(location >= 0);
+
+    auto & cached = uniforms[(program << 32) | std::uint32_t(location)];
+    if (!count(cached.size() != size || std::memcmp(cached.data(), data, size) != 0))
+        return false;
+
+    cached.assign(static_cast<unsigned char const *>(data), static_cast<unsigned char const *>(data) + size);
+    return true;
+}
+
+void gl_state::uniform(GLint location, int value)
+{
+    if (uniform_changed(location, &value, sizeof(value)))
+        glUniform1i(location, value);
+}
+
+void gl_state::uniform(GLint location, float value)
+{
+    if (uniform_changed(location, &value, sizeof(value)))
+        glUniform1f(location, value);
+}
+
+void gl_state::uniform(GLint location, glm::vec2 const & value)
+{
+    if (uniform_changed(location, &value, sizeof(value)))
+        glUniform2fv(location, 1, &value.x);
+}
+
+void gl_state::uniform(GLint location, glm::vec3 const & value)
+{
+    if (uniform_changed(location, &value, sizeof(value)))
+        glUniform3fv(location, 1, &value.x);
+}
+
+void gl_state::uniform(GLint location, glm::vec4 const & value)
+{
+    if (uniform_changed(location, &value, sizeof(value)))
+        glUniform4fv(location, 1, &value.x);
+}
+
+void gl_state::uniform(GLint location, glm::mat4 const & value)
+{
+    if (uniform_changed(location, &value, sizeof(value)))
+        glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+}
+
+void gl_state::uniform(GLint location, glm::vec4 const * values, std::size_t count)
+{
+    if (uniform_changed(location, values, count * sizeof(*values)))
+        glUniform4fv(location, count, &values->x);
+}
+
+void gl_state::invalidate()
+{
+    program = vao = draw_framebuffer = read_framebuffer = active_unit = depth_write = unknown;
+    current_viewport = {-1, -1, -1, -1};
+    clear_color_known = false;
+    textures.clear();
+    capabilities.clear();
+    uniforms.clear();
+}
+
+gl_state::statistics gl_state::end_frame()
+{
+    auto result = stats;
+    stats = {};
+    return result;
+}
@@ -1,9 +1,15 @@
 #include "gltf_loader.hpp"
+#include "meshopt_decoder.hpp"
 
 #include <rapidjson/document.h>
 #include <rapidjson/istreamwrapper.h>
 
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <limits>
+#include <type_traits>
+#include <unordered_map>
 #include <stdexcept>
 
 static unsigned int attribute_type_to_size(std::string const & type)
@@ -12,6 +18,9 @@ static unsigned int attribute_type_to_size(std::string const & type)
     if (type == "VEC2") return 2;
     if (type == "VEC3") return 3;
     if (type == "VEC4") return 4;
+    if (type == "MAT2") return 4;
+    if (type == "MAT3") return 9;
+    if (type == "MAT4") return 16;
     return 0;
     throw std::runtime_error("Unknown attribute type: " + type);
 }
@@ -28,33 +37,117 @@ gltf_model load_gltf(std::filesystem::path const & path)
 
     gltf_model result;
 
+    // All buffers are concatenated into result.buffer; buffers without a uri are fallbacks
+    // for compressed views (EXT_meshopt_compression) and start out zero-filled
+    std::vector<unsigned int> buffer_offsets;
+    for (auto const & buffer : document["buffers"].GetArray())
     {
-        auto buffers = document["buffers"].GetArray();
-        assert(buffers.Size() == 1);
+        auto const offset = result.buffer.size();
+        buffer_offsets.push_back(offset);
 
-        auto const buffer_uri = buffers[0]["uri"].GetString();
+        if (!buffer.HasMember("uri"))
+        {
+            result.buffer.resize(offset + buffer["byteLength"].GetUint());
+            continue;
+        }
 
-        auto const buffer_path = path.parent_path() / buffer_uri;
+        auto const buffer_path = path.parent_path() / buffer["uri"].GetString();
 
-        result.buffer.resize(std::filesystem::file_size(buffer_path));
-        std::ifstream buffer(buffer_path, std::ios::binary);
-        buffer.read(result.buffer.data(), result.buffer.size());
+        result.buffer.resize(offset + std::filesystem::file_size(buffer_path));
+        std::ifstream input(buffer_path, std::ios::binary);
+        input.read(result.buffer.data() + offset, result.buffer.size() - offset);
     }
 
     auto parse_buffer_view = [&](int index) -> gltf_model::buffer_view
     {
         auto view = document["bufferViews"].GetArray()[index].GetObject();
-        return {view["byteOffset"].GetUint(), view["byteLength"].GetUint()};
+        return {
+            buffer_offsets.at(view["buffer"].GetUint()) + (view.HasMember("byteOffset") ? view["byteOffset"].GetUint() : 0),
+            view["byteLength"].GetUint(),
+            view.HasMember("byteStride") ? view["byteStride"].GetUint() : 0,
+        };
     };
 
+    if (document.HasMember("bufferViews"))
+    {
+        auto views = document["bufferViews"].GetArray();
+        for (rapidjson::SizeType i = 0; i < views.Size(); ++i)
+        {
+            if (!views[i].HasMember("extensions"))
+                continue;
+
+            auto const & extensions = views[i]["extensions"];
+            // KHR_meshopt_compression adds version 1 of the vertex codec and the COLOR filter, which the decoder doesn't support
+            if (extensions.HasMember("KHR_meshopt_compression"))
+                throw std::runtime_error("Buffer view " + std::to_string(i) + " uses unsupported KHR_meshopt_compression");
+            if (!extensions.HasMember("EXT_meshopt_compression"))
+                continue;
+
+            auto const & info = extensions["EXT_meshopt_compression"];
+            auto const view = parse_buffer_view(i);
+
+            auto const source_offset = buffer_offsets.at(info["buffer"].GetUint()) + (info.HasMember("byteOffset") ? info["byteOffset"].GetUint() : 0);
+            auto const source_size = info["byteLength"].GetUint();
+            auto const stride = info["byteStride"].GetUint();
+            auto const count = info["count"].GetUint();
+            std::string const mode = info["mode"].GetString();
+
+            if (std::size_t(stride) * count > view.size || source_offset + source_size > result.buffer.size())
+                throw std::runtime_error("Compressed buffer view " + std::to_string(i) + " is out of bounds");
+
+            auto const source = reinterpret_cast<unsigned char const *>(result.buffer.data() + source_offset);
+            auto const destination = result.buffer.data() + view.offset;
+
+            if (mode == "ATTRIBUTES")
+            {
+                decode_meshopt_attributes(destination, count, stride, source, source_size);
+                if (info.HasMember("filter"))
+                    apply_meshopt_filter(info["filter"].GetString(), destination, count, stride);
+            }
+            else if (mode == "TRIANGLES")
+                decode_meshopt_triangles(destination, count, stride, source, source_size);
+            else if (mode == "INDICES")
+                decode_meshopt_indices(destination, count, stride, source, source_size);
+            else
+                throw std::runtime_error("Unknown meshopt compression mode: " + mode);
+        }
+    }
+
+    // Accessors without a buffer view are zero-filled (sparse ones list their non-zero elements separately),
+    // so each of them gets a zeroed range appended to the buffer the first time it's parsed
+    std::unordered_map<int, gltf_model::buffer_view> zero_views;
+
     auto parse_accessor = [&](int index) -> gltf_model::accessor
     {
         auto accessor = document["accessors"].GetArray()[index].GetObject();
+        auto const type = accessor["componentType"].GetUint();
+        auto const size = attribute_type_to_size(accessor["type"].GetString());
+        auto const count = accessor["count"].GetUint();
+
+        gltf_model::buffer_view view;
+        if (accessor.HasMember("bufferView"))
+        {
+            view = parse_buffer_view(accessor["bufferView"].GetInt());
+            if (accessor.HasMember("byteOffset"))
+                view.offset += accessor["byteOffset"].GetUint();
+        }
+        else if (auto it = zero_views.find(index); it != zero_views.end())
+            view = it->second;
+        else
+        {
+            // Aligned for any component type
+            auto const offset = (result.buffer.size() + 3) / 4 * 4;
+            view = {static_cast<unsigned int>(offset), count * size * component_size(type)};
+            result.buffer.resize(offset + view.size);
+            zero_views[index] = view;
+        }
+
         return {
-            parse_buffer_view(accessor["bufferView"].GetInt()),
-            accessor["componentType"].GetUint(),
-            attribute_type_to_size(accessor["type"].GetString()),
-            accessor["count"].GetUint(),
+            view,
+            type,
+            size,
+            count,
+            accessor.HasMember("normalized") && accessor["normalized"].GetBool(),
         };
     };
 
@@ -74,11 +167,56 @@ gltf_model load_gltf(std::filesystem::path const & path)
         };
     };
 
+    // Dense deltas of one morph target attribute, resolving sparse accessors (which may omit the buffer view)
+    auto read_deltas = [&](auto const & target, char const * attribute, unsigned int vertex_count)
+    {
+        std::vector<glm::vec3> deltas(vertex_count, glm::vec3(0.f));
+        if (!target.HasMember(attribute))
+            return deltas;
+
+        auto const & accessor = document["accessors"].GetArray()[target[attribute].GetInt()];
+        auto const type = accessor["componentType"].GetUint();
+        bool const normalized = accessor.HasMember("normalized") && accessor["normalized"].GetBool();
+
+        auto store = [&](std::vector<float> const & values, auto index)
+        {
+            for (std::size_t i = 0; i * 3 < values.size(); ++i)
+                deltas.at(index(i)) = {values[i * 3], values[i * 3 + 1], values[i * 3 + 2]};
+        };
+
+        if (accessor.HasMember("bufferView"))
+            store(read_floats(result, parse_accessor(target[attribute].GetInt())), [](std::size_t i){ return i; });
+
+        if (accessor.HasMember("sparse"))
+        {
+            auto const & sparse = accessor["sparse"];
+            auto const count = sparse["count"].GetUint();
+
+            auto sparse_accessor = [&](auto const & info, unsigned int component_type, unsigned int size, bool normalized)
+            {
+                auto view = parse_buffer_view(info["bufferView"].GetInt());
+                if (info.HasMember("byteOffset"))
+                    view.offset += info["byteOffset"].GetUint();
+                return gltf_model::accessor{view, component_type, size, count, normalized};
+            };
+
+            auto const indices = read_floats(result, sparse_accessor(sparse["indices"], sparse["indices"]["componentType"].GetUint(), 1, false));
+            auto const values = read_floats(result, sparse_accessor(sparse["values"], type, 3, normalized));
+            store(values, [&](std::size_t i){ return std::size_t(indices[i]); });
+        }
+
+        return deltas;
+    };
+
     for (auto const & mesh : document["meshes"].GetArray())
     {
         auto & result_mesh = result.meshes.emplace_back();
         result_mesh.name = mesh["name"].GetString();
 
+        if (mesh.HasMember("weights"))
+            for (auto const & weight : mesh["weights"].GetArray())
+                result_mesh.weights.push_back(weight.GetFloat());
+
         for (auto const & primitive : mesh["primitives"].GetArray())
         {
             auto & result_primitive = result_mesh.primitives.emplace_back();
@@ -92,6 +230,27 @@ gltf_model load_gltf(std::filesystem::path const & path)
             result_primitive.joints = parse_accessor(attributes["JOINTS_0"].GetInt());
             result_primitive.weights = parse_accessor(attributes["WEIGHTS_0"].GetInt());
 
+            if (primitive.HasMember("targets"))
+            {
+                auto const vertex_count = result_primitive.position.count;
+                for (auto const & target : primitive["targets"].GetArray())
+                {
+                    auto const positions = read_deltas(target, "POSITION", vertex_count);
+                    auto const normals = read_deltas(target, "NORMAL", vertex_count);
+
+                    auto & result_target = result_primitive.targets.emplace_back();
+                    for (std::uint32_t v = 0; v < vertex_count; ++v)
+                    {
+                        if (positions[v] == glm::vec3(0.f) && normals[v] == glm::vec3(0.f))
+                            continue;
+
+                        result_target.vertices.push_back(v);
+                        result_target.position_deltas.emplace_back(positions[v], 0.f);
+                        result_target.normal_deltas.emplace_back(normals[v], 0.f);
+                    }
+                }
+            }
+
             auto const & material = document["materials"].GetArray()[primitive["material"].GetInt()];
 
             result_primitive.material.two_sided = material.HasMember("doubleSided") && material["doubleSided"].GetBool();
@@ -109,12 +268,13 @@ gltf_model load_gltf(std::filesystem::path const & path)
     assert(skins.Size() == 1);
 
     {
+        // Animation data may be quantized too, so everything goes through read_floats
         auto fill_buffer = [&](auto & vector, gltf_model::accessor const & accessor)
         {
-            assert(accessor.type == 0x1406); // GL_FLOAT
-            using value_type = std::decay_t<decltype(vector[0])>;
-            auto begin = reinterpret_cast<value_type const *>(result.buffer.data() + accessor.view.offset);
-            vector.assign(begin, begin + accessor.count);
+            auto const values = read_floats(result, accessor);
+            assert(values.size() * sizeof(float) == accessor.count * sizeof(vector[0]));
+            vector.resize(accessor.count);
+            std::memcpy(static_cast<void *>(vector.data()), values.data(), values.size() * sizeof(float));
         };
 
         auto fix_rotations = [](std::vector<glm::quat> & rotations)
@@ -169,9 +329,31 @@ gltf_model load_gltf(std::filesystem::path const & path)
             gltf_model::animation result_animation;
             result_animation.bones.resize(result.bones.size());
 
+            auto update_max_time = [&](std::vector<float> const & timestamps)
+            {
+                for (float t : timestamps)
+                    result_animation.max_time = std::max(result_animation.max_time, t);
+            };
+
             for (auto const & channel : animation["channels"].GetArray())
             {
                 int node_id = channel["target"]["node"].GetInt();
+
+                if (channel["target"]["path"].GetString() == std::string("weights"))
+                {
+                    auto const & node = document["nodes"].GetArray()[node_id];
+                    if (!node.HasMember("mesh")) continue;
+
+                    auto const & sampler = samplers[channel["sampler"].GetInt()];
+
+                    auto & weights = result_animation.morph_weights.emplace_back();
+                    weights.mesh = node["mesh"].GetUint();
+                    weights.timestamps = read_floats(result, parse_accessor(sampler["input"].GetInt()));
+                    weights.values = read_floats(result, parse_accessor(sampler["output"].GetInt()));
+                    update_max_time(weights.timestamps);
+                    continue;
+                }
+
                 if (!bone_node_to_index.contains(node_id)) continue;
 
                 auto & bone = result_animation.bones[bone_node_to_index.at(node_id)];
@@ -201,12 +383,6 @@ gltf_model load_gltf(std::filesystem::path const & path)
                 }
             }
 
-            auto update_max_time = [&](std::vector<float> const & timestamps)
-            {
-                for (float t : timestamps)
-                    result_animation.max_time = std::max(result_animation.max_time, t);
-            };
-
             for (auto const & bone : result_animation.bones)
             {
                 update_max_time(bone.translation.timestamps);
@@ -220,3 +396,97 @@ gltf_model load_gltf(std::filesystem::path const & path)
 
     return result;
 }
+
+unsigned int component_size(unsigned int type)
+{
+    switch (type)
+    {
+    case 0x1400: // GL_BYTE
+    case 0x1401: // GL_UNSIGNED_BYTE
+        return 1;
+    case 0x1402: // GL_SHORT
+    case 0x1403: // GL_UNSIGNED_SHORT
+        return 2;
+    case 0x1405: // GL_UNSIGNED_INT
+    case 0x1406: // GL_FLOAT
+        return 4;
+    }
+    throw std::runtime_error("Unknown component type: " + std::to_string(type));
+}
+
+namespace
+{
+
+    template <typename T>
+    float read_component(char const * data, bool normalized)
+    {
+        T value;
+        std::memcpy(&value, data, sizeof(value));
+        if constexpr (std::is_integral_v<T>)
+        {
+            // glTF normalization: signed values map -max and -max-1 both to -1
+            if (normalized)
+                return std::max(float(value) / float(std::numeric_limits<T>::max()), -1.f);
+        }
+        return float(value);
+    }
+
+}
+
+std::vector<float> read_floats(gltf_model const & model, gltf_model::accessor const & accessor)
+{
+    auto const size = component_size(accessor.type);
+    auto const stride = accessor.view.stride ? accessor.view.stride : size * accessor.size;
+
+    if (accessor.count == 0)
+        return {};
+
+    if (accessor.view.offset + std::size_t(stride) * (accessor.count - 1) + size * accessor.size > model.buffer.size())
+        throw std::runtime_error("Accessor is out of buffer bounds");
+
+    std::vector<float> result(accessor.count * accessor.size);
+    char const * data = model.buffer.data() + accessor.view.offset;
+
+    for (unsigned int i = 0; i < accessor.count; ++i, data += stride)
+    {
+        for (unsigned int c = 0; c < accessor.size; ++c)
+        {
+            char const * component = data + c * size;
+            float & value = result[i * accessor.size + c];
+            switch (accessor.type)
+            {
+            case 0x1400: value = read_component<std::int8_t>(component, accessor.normalized); break;
+            case 0x1401: value = read_component<std::uint8_t>(component, accessor.normalized); break;
+            case 0x1402: value = read_component<std::int16_t>(component, accessor.normalized); break;
+            case 0x1403: value = read_component<std::uint16_t>(component, accessor.normalized); break;
+            case 0x1405: value = read_component<std::uint32_t>(component, accessor.normalized); break;
+            case 0x1406: value = read_component<float>(component, false); break;
+            }
+        }
+    }
+
+    return result;
+}
+
+std::vector<std::uint32_t> read_indices(gltf_model const & model, gltf_model::accessor const & accessor)
+{
+    auto const size = component_size(accessor.type);
+    if (accessor.view.offset + std::size_t(size) * accessor.count > model.buffer.size())
+        throw std::runtime_error("Accessor is out of buffer bounds");
+
+    std::vector<std::uint32_t> result(accessor.count);
+    char const * data = model.buffer.data() + accessor.view.offset;
+
+    for (unsigned int i = 0; i < accessor.count; ++i, data += size)
+    {
+        switch (accessor.type)
+        {
+        case 0x1401: result[i] = *reinterpret_cast<std::uint8_t const *>(data); break;
+        case 0x1403: { std::uint16_t index; std::memcpy(&index, data, sizeof(index)); result[i] = index; break; }
+        case 0x1405: std::memcpy(&result[i], data, sizeof(result[i])); break;
+        default: throw std::runtime_error("Unsupported index type: " + std::to_string(accessor.type));
+        }
+    }
+
+    return result;
+}
@@ -6,6 +6,7 @@
 #include <optional>
 #include <unordered_map>
 #include <algorithm>
+#include <cstdint>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -20,14 +21,19 @@ struct gltf_model
     {
         unsigned int offset;
         unsigned int size;
+        // Distance between elements in bytes, 0 if they are tightly packed
+        unsigned int stride = 0;
     };
 
     struct accessor
     {
+        // For accessors, the view offset already includes the accessor's own byte offset
         buffer_view view;
         unsigned int type;
         unsigned int size;
         unsigned int count;
+        // Integer components map to [0, 1] or [-1, 1] (KHR_mesh_quantization)
+        bool normalized = false;
     };
 
     struct material
@@ -61,12 +67,32 @@ struct gltf_model
         spline<glm::vec3> scale;
     };
 
+    // Morph target weights of one mesh; values holds one weight per target for each timestamp
+    struct morph_weights_animation
+    {
+        unsigned int mesh;
+        std::vector<float> timestamps;
+        std::vector<float> values;
+
+        void operator()(float time, float * weights, std::size_t target_count) const;
+    };
+
     struct animation
     {
         std::vector<bone_animation> bones;
+        std::vector<morph_weights_animation> morph_weights;
         float max_time = 0.f;
     };
 
+    // Only the vertices that a target moves, in increasing order; deltas are padded to four floats
+    // so that each one loads as a single SIMD vector
+    struct morph_target
+    {
+        std::vector<std::uint32_t> vertices;
+        std::vector<glm::vec4> position_deltas;
+        std::vector<glm::vec4> normal_deltas;
+    };
+
     struct primitive
     {
         struct material material;
@@ -78,6 +104,8 @@ struct gltf_model
         accessor texcoord;
         accessor joints;
         accessor weights;
+
+        std::vector<morph_target> targets;
     };
 
     struct mesh
@@ -85,6 +113,9 @@ struct gltf_model
         std::string name;
 
         std::vector<primitive> primitives;
+
+        // Default morph target weights, shared by all primitives of the mesh
+        std::vector<float> weights;
     };
 
     std::vector<char> buffer;
@@ -93,8 +124,19 @@ struct gltf_model
     std::unordered_map<std::string, animation> animations;
 };
 
+// Buffer views compressed with EXT_meshopt_compression are decoded while loading, so that
+// `buffer` always holds plain vertex and index data
 gltf_model load_gltf(std::filesystem::path const & path);
 
+// Size of one component of the given GL type in bytes
+unsigned int component_size(unsigned int type);
+
+// Reads the components of an accessor as floats, converting integer types (normalized or not) and honoring the view stride
+std::vector<float> read_floats(gltf_model const & model, gltf_model::accessor const & accessor);
+
+// Reads an index accessor of any index type as 32-bit indices
+std::vector<std::uint32_t> read_indices(gltf_model const & model, gltf_model::accessor const & accessor);
+
 template <>
 inline glm::vec3 gltf_model::spline<glm::vec3>::operator()(float time) const
 {
@@ -102,7 +144,7 @@ inline glm::vec3 gltf_model::spline<glm::vec3>::operator()(float time) const
 
     auto it = std::lower_bound(timestamps.begin(), timestamps.end(), time);
     if (it == timestamps.begin())
-        return values.back();
+        return values.front();
     if (it == timestamps.end())
         return values.back();
 
@@ -119,7 +161,7 @@ inline glm::quat gltf_model::spline<glm::quat>::operator()(float time) const
 
     auto it = std::lower_bound(timestamps.begin(), timestamps.end(), time);
     if (it == timestamps.begin())
-        return values.back();
+        return values.front();
     if (it == timestamps.end())
         return values.back();
 
@@ -128,3 +170,22 @@ inline glm::quat gltf_model::spline<glm::quat>::operator()(float time) const
     float t = (time - timestamps[i - 1]) / (timestamps[i] - timestamps[i - 1]);
     return glm::slerp(values[i - 1], values[i], t);
 }
+
+inline void gltf_model::morph_weights_animation::operator()(float time, float * weights, std::size_t target_count) const
+{
+    assert(!timestamps.empty() && values.size() == timestamps.size() * target_count);
+
+    auto it = std::lower_bound(timestamps.begin(), timestamps.end(), time);
+    if (it == timestamps.begin() || it == timestamps.end())
+    {
+        auto const * key = values.data() + (it == timestamps.begin() ? 0 : values.size() - target_count);
+        std::copy(key, key + target_count, weights);
+        return;
+    }
+
+    int i = it - timestamps.begin();
+
+    float t = (time - timestamps[i - 1]) / (timestamps[i] - timestamps[i - 1]);
+    for (std::size_t k = 0; k < target_count; ++k)
+        weights[k] = glm::lerp(values[(i - 1) * target_count + k], values[i * target_count + k], t);
+}
@@ -15,7 +15,10 @@
 #include <vector>
 #include <random>
 #include <map>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <array>
 
 #define GLM_FORCE_SWIZZLE
 #define GLM_ENABLE_EXPERIMENTAL
@@ -28,6 +31,19 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "gltf_loader.hpp"
+#include "animation_compression.hpp"
+#include "skeleton.hpp"
+#include "cpu_skinning.hpp"
+#include "morph_targets.hpp"
+#include "thread_pool.hpp"
+#include "bone_buffer.hpp"
+#include "animation_atlas.hpp"
+#include "animation_texture.hpp"
+#include "animation_blend.hpp"
+#include "animation_lod.hpp"
+#include "geometry_pool.hpp"
+#include "render_queue.hpp"
+#include "gl_state.hpp"
 #include "stb_image.h"
 
 std::string to_string(std::string_view str)
@@ -68,6 +84,118 @@ void main()
 }
 )";
 
+// Skins instance gl_InstanceID with its palette from the bone buffer: matrix 0 of every palette is the
+// instance model matrix, followed by the bone matrices; each is stored as three rows of its 3x4 part
+const char skinning_vertex_shader_source[] =
+R"(#version 330 core
+
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform samplerBuffer bones;
+uniform int bone_count;
+uniform int palette_offset;
+
+layout (location = 0) in vec3 in_position;
+layout (location = 1) in vec3 in_normal;
+layout (location = 2) in vec2 in_texcoord;
+layout (location = 3) in uvec4 in_joints;
+layout (location = 4) in vec4 in_weights;
+
+out vec3 normal;
+out vec2 texcoord;
+
+mat4 palette_matrix(int index)
+{
+    int texel = 3 * (palette_offset + gl_InstanceID * (bone_count + 1) + index);
+    return transpose(mat4(
+        texelFetch(bones, texel),
+        texelFetch(bones, texel + 1),
+        texelFetch(bones, texel + 2),
+        vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+void main()
+{
+    mat4 model = palette_matrix(0);
+    mat4 skin = in_weights.x * palette_matrix(1 + int(in_joints.x))
+        + in_weights.y * palette_matrix(1 + int(in_joints.y))
+        + in_weights.z * palette_matrix(1 + int(in_joints.z))
+        + in_weights.w * palette_matrix(1 + int(in_joints.w));
+
+    gl_Position = projection * view * model * skin * vec4(in_position, 1.0);
+    normal = mat3(model) * mat3(skin) * in_normal;
+    texcoord = in_texcoord;
+}
+)";
+
+// Skins crowd instances straight from the animation texture: every instance plays clip in_clip with
+// its own time offset, interpolating between the two closest baked frames
+const char crowd_vertex_shader_source[] =
+R"(#version 330 core
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+uniform sampler2D animations;
+uniform vec4 clips[8]; // first frame, frame count, frame rate, duration
+uniform float time;
+
+layout (location = 0) in vec3 in_position;
+layout (location = 1) in vec3 in_normal;
+layout (location = 2) in vec2 in_texcoord;
+layout (location = 3) in uvec4 in_joints;
+layout (location = 4) in vec4 in_weights;
+layout (location = 5) in vec4 in_placement; // x, z, rotation around y, time offset
+layout (location = 6) in int in_clip;
+
+out vec3 normal;
+out vec2 texcoord;
+
+mat4 bone_matrix(int frame, uint bone)
+{
+    int x = 3 * int(bone);
+    return transpose(mat4(
+        texelFetch(animations, ivec2(x, frame), 0),
+        texelFetch(animations, ivec2(x + 1, frame), 0),
+        texelFetch(animations, ivec2(x + 2, frame), 0),
+        vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+mat4 skin_matrix(int frame)
+{
+    return in_weights.x * bone_matrix(frame, in_joints.x)
+        + in_weights.y * bone_matrix(frame, in_joints.y)
+        + in_weights.z * bone_matrix(frame, in_joints.z)
+        + in_weights.w * bone_matrix(frame, in_joints.w);
+}
+
+void main()
+{
+    vec4 clip = clips[in_clip];
+    float position = mod(time + in_placement.w, clip.w) * clip.z;
+    int frame = min(int(position), int(clip.y) - 2);
+    float t = position - float(frame);
+    frame += int(clip.x);
+
+    mat4 skin = (1.0 - t) * skin_matrix(frame) + t * skin_matrix(frame + 1);
+
+    float c = cos(in_placement.z);
+    float s = sin(in_placement.z);
+    mat4 placement = mat4(
+        c, 0.0, -s, 0.0,
+        0.0, 1.0, 0.0, 0.0,
+        s, 0.0, c, 0.0,
+        in_placement.x, 0.0, in_placement.y, 1.0);
+    mat4 instance_model = placement * model;
+
+    gl_Position = projection * view * instance_model * skin * vec4(in_position, 1.0);
+    normal = mat3(instance_model) * mat3(skin) * in_normal;
+    texcoord = in_texcoord;
+}
+)";
+
 const char fragment_shader_source[] =
 R"(#version 330 core
 
@@ -187,77 +315,362 @@ int main() try
     GLuint use_texture_location = glGetUniformLocation(program, "use_texture");
     GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
 
+    auto skinning_vertex_shader = create_shader(GL_VERTEX_SHADER, skinning_vertex_shader_source);
+    auto skinning_program = create_program(skinning_vertex_shader, fragment_shader);
+
+    GLuint skinning_view_location = glGetUniformLocation(skinning_program, "view");
+    GLuint skinning_projection_location = glGetUniformLocation(skinning_program, "projection");
+    GLuint skinning_bones_location = glGetUniformLocation(skinning_program, "bones");
+    GLuint skinning_bone_count_location = glGetUniformLocation(skinning_program, "bone_count");
+    GLuint skinning_palette_offset_location = glGetUniformLocation(skinning_program, "palette_offset");
+    GLuint skinning_color_location = glGetUniformLocation(skinning_program, "color");
+    GLuint skinning_use_texture_location = glGetUniformLocation(skinning_program, "use_texture");
+    GLuint skinning_light_direction_location = glGetUniformLocation(skinning_program, "light_direction");
+
+    auto crowd_vertex_shader = create_shader(GL_VERTEX_SHADER, crowd_vertex_shader_source);
+    auto crowd_program = create_program(crowd_vertex_shader, fragment_shader);
+
+    GLuint crowd_model_location = glGetUniformLocation(crowd_program, "model");
+    GLuint crowd_view_location = glGetUniformLocation(crowd_program, "view");
+    GLuint crowd_projection_location = glGetUniformLocation(crowd_program, "projection");
+    GLuint crowd_animations_location = glGetUniformLocation(crowd_program, "animations");
+    GLuint crowd_clips_location = glGetUniformLocation(crowd_program, "clips");
+    GLuint crowd_time_location = glGetUniformLocation(crowd_program, "time");
+    GLuint crowd_color_location = glGetUniformLocation(crowd_program, "color");
+    GLuint crowd_use_texture_location = glGetUniformLocation(crowd_program, "use_texture");
+    GLuint crowd_light_direction_location = glGetUniformLocation(crowd_program, "light_direction");
+
     const std::string project_root = PROJECT_ROOT;
     const std::string model_path = project_root + "/dancing/dancing.gltf";
 
     auto const input_model = load_gltf(model_path);
-    GLuint vbo;
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, input_model.buffer.size(), input_model.buffer.data(), GL_STATIC_DRAW);
+
+    // Every character is animated separately; instance i stands at instance_offset * i
+    const int instance_count = 5;
+    const glm::vec3 instance_offset{1.5f, 0.f, 0.f};
 
     struct mesh
     {
-        GLuint vao;
-        gltf_model::accessor indices;
+        geometry_pool::range range;
         gltf_model::material material;
-    };
+        std::uint32_t texture_slot = 0;
 
-    auto setup_attribute = [](int index, gltf_model::accessor const & accessor, bool integer = false)
-    {
-        glEnableVertexAttribArray(index);
-        if (integer)
-            glVertexAttribIPointer(index, accessor.size, accessor.type, 0, reinterpret_cast<void *>(accessor.view.offset));
-        else
-            glVertexAttribPointer(index, accessor.size, accessor.type, GL_FALSE, 0, reinterpret_cast<void *>(accessor.view.offset));
+        skinning_source skinning;
+
+        // Primitives with morph targets are blended into morphed_positions/normals starting at vertex morphed_base
+        // before CPU skinning; the GPU paths draw them without morphs
+        std::size_t model_mesh;
+        std::vector<gltf_model::morph_target> const * targets = nullptr;
+        std::size_t morphed_base = 0;
     };
 
-    std::vector<mesh> meshes;
+    // All primitives share one geometry pool, interleaved in the attribute types of the first
+    // primitive, so that quantized attributes stay quantized on the GPU
+    std::array<std::pair<gltf_model::accessor gltf_model::primitive::*, bool>, 5> const pooled_attributes{{
+        {&gltf_model::primitive::position, false},
+        {&gltf_model::primitive::normal, false},
+        {&gltf_model::primitive::texcoord, false},
+        {&gltf_model::primitive::joints, true},
+        {&gltf_model::primitive::weights, false},
+    }};
+
+    std::vector<geometry_pool::attribute> pool_layout;
+    std::size_t pool_vertex_size = 0;
+    std::size_t pool_vertex_count = 0;
+    std::size_t pool_index_count = 0;
     for (auto const & mesh : input_model.meshes)
     {
         for (auto const & primitive : mesh.primitives)
+        {
+            for (GLuint a = 0; a < pooled_attributes.size(); ++a)
+            {
+                auto const & accessor = primitive.*pooled_attributes[a].first;
+                if (pool_layout.size() == a)
+                {
+                    pool_layout.push_back({a, GLint(accessor.size), accessor.type, accessor.normalized, pooled_attributes[a].second, pool_vertex_size});
+                    pool_vertex_size += (component_size(accessor.type) * accessor.size + 3) & ~3u;
+                }
+                else if (pool_layout[a].type != accessor.type || pool_layout[a].size != GLint(accessor.size) || pool_layout[a].normalized != accessor.normalized)
+                    throw std::runtime_error("All primitives of " + model_path + " must share one vertex format");
+            }
+            pool_vertex_count += primitive.position.count;
+            pool_index_count += primitive.indices.count;
+        }
+    }
+
+    geometry_pool geometry(pool_vertex_size, pool_layout, pool_vertex_count, pool_index_count);
+
+    std::size_t morphed_vertex_count = 0;
+
+    std::vector<mesh> meshes;
+    std::vector<char> pooled_vertices;
+    for (std::size_t mesh_index = 0; mesh_index < input_model.meshes.size(); ++mesh_index)
+    {
+        for (auto const & primitive : input_model.meshes[mesh_index].primitives)
         {
             auto & result = meshes.emplace_back();
-            glGenVertexArrays(1, &result.vao);
-            glBindVertexArray(result.vao);
+            result.model_mesh = mesh_index;
 
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo);
-            result.indices = primitive.indices;
+            std::size_t const vertex_count = primitive.position.count;
+            pooled_vertices.assign(vertex_count * pool_vertex_size, 0);
+            for (std::size_t a = 0; a < pooled_attributes.size(); ++a)
+            {
+                auto const & accessor = primitive.*pooled_attributes[a].first;
+                std::size_t const element_size = component_size(accessor.type) * accessor.size;
+                std::size_t const stride = accessor.view.stride ? accessor.view.stride : element_size;
+                for (std::size_t v = 0; v < vertex_count; ++v)
+                    std::memcpy(pooled_vertices.data() + v * pool_vertex_size + pool_layout[a].offset,
+                        input_model.buffer.data() + accessor.view.offset + v * stride, element_size);
+            }
 
-            setup_attribute(0, primitive.position);
-            setup_attribute(1, primitive.normal);
-            setup_attribute(2, primitive.texcoord);
-            setup_attribute(3, primitive.joints, true);
-            setup_attribute(4, primitive.weights);
+            auto const indices = read_indices(input_model, primitive.indices);
+            result.range = geometry.add(pooled_vertices.data(), vertex_count, indices.data(), indices.size());
 
             result.material = primitive.material;
+
+            result.skinning = skinning_source(input_model, primitive);
+
+            if (!primitive.targets.empty())
+            {
+                result.targets = &primitive.targets;
+                result.morphed_base = morphed_vertex_count;
+                morphed_vertex_count += result.skinning.vertex_count * instance_count;
+            }
         }
     }
 
-    std::map<std::string, GLuint> textures;
-    for (auto const & mesh : meshes)
+    // CPU skinning writes instance i of pool vertex v to skinned_vbo at i * geometry.vertex_count() + v. Each instance
+    // has its own VAO whose positions and normals start at its part of skinned_vbo, and whose texture
+    // coordinates come straight from the pool, so the pool's base vertices apply to both
+    GLuint skinned_vbo;
+    glGenBuffers(1, &skinned_vbo);
+
+    std::size_t const skinned_vertex_count = geometry.vertex_count() * instance_count;
+
+    std::vector<GLuint> skinned_vaos(instance_count);
+    glGenVertexArrays(instance_count, skinned_vaos.data());
+    for (int i = 0; i < instance_count; ++i)
+    {
+        glBindVertexArray(skinned_vaos[i]);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.index_buffer());
+
+        glBindBuffer(GL_ARRAY_BUFFER, geometry.vertex_buffer());
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, pool_layout[2].size, pool_layout[2].type, pool_layout[2].normalized ? GL_TRUE : GL_FALSE, pool_vertex_size,
+            reinterpret_cast<void *>(pool_layout[2].offset));
+
+        auto const skinned_offset = i * geometry.vertex_count() * sizeof(skinned_vertex);
+        glBindBuffer(GL_ARRAY_BUFFER, skinned_vbo);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(skinned_vertex), reinterpret_cast<void *>(skinned_offset + offsetof(skinned_vertex, position)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(skinned_vertex), reinterpret_cast<void *>(skinned_offset + offsetof(skinned_vertex, normal)));
+    }
+
+    // Textures are resolved to slots of texture_handles at load time; slot 0 means "no texture"
+    std::vector<GLuint> texture_handles{0};
+    {
+        std::map<std::string, std::uint32_t> texture_slots;
+        for (auto & mesh : meshes)
+        {
+            if (!mesh.material.texture_path) continue;
+            if (auto it = texture_slots.find(*mesh.material.texture_path); it != texture_slots.end())
+            {
+                mesh.texture_slot = it->second;
+                continue;
+            }
+
+            auto path = std::filesystem::path(model_path).parent_path() / *mesh.material.texture_path;
+
+            int width, height, channels;
+            auto data = stbi_load(path.c_str(), &width, &height, &channels, 4);
+            assert(data);
+
+            GLuint texture;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+            glGenerateMipmap(GL_TEXTURE_2D);
+
+            stbi_image_free(data);
+
+            mesh.texture_slot = texture_slots[*mesh.material.texture_path] = texture_handles.size();
+            texture_handles.push_back(texture);
+        }
+    }
+
+    // Characters play compressed clips, which take several times less memory than baked frames
+    std::unordered_map<std::string, compressed_animation> animations;
+    for (auto const & [name, animation] : input_model.animations)
+        animations[name] = compress_animation(animation, input_model.bones);
+
+    std::vector<std::string> clip_names;
+    for (auto const & [name, animation] : animations)
+        clip_names.push_back(name);
+    std::sort(clip_names.begin(), clip_names.end());
+
+    skeleton const rig(input_model.bones);
+
+    // N crossfades every character to the next clip, M toggles an upper body layer playing a different clip
+    std::size_t current_clip = std::find(clip_names.begin(), clip_names.end(), "hip-hop") - clip_names.begin();
+    float const crossfade_duration = 0.5f;
+
+    std::uint32_t upper_body_root = 0;
+    while (upper_body_root < input_model.bones.size() && input_model.bones[upper_body_root].name != "mixamorig:Spine1")
+        ++upper_body_root;
+    bone_mask const upper_body = make_bone_mask(rig, upper_body_root);
+
+    std::vector<animation_blender> blenders(instance_count);
+    for (int i = 0; i < instance_count; ++i)
+    {
+        auto const & clip = animations.at(clip_names[current_clip]);
+        blenders[i].play(clip, 0.f, std::fmod(0.5f * i, clip.duration));
+
+        animation_layer layer;
+        layer.clip = animations.at(clip_names[(current_clip + 1) % clip_names.size()]);
+        layer.mask = &upper_body;
+        layer.time = std::fmod(0.5f * i, layer.clip.duration());
+        layer.weight = layer.target_weight = 0.f;
+        layer.fade_speed = 1.f / crossfade_duration;
+        blenders[i].add_layer(layer);
+    }
+
+    // Characters are updated less often as they get smaller on screen (L toggles this); sizes are
+    // measured while drawing and used by the next frame
+    animation_scheduler scheduler(rig.bone_count(), instance_count);
+    std::vector<float> instance_sizes(instance_count, 1.f);
+    std::vector<float> const full_sizes(instance_count, 1.f);
+    bool animation_lod = true;
+    std::vector<glm::mat4> bone_matrices(instance_count * rig.bone_count());
+
+    thread_pool pool;
+    skinning_batch skinning;
+    std::vector<geometry_pool::range> batch_ranges;
+    render_queue queue;
+
+    std::vector<float> morphed_positions(morphed_vertex_count * 3);
+    std::vector<float> morphed_normals(morphed_vertex_count * 3);
+
+    // Morph weights follow the topmost full-body clip of each character
+    std::unordered_map<compressed_animation const *, gltf_model::animation const *> morph_animations;
+    for (auto const & [name, clip] : animations)
+        morph_animations[&clip] = &input_model.animations.at(name);
+
+    struct morph_job
     {
-        if (!mesh.material.texture_path) continue;
-        if (textures.contains(*mesh.material.texture_path)) continue;
+        std::size_t mesh;
+        int instance;
+    };
+
+    std::vector<morph_job> morph_jobs;
+    for (std::size_t m = 0; m < meshes.size(); ++m)
+        if (meshes[m].targets)
+            for (int i = 0; i < instance_count; ++i)
+                morph_jobs.push_back({m, i});
 
-        auto path = std::filesystem::path(model_path).parent_path() / *mesh.material.texture_path;
+    glBindBuffer(GL_ARRAY_BUFFER, skinned_vbo);
+    glBufferData(GL_ARRAY_BUFFER, skinned_vertex_count * sizeof(skinned_vertex), nullptr, GL_STREAM_DRAW);
 
-        int width, height, channels;
-        auto data = stbi_load(path.c_str(), &width, &height, &channels, 4);
-        assert(data);
+    // Instance model matrix followed by the instance bone matrices
+    std::size_t const palette_size = rig.bone_count() + 1;
+    bone_buffer bone_palettes(instance_count * palette_size);
 
-        GLuint texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    // Bone matrices don't include the 0.01 scale of the armature node the skeleton hangs from
+    glm::mat4 const model = glm::scale(glm::mat4(1.f), glm::vec3(0.01f));
 
-        stbi_image_free(data);
+    std::vector<glm::mat4> instance_models(instance_count);
+    for (int i = 0; i < instance_count; ++i)
+        instance_models[i] = glm::translate(glm::mat4(1.f), instance_offset * (i - (instance_count - 1) / 2.f)) * model;
 
-        textures[*mesh.material.texture_path] = texture;
+    // Stress scene: a grid of dancers playing random clips, animated entirely on the GPU from an animation texture.
+    // Time offsets are quantized to a few phases per clip, so that many instances share the same texels.
+    const int crowd_side = 128;
+    const int crowd_phase_count = 16;
+    const float crowd_spacing = 1.f;
+    int crowd_size = 1024;
+
+    animation_atlas atlas;
+    std::vector<glm::vec4> clip_table;
+    for (auto const & [name, animation] : input_model.animations)
+    {
+        auto const & clip = atlas.clips[add_clip(atlas, rig, animation)];
+        clip_table.push_back({clip.first_frame, clip.frame_count, clip.frame_rate, clip.duration});
     }
+    if (clip_table.size() > 8)
+        throw std::runtime_error("The crowd shader supports at most 8 clips");
+
+    animation_texture crowd_animations(atlas);
+
+    struct crowd_instance
+    {
+        glm::vec4 placement;
+        GLint clip;
+    };
+
+    std::vector<crowd_instance> crowd(crowd_side * crowd_side);
+    {
+        std::default_random_engine rng;
+        std::uniform_int_distribution<int> clip_distribution(0, clip_table.size() - 1);
+        std::uniform_int_distribution<int> phase_distribution(0, crowd_phase_count - 1);
+        std::uniform_real_distribution<float> angle_distribution(0.f, 2.f * glm::pi<float>());
+
+        // Spiral out of the center, so that any prefix of the instances forms a roughly round crowd
+        std::vector<glm::vec2> cells;
+        for (int x = 0; x < crowd_side; ++x)
+            for (int z = 0; z < crowd_side; ++z)
+                cells.push_back(crowd_spacing * (glm::vec2(x, z) - (crowd_side - 1) / 2.f));
+        std::stable_sort(cells.begin(), cells.end(), [](glm::vec2 const & a, glm::vec2 const & b){ return glm::dot(a, a) < glm::dot(b, b); });
+
+        for (std::size_t i = 0; i < crowd.size(); ++i)
+        {
+            int const clip = clip_distribution(rng);
+            float const offset = phase_distribution(rng) * clip_table[clip].w / crowd_phase_count;
+            crowd[i] = {glm::vec4(cells[i].x, cells[i].y, angle_distribution(rng), offset), clip};
+        }
+    }
+
+    GLuint crowd_vbo;
+    glGenBuffers(1, &crowd_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, crowd_vbo);
+    glBufferData(GL_ARRAY_BUFFER, crowd.size() * sizeof(crowd_instance), crowd.data(), GL_STATIC_DRAW);
+
+    geometry.bind();
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(crowd_instance), reinterpret_cast<void *>(offsetof(crowd_instance, placement)));
+    glVertexAttribDivisor(5, 1);
+    glEnableVertexAttribArray(6);
+    glVertexAttribIPointer(6, 1, GL_INT, sizeof(crowd_instance), reinterpret_cast<void *>(offsetof(crowd_instance, clip)));
+    glVertexAttribDivisor(6, 1);
+
+    enum class skinning_mode
+    {
+        cpu,
+        gpu,
+        crowd,
+    };
+
+    skinning_mode mode = skinning_mode::gpu;
+
+    // Frame time statistics, printed once a second; GPU time is measured with a timer query
+    // that is only read back once available, so that measuring never stalls the pipeline
+    GLuint gpu_timer;
+    glGenQueries(1, &gpu_timer);
+    bool gpu_timer_pending = false;
+
+    struct
+    {
+        int frames = 0;
+        float cpu_time = 0.f;
+        float max_cpu_time = 0.f;
+        int gpu_frames = 0;
+        double gpu_time = 0.0;
+        gl_state::statistics state_calls;
+    } stats;
+
+    // Rendering state goes through this layer, which skips the calls that wouldn't change anything
+    gl_state state;
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
@@ -294,6 +707,30 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            if (event.key.keysym.sym == SDLK_g)
+                mode = (mode == skinning_mode::gpu) ? skinning_mode::cpu : skinning_mode::gpu;
+            if (event.key.keysym.sym == SDLK_n)
+            {
+                current_clip = (current_clip + 1) % clip_names.size();
+                for (auto & blender : blenders)
+                    blender.play(animations.at(clip_names[current_clip]), crossfade_duration);
+            }
+            if (event.key.keysym.sym == SDLK_m)
+                for (auto & blender : blenders)
+                    for (std::size_t i = 0; i < blender.layer_count(); ++i)
+                        if (auto & layer = blender.layer(i); layer.mask == &upper_body)
+                            layer.target_weight = 1.f - layer.target_weight;
+            if (event.key.keysym.sym == SDLK_l)
+                animation_lod = !animation_lod;
+            if (event.key.keysym.sym == SDLK_c)
+            {
+                mode = (mode == skinning_mode::crowd) ? skinning_mode::gpu : skinning_mode::crowd;
+                camera_distance = (mode == skinning_mode::crowd) ? 10.f : 1.5f;
+            }
+            if (event.key.keysym.sym == SDLK_EQUALS)
+                crowd_size = std::min<int>(crowd.size(), crowd_size * 2);
+            if (event.key.keysym.sym == SDLK_MINUS)
+                crowd_size = std::max(1, crowd_size / 2);
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
@@ -308,7 +745,115 @@ int main() try
         last_frame_start = now;
 
         if (!paused)
+        {
             time += dt;
+            for (auto & blender : blenders)
+                blender.update(dt);
+        }
+
+        ++stats.frames;
+        stats.cpu_time += dt;
+        stats.max_cpu_time = std::max(stats.max_cpu_time, dt);
+        if (stats.cpu_time >= 1.f)
+        {
+            std::cout << (mode == skinning_mode::crowd ? crowd_size : instance_count) << " instances, "
+                << (mode == skinning_mode::cpu ? "CPU" : mode == skinning_mode::gpu ? "GPU" : "crowd") << " skinning: "
+                << "frame " << 1000.f * stats.cpu_time / stats.frames << " ms avg, " << 1000.f * stats.max_cpu_time << " ms max, "
+                << "GPU " << (stats.gpu_frames ? 1e-6 * stats.gpu_time / stats.gpu_frames : 0.0) << " ms, "
+                << "GL state calls " << float(stats.state_calls.issued) / stats.frames << " issued, "
+                << float(stats.state_calls.elided) / stats.frames << " elided per frame" << std::endl;
+            stats = {};
+        }
+
+        if (gpu_timer_pending)
+        {
+            GLint available;
+            glGetQueryObjectiv(gpu_timer, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                GLuint64 elapsed;
+                glGetQueryObjectui64v(gpu_timer, GL_QUERY_RESULT, &elapsed);
+                stats.gpu_time += elapsed;
+                ++stats.gpu_frames;
+                gpu_timer_pending = false;
+            }
+        }
+
+        if (mode != skinning_mode::crowd)
+        {
+            scheduler.schedule(animation_lod ? instance_sizes.data() : full_sizes.data());
+            animate(scheduler, rig, blenders.data(), paused ? 0.f : dt, pool);
+            scheduler.interpolate(pool, bone_matrices.data());
+        }
+
+        GLint palette_offset = 0;
+        if (mode == skinning_mode::gpu)
+        {
+            float * palettes = bone_palettes.map();
+            for (int i = 0; i < instance_count; ++i)
+            {
+                float * palette = palettes + i * palette_size * bone_buffer::floats_per_matrix;
+                bone_buffer::write(palette, instance_models[i]);
+                for (std::size_t b = 0; b < rig.bone_count(); ++b)
+                    bone_buffer::write(palette + (b + 1) * bone_buffer::floats_per_matrix, bone_matrices[i * rig.bone_count() + b]);
+            }
+            palette_offset = bone_palettes.unmap();
+        }
+        else if (mode == skinning_mode::cpu)
+        {
+            // Orphan the previous frame's storage, so that skinning never waits for the GPU to finish reading it
+            glBindBuffer(GL_ARRAY_BUFFER, skinned_vbo);
+            auto skinned_vertices = static_cast<skinned_vertex *>(glMapBufferRange(GL_ARRAY_BUFFER, 0, skinned_vertex_count * sizeof(skinned_vertex),
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+
+            pool.parallel_for(morph_jobs.size(), 1, [&](std::size_t begin, std::size_t end)
+            {
+                thread_local std::vector<float> weights;
+                for (std::size_t j = begin; j < end; ++j)
+                {
+                    auto const & mesh = meshes[morph_jobs[j].mesh];
+                    int const i = morph_jobs[j].instance;
+
+                    gltf_model::animation const * animation = nullptr;
+                    float time = 0.f;
+                    for (std::size_t l = blenders[i].layer_count(); l --> 0;)
+                    {
+                        auto const & layer = blenders[i].layer(l);
+                        if (layer.mode == animation_layer::blend && !layer.mask && layer.weight > 0.f)
+                        {
+                            animation = morph_animations.at(layer.clip.compressed());
+                            time = layer.time;
+                            break;
+                        }
+                    }
+
+                    weights.resize(mesh.targets->size());
+                    sample_morph_weights(input_model, mesh.model_mesh, animation, time, weights.data());
+
+                    std::size_t const offset = (mesh.morphed_base + i * mesh.skinning.vertex_count) * 3;
+                    blend_morph_targets(mesh.skinning, *mesh.targets, weights.data(), morphed_positions.data() + offset, morphed_normals.data() + offset);
+                }
+            });
+
+            skinning.clear();
+            for (auto const & mesh : meshes)
+            {
+                for (int i = 0; i < instance_count; ++i)
+                {
+                    skinning_job job{&mesh.skinning, bone_matrices.data() + i * rig.bone_count(), skinned_vertices + i * geometry.vertex_count() + mesh.range.base_vertex};
+                    if (mesh.targets)
+                    {
+                        std::size_t const offset = (mesh.morphed_base + i * mesh.skinning.vertex_count) * 3;
+                        job.positions = morphed_positions.data() + offset;
+                        job.normals = morphed_normals.data() + offset;
+                    }
+                    skinning.add(job);
+                }
+            }
+            skinning.run(pool);
+
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
 
         if (button_down[SDLK_UP])
             camera_distance -= 3.f * dt;
@@ -325,18 +870,20 @@ int main() try
         if (button_down[SDLK_s])
             view_angle += 2.f * dt;
 
-        glClearColor(0.8f, 0.8f, 1.f, 0.f);
+        state.clear_color(0.8f, 0.8f, 1.f, 0.f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glEnable(GL_DEPTH_TEST);
+        state.enable(GL_DEPTH_TEST);
+
+        bool const timing = !gpu_timer_pending;
+        if (timing)
+            glBeginQuery(GL_TIME_ELAPSED, gpu_timer);
 
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         float near = 0.1f;
         float far = 100.f;
 
-        glm::mat4 model = glm::scale(glm::mat4(1.f), glm::vec3(1.f));
-
         glm::mat4 view(1.f);
         view = glm::translate(view, {0.f, 0.f, -camera_distance});
         view = glm::rotate(view, view_angle, {1.f, 0.f, 0.f});
@@ -349,51 +896,132 @@ int main() try
 
         glm::vec3 light_direction = glm::normalize(glm::vec3(1.f, 2.f, 3.f));
 
-        glUseProgram(program);
-        glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
-        glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
-        glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
-        glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
+        for (int i = 0; i < instance_count; ++i)
+            instance_sizes[i] = projected_size(glm::vec3(instance_models[i][3]) + glm::vec3(0.f, 1.f, 0.f), 1.f, view, glm::pi<float>() / 2.f);
 
-        auto draw_meshes = [&](bool transparent)
+        if (mode == skinning_mode::crowd)
         {
-            for (auto const & mesh : meshes)
+            state.use_program(crowd_program);
+            state.uniform(crowd_model_location, model);
+            state.uniform(crowd_view_location, view);
+            state.uniform(crowd_projection_location, projection);
+            state.uniform(crowd_light_direction_location, light_direction);
+            state.uniform(crowd_animations_location, 1);
+            state.uniform(crowd_clips_location, clip_table.data(), clip_table.size());
+            state.uniform(crowd_time_location, time);
+            state.bind_texture(1, GL_TEXTURE_2D, crowd_animations.texture_handle());
+        }
+        else if (mode == skinning_mode::gpu)
+        {
+            state.use_program(skinning_program);
+            state.uniform(skinning_view_location, view);
+            state.uniform(skinning_projection_location, projection);
+            state.uniform(skinning_light_direction_location, light_direction);
+            state.uniform(skinning_bones_location, 1);
+            state.uniform(skinning_bone_count_location, int(rig.bone_count()));
+            state.uniform(skinning_palette_offset_location, palette_offset);
+            state.bind_texture(1, GL_TEXTURE_BUFFER, bone_palettes.texture_handle());
+        }
+        else
+        {
+            state.use_program(program);
+            state.uniform(view_location, view);
+            state.uniform(projection_location, projection);
+            state.uniform(light_direction_location, light_direction);
+        }
+
+        GLuint const current_use_texture_location = (mode == skinning_mode::crowd) ? crowd_use_texture_location
+            : (mode == skinning_mode::gpu) ? skinning_use_texture_location : use_texture_location;
+        GLuint const current_color_location = (mode == skinning_mode::crowd) ? crowd_color_location
+            : (mode == skinning_mode::gpu) ? skinning_color_location : color_location;
+
+        // One queue item per draw: a mesh with all its instances on the GPU paths, a mesh of one
+        // instance with CPU skinning. The queue orders them by pass, state and depth, and the
+        // loop below only touches the GL state that differs from the previous item.
+        queue.clear();
+        {
+            std::uint32_t const program_index = static_cast<std::uint32_t>(mode);
+            int const draw_instances = (mode == skinning_mode::cpu) ? instance_count : 1;
+            for (int i = 0; i < draw_instances; ++i)
             {
-                if (mesh.material.transparent != transparent)
-                    continue;
+                glm::vec3 const center = (mode == skinning_mode::cpu) ? glm::vec3(instance_models[i][3]) : glm::vec3(0.f);
+                float const depth = -(view * glm::vec4(center + glm::vec3(0.f, 1.f, 0.f), 1.f)).z / far;
 
-                if (mesh.material.two_sided)
-                    glDisable(GL_CULL_FACE);
-                else
-                    glEnable(GL_CULL_FACE);
+                for (std::size_t m = 0; m < meshes.size(); ++m)
+                {
+                    auto const & material = meshes[m].material;
+                    if (!material.texture_path && !material.color)
+                        continue;
+
+                    auto const pass = material.transparent ? render_queue::transparent : render_queue::opaque;
+                    queue.push(render_queue::make_key(pass, program_index, meshes[m].texture_slot, !material.two_sided, depth), i * meshes.size() + m);
+                }
+            }
+        }
+        queue.sort();
 
-                if (transparent)
-                    glEnable(GL_BLEND);
+        {
+            // Items are applied in full and gl_state drops whatever matches the previous item
+            if (mode != skinning_mode::cpu)
+                state.bind_vertex_array(geometry.vertex_array());
+
+            auto const & items = queue.items();
+            for (std::size_t k = 0; k < items.size();)
+            {
+                auto const key = items[k].key;
+                int const instance = items[k].index / meshes.size();
+                auto const & mesh = meshes[items[k].index % meshes.size()];
+
+                bool const opaque = render_queue::pass(key) == render_queue::opaque;
+                state.depth_mask(opaque);
+                state.set_enabled(GL_BLEND, !opaque);
+                state.set_enabled(GL_CULL_FACE, render_queue::cull(key));
+
+                std::uint32_t const texture = render_queue::texture(key);
+                if (texture != 0)
+                    state.bind_texture(0, GL_TEXTURE_2D, texture_handles[texture]);
                 else
-                    glDisable(GL_BLEND);
+                    state.uniform(current_color_location, *mesh.material.color);
+                state.uniform(current_use_texture_location, int(texture != 0));
 
-                if (mesh.material.texture_path)
+                if (mode != skinning_mode::cpu)
                 {
-                    glBindTexture(GL_TEXTURE_2D, textures[*mesh.material.texture_path]);
-                    glUniform1i(use_texture_location, 1);
+                    geometry.draw(mesh.range, (mode == skinning_mode::crowd) ? crowd_size : instance_count);
+                    ++k;
+                    continue;
                 }
-                else if (mesh.material.color)
+
+                state.bind_vertex_array(skinned_vaos[instance]);
+                state.uniform(model_location, instance_models[instance]);
+
+                // Following items of the same instance with the same key (hence the same state) go into one multi-draw
+                batch_ranges.clear();
+                batch_ranges.push_back(mesh.range);
+                for (++k; k < items.size() && items[k].key == key && int(items[k].index / meshes.size()) == instance; ++k)
                 {
-                    glUniform1i(use_texture_location, 0);
-                    glUniform4fv(color_location, 1, reinterpret_cast<const float *>(&(*mesh.material.color)));
+                    auto const & next = meshes[items[k].index % meshes.size()];
+                    if (texture == 0 && *next.material.color != *mesh.material.color)
+                        break;
+                    batch_ranges.push_back(next.range);
                 }
-                else
-                    continue;
-
-                glBindVertexArray(mesh.vao);
-                glDrawElements(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset));
+                geometry.draw(batch_ranges.data(), batch_ranges.size());
             }
-        };
 
-        draw_meshes(false);
-        glDepthMask(GL_FALSE);
-        draw_meshes(true);
-        glDepthMask(GL_TRUE);
+            state.depth_mask(true);
+        }
+
+        if (mode == skinning_mode::gpu)
+            bone_palettes.fence();
+
+        if (timing)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            gpu_timer_pending = true;
+        }
+
+        auto const state_calls = state.end_frame();
+        stats.state_calls.issued += state_calls.issued;
+        stats.state_calls.elided += state_calls.elided;
 
         SDL_GL_SwapWindow(window);
     }
@@ -0,0 +1,440 @@
+#include "meshopt_decoder.hpp"
+#include "simd.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+
+    constexpr unsigned char vertex_header = 0xa0;
+    constexpr unsigned char triangle_header = 0xe0;
+    constexpr unsigned char sequence_header = 0xd0;
+
+    constexpr std::size_t byte_group_size = 16;
+    constexpr std::size_t byte_group_decode_limit = 24;
+    constexpr std::size_t vertex_block_size_bytes = 8192;
+    constexpr std::size_t vertex_block_max_size = 256;
+    constexpr std::size_t tail_max_size = 32;
+
+    [[noreturn]] void fail(char const * what)
+    {
+        throw std::runtime_error(std::string("Malformed meshopt data: ") + what);
+    }
+
+    std::size_t vertex_block_size(std::size_t stride)
+    {
+        std::size_t const result = (vertex_block_size_bytes / stride) & ~(byte_group_size - 1);
+        return std::min(result, vertex_block_max_size);
+    }
+
+    // One group of 16 bytes, stored with 0, 2, 4 or 8 bits per byte; values that don't fit
+    // the smaller widths are marked with all ones and follow the group as whole bytes
+    unsigned char const * decode_byte_group(unsigned char const * data, unsigned char * buffer, int bits_log2)
+    {
+        switch (bits_log2)
+        {
+        case 0:
+            std::memset(buffer, 0, byte_group_size);
+            return data;
+        case 3:
+            std::memcpy(buffer, data, byte_group_size);
+            return data + byte_group_size;
+        }
+
+        int const bits = 1 << bits_log2;
+        unsigned int const escape = (1u << bits) - 1;
+        int const per_byte = 8 / bits;
+
+        unsigned char const * extra = data + byte_group_size / per_byte;
+        for (std::size_t i = 0; i < byte_group_size; i += per_byte)
+        {
+            unsigned int byte = *data++;
+            for (int j = 0; j < per_byte; ++j)
+            {
+                unsigned int const value = (byte >> (8 - bits)) & escape;
+                byte <<= bits;
+                buffer[i + j] = (value == escape) ? *extra : value;
+                extra += (value == escape);
+            }
+        }
+        return extra;
+    }
+
+    unsigned char const * decode_bytes(unsigned char const * data, unsigned char const * end, unsigned char * buffer, std::size_t size)
+    {
+        unsigned char const * header = data;
+        std::size_t const header_size = (size / byte_group_size + 3) / 4;
+        if (std::size_t(end - data) < header_size)
+            fail("truncated byte group header");
+        data += header_size;
+
+        for (std::size_t i = 0; i < size; i += byte_group_size)
+        {
+            // A group never takes more than 24 bytes, and the stream ends with a tail at least that long
+            if (std::size_t(end - data) < byte_group_decode_limit)
+                fail("truncated byte group");
+
+            std::size_t const group = i / byte_group_size;
+            int const bits_log2 = (header[group / 4] >> ((group % 4) * 2)) & 3;
+            data = decode_byte_group(data, buffer + i, bits_log2);
+        }
+        return data;
+    }
+
+    // Bytes are zigzag-encoded deltas from the same byte of the previous vertex
+    void decode_deltas(unsigned char const * buffer, std::size_t count, unsigned char & previous, unsigned char * output, std::size_t stride)
+    {
+        std::size_t i = 0;
+
+#if defined(SIMD_SSE2)
+        alignas(16) unsigned char decoded[byte_group_size];
+        for (; i + byte_group_size <= count; i += byte_group_size)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(buffer + i));
+
+            // unzigzag: (v >> 1) ^ -(v & 1), with the byte shift emulated on 16-bit lanes
+            __m128i const half = _mm_and_si128(_mm_srli_epi16(v, 1), _mm_set1_epi8(0x7f));
+            __m128i const sign = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(v, _mm_set1_epi8(1)));
+            v = _mm_xor_si128(half, sign);
+
+            // Inclusive prefix sum of 16 bytes in four steps, plus the last byte of the previous group
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 1));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 2));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+            v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+            v = _mm_add_epi8(v, _mm_set1_epi8(static_cast<char>(previous)));
+
+            _mm_store_si128(reinterpret_cast<__m128i *>(decoded), v);
+            for (std::size_t j = 0; j < byte_group_size; ++j)
+                output[(i + j) * stride] = decoded[j];
+            previous = decoded[byte_group_size - 1];
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            unsigned char const v = buffer[i];
+            previous += static_cast<unsigned char>((v >> 1) ^ (0u - (v & 1)));
+            output[i * stride] = previous;
+        }
+    }
+
+    unsigned char const * decode_vertex_block(unsigned char const * data, unsigned char const * end, unsigned char * destination,
+        std::size_t count, std::size_t stride, unsigned char * last_vertex)
+    {
+        unsigned char buffer[vertex_block_max_size];
+        std::size_t const count_aligned = (count + byte_group_size - 1) & ~(byte_group_size - 1);
+
+        for (std::size_t k = 0; k < stride; ++k)
+        {
+            data = decode_bytes(data, end, buffer, count_aligned);
+            decode_deltas(buffer, count, last_vertex[k], destination + k, stride);
+        }
+        return data;
+    }
+
+    unsigned int decode_vbyte(unsigned char const *& data)
+    {
+        unsigned char const lead = *data++;
+        if (lead < 128)
+            return lead;
+
+        unsigned int result = lead & 127;
+        unsigned int shift = 7;
+        for (int i = 0; i < 4; ++i)
+        {
+            unsigned char const group = *data++;
+            result |= unsigned(group & 127) << shift;
+            shift += 7;
+            if (group < 128)
+                break;
+        }
+        return result;
+    }
+
+    unsigned int decode_index(unsigned char const *& data, unsigned int last)
+    {
+        unsigned int const v = decode_vbyte(data);
+        unsigned int const d = (v >> 1) ^ (0u - (v & 1));
+        return last + d;
+    }
+
+    void write_index(void * destination, std::size_t i, std::size_t index_size, unsigned int index)
+    {
+        if (index_size == 2)
+            static_cast<std::uint16_t *>(destination)[i] = static_cast<std::uint16_t>(index);
+        else
+            static_cast<std::uint32_t *>(destination)[i] = index;
+    }
+
+    template <typename T>
+    void decode_octahedral(T * data, std::size_t count)
+    {
+        float const max = float((1 << (sizeof(T) * 8 - 1)) - 1);
+        for (std::size_t i = 0; i < count; ++i, data += 4)
+        {
+            // x and y are the octahedral coordinates, z holds the encoding scale
+            float x = data[0];
+            float y = data[1];
+            float const z = float(data[2]) - std::abs(x) - std::abs(y);
+
+            float const t = std::min(z, 0.f);
+            x += (x >= 0.f) ? t : -t;
+            y += (y >= 0.f) ? t : -t;
+
+            float const s = max / std::sqrt(x * x + y * y + z * z);
+            data[0] = T(std::lround(x * s));
+            data[1] = T(std::lround(y * s));
+            data[2] = T(std::lround(z * s));
+        }
+    }
+
+    void decode_quaternion(std::int16_t * data, std::size_t count)
+    {
+        float const scale = 1.f / std::sqrt(2.f);
+        for (std::size_t i = 0; i < count; ++i, data += 4)
+        {
+            // The fourth component holds the scale in its upper bits and the index of the omitted component in the lower two
+            int const sf = data[3] | 3;
+            float const ss = scale / float(sf);
+
+            float const x = data[0] * ss;
+            float const y = data[1] * ss;
+            float const z = data[2] * ss;
+            float const w = std::sqrt(std::max(0.f, 1.f - x * x - y * y - z * z));
+
+            int const qc = data[3] & 3;
+            data[(qc + 1) & 3] = std::int16_t(std::lround(x * 32767.f));
+            data[(qc + 2) & 3] = std::int16_t(std::lround(y * 32767.f));
+            data[(qc + 3) & 3] = std::int16_t(std::lround(z * 32767.f));
+            data[(qc + 0) & 3] = std::int16_t(std::lround(w * 32767.f));
+        }
+    }
+
+    // Every 32-bit value is a 24-bit signed mantissa and an 8-bit signed exponent
+    void decode_exponential(std::uint32_t * data, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            std::int32_t const m = std::int32_t(data[i] << 8) >> 8;
+            std::int32_t const e = std::int32_t(data[i]) >> 24;
+
+            float const f = std::ldexp(float(m), e);
+            std::memcpy(&data[i], &f, sizeof(f));
+        }
+    }
+
+}
+
+void decode_meshopt_attributes(void * destination, std::size_t count, std::size_t stride, unsigned char const * data, std::size_t size)
+{
+    if (stride == 0 || stride > 256 || stride % 4 != 0)
+        throw std::runtime_error("Unsupported meshopt vertex stride: " + std::to_string(stride));
+
+    unsigned char const * const end = data + size;
+    if (size < 1 + stride)
+        fail("truncated vertex data");
+    if ((*data & 0xf0) != vertex_header || (*data & 0x0f) != 0)
+        fail("unsupported vertex codec version");
+    ++data;
+
+    // The stream ends with the first vertex, padded to at least 32 bytes, which the deltas of the first block start from
+    std::size_t const tail_size = std::max(stride, tail_max_size);
+    if (std::size_t(end - data) < tail_size)
+        fail("truncated vertex tail");
+
+    unsigned char last_vertex[256];
+    std::memcpy(last_vertex, end - stride, stride);
+
+    auto output = static_cast<unsigned char *>(destination);
+    std::size_t const block_size = vertex_block_size(stride);
+    for (std::size_t offset = 0; offset < count; offset += block_size)
+    {
+        std::size_t const block = std::min(block_size, count - offset);
+        data = decode_vertex_block(data, end, output + offset * stride, block, stride, last_vertex);
+    }
+
+    if (std::size_t(end - data) != tail_size)
+        fail("unexpected vertex data size");
+}
+
+void decode_meshopt_triangles(void * destination, std::size_t count, std::size_t index_size, unsigned char const * data, std::size_t size)
+{
+    if (count % 3 != 0 || (index_size != 2 && index_size != 4))
+        throw std::runtime_error("Unsupported meshopt triangle layout");
+
+    // Header, a code byte per triangle and a 16-byte table of auxiliary codes at the end
+    if (size < 1 + count / 3 + 16)
+        fail("truncated triangle data");
+    if ((data[0] & 0xf0) != triangle_header)
+        fail("unsupported triangle codec");
+    int const version = data[0] & 0x0f;
+    if (version > 1)
+        fail("unsupported triangle codec version");
+
+    // Recently seen edges and vertices: triangles mostly reuse an edge of the last few triangles
+    unsigned int edges[16][2];
+    unsigned int vertices[16];
+    std::memset(edges, -1, sizeof(edges));
+    std::memset(vertices, -1, sizeof(vertices));
+    std::size_t edge_offset = 0;
+    std::size_t vertex_offset = 0;
+
+    auto push_edge = [&](unsigned int a, unsigned int b)
+    {
+        edges[edge_offset][0] = a;
+        edges[edge_offset][1] = b;
+        edge_offset = (edge_offset + 1) & 15;
+    };
+
+    auto push_vertex = [&](unsigned int v, bool condition = true)
+    {
+        vertices[vertex_offset] = v;
+        vertex_offset = (vertex_offset + condition) & 15;
+    };
+
+    unsigned int next = 0;
+    unsigned int last = 0;
+    int const fec_max = (version >= 1) ? 13 : 15;
+
+    unsigned char const * code = data + 1;
+    unsigned char const * stream = code + count / 3;
+    unsigned char const * const safe_end = data + size - 16;
+    unsigned char const * const aux_table = safe_end;
+
+    for (std::size_t i = 0; i < count; i += 3)
+    {
+        // A triangle reads at most 16 bytes, which the auxiliary table at the end guarantees
+        if (stream > safe_end)
+            fail("truncated triangle stream");
+
+        unsigned char const code_triangle = *code++;
+        unsigned int a, b, c;
+
+        if (code_triangle < 0xf0)
+        {
+            // Edge from the fifo plus a new, cached or explicitly encoded vertex
+            int const fe = code_triangle >> 4;
+            a = edges[(edge_offset - 1 - fe) & 15][0];
+            b = edges[(edge_offset - 1 - fe) & 15][1];
+
+            int const fec = code_triangle & 15;
+            if (fec < fec_max)
+            {
+                c = (fec == 0) ? next : vertices[(vertex_offset - 1 - fec) & 15];
+                next += (fec == 0);
+                push_vertex(c, fec == 0);
+            }
+            else
+            {
+                // 13 and 14 encode last - 1 and last + 1
+                c = last = (fec != 15) ? last + (fec - (fec ^ 3)) : decode_index(stream, last);
+                push_vertex(c);
+            }
+
+            push_edge(c, b);
+            push_edge(a, c);
+        }
+        else
+        {
+            int fea, feb, fec;
+            if (code_triangle < 0xfe)
+            {
+                unsigned char const aux = aux_table[code_triangle & 15];
+                fea = 0;
+                feb = aux >> 4;
+                fec = aux & 15;
+            }
+            else
+            {
+                unsigned char const aux = *stream++;
+                fea = (code_triangle == 0xfe) ? 0 : 15;
+                feb = aux >> 4;
+                fec = aux & 15;
+                if (aux == 0)
+                    next = 0;
+            }
+
+            a = (fea == 0) ? next++ : 0;
+            b = (feb == 0) ? next++ : vertices[(vertex_offset - feb) & 15];
+            c = (fec == 0) ? next++ : vertices[(vertex_offset - fec) & 15];
+
+            if (fea == 15)
+                last = a = decode_index(stream, last);
+            if (feb == 15)
+                last = b = decode_index(stream, last);
+            if (fec == 15)
+                last = c = decode_index(stream, last);
+
+            push_vertex(a);
+            push_vertex(b, feb == 0 || feb == 15);
+            push_vertex(c, fec == 0 || fec == 15);
+
+            push_edge(b, a);
+            push_edge(c, b);
+            push_edge(a, c);
+        }
+
+        write_index(destination, i + 0, index_size, a);
+        write_index(destination, i + 1, index_size, b);
+        write_index(destination, i + 2, index_size, c);
+    }
+
+    if (stream != safe_end)
+        fail("unexpected triangle data size");
+}
+
+void decode_meshopt_indices(void * destination, std::size_t count, std::size_t index_size, unsigned char const * data, std::size_t size)
+{
+    if (index_size != 2 && index_size != 4)
+        throw std::runtime_error("Unsupported meshopt index size");
+
+    // Header, at least a byte per index and a 4-byte tail
+    if (size < 1 + count + 4)
+        fail("truncated index data");
+    if ((data[0] & 0xf0) != sequence_header || (data[0] & 0x0f) > 1)
+        fail("unsupported index codec");
+
+    unsigned char const * stream = data + 1;
+    unsigned char const * const safe_end = data + size - 4;
+
+    // Deltas alternate between two baselines, selected by the lowest bit
+    unsigned int last[2] = {0, 0};
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        if (stream >= safe_end)
+            fail("truncated index stream");
+
+        unsigned int v = decode_vbyte(stream);
+        unsigned int const baseline = v & 1;
+        v >>= 1;
+
+        unsigned int const index = last[baseline] + ((v >> 1) ^ (0u - (v & 1)));
+        last[baseline] = index;
+        write_index(destination, i, index_size, index);
+    }
+
+    if (stream != safe_end)
+        fail("unexpected index data size");
+}
+
+void apply_meshopt_filter(std::string_view filter, void * data, std::size_t count, std::size_t stride)
+{
+    if (filter.empty() || filter == "NONE")
+        return;
+
+    if (filter == "OCTAHEDRAL" && stride == 4)
+        decode_octahedral(static_cast<std::int8_t *>(data), count);
+    else if (filter == "OCTAHEDRAL" && stride == 8)
+        decode_octahedral(static_cast<std::int16_t *>(data), count);
+    else if (filter == "QUATERNION" && stride == 8)
+        decode_quaternion(static_cast<std::int16_t *>(data), count);
+    else if (filter == "EXPONENTIAL" && stride % 4 == 0)
+        decode_exponential(static_cast<std::uint32_t *>(data), count * stride / 4);
+    else
+        throw std::runtime_error("Unsupported meshopt filter " + std::string(filter) + " with stride " + std::to_string(stride));
+}
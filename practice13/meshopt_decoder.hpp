@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// Decoders for buffer views compressed with EXT_meshopt_compression: the meshoptimizer vertex codec
+// (version 0), the triangle and index sequence codecs, and the octahedral, quaternion and exponential
+// filters. All of them throw std::runtime_error on malformed data instead of reading out of bounds.
+
+// ATTRIBUTES mode: `count` elements of `stride` bytes (a multiple of 4, at most 256)
+void decode_meshopt_attributes(void * destination, std::size_t count, std::size_t stride, unsigned char const * data, std::size_t size);
+
+// TRIANGLES mode: `count` indices (a multiple of 3) of `index_size` bytes (2 or 4)
+void decode_meshopt_triangles(void * destination, std::size_t count, std::size_t index_size, unsigned char const * data, std::size_t size);
+
+// INDICES mode: `count` indices of `index_size` bytes (2 or 4)
+void decode_meshopt_indices(void * destination, std::size_t count, std::size_t index_size, unsigned char const * data, std::size_t size);
+
+// Applies a filter ("NONE", "OCTAHEDRAL", "QUATERNION" or "EXPONENTIAL") in place to decoded attributes
+void apply_meshopt_filter(std::string_view filter, void * data, std::size_t count, std::size_t stride);
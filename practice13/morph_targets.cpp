@@ -0,0 +1,56 @@
+#include "morph_targets.hpp"
+#include "simd.hpp"
+
+#include <cstring>
+
+std::size_t blend_morph_targets(skinning_source const & source, std::vector<gltf_model::morph_target> const & targets,
+    float const * weights, float * positions, float * normals)
+{
+    std::memcpy(positions, source.positions, source.vertex_count * 3 * sizeof(float));
+    std::memcpy(normals, source.normals, source.vertex_count * 3 * sizeof(float));
+
+    std::size_t applied = 0;
+    for (std::size_t t = 0; t < targets.size(); ++t)
+    {
+        if (weights[t] == 0.f)
+            continue;
+
+        auto const & target = targets[t];
+        auto const weight = simd::splat4(weights[t]);
+        for (std::size_t i = 0; i < target.vertices.size(); ++i)
+        {
+            std::size_t const v = target.vertices[i] * 3;
+            simd::store3(positions + v, simd::load3(positions + v) + simd::load4(&target.position_deltas[i].x) * weight);
+            simd::store3(normals + v, simd::load3(normals + v) + simd::load4(&target.normal_deltas[i].x) * weight);
+        }
+        applied += target.vertices.size();
+    }
+
+    return applied;
+}
+
+std::size_t morph_target_count(gltf_model::mesh const & mesh)
+{
+    return mesh.primitives.empty() ? 0 : mesh.primitives.front().targets.size();
+}
+
+void sample_morph_weights(gltf_model const & model, std::size_t mesh, gltf_model::animation const * animation, float time, float * weights)
+{
+    auto const & defaults = model.meshes[mesh].weights;
+    std::size_t const count = morph_target_count(model.meshes[mesh]);
+
+    if (animation)
+    {
+        for (auto const & channel : animation->morph_weights)
+        {
+            if (channel.mesh != mesh)
+                continue;
+
+            channel(time, weights, count);
+            return;
+        }
+    }
+
+    for (std::size_t t = 0; t < count; ++t)
+        weights[t] = (t < defaults.size()) ? defaults[t] : 0.f;
+}
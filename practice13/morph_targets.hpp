@@ -0,0 +1,17 @@
+#pragma once
+
+#include "cpu_skinning.hpp"
+
+// Writes the base positions and normals of `source` plus the weighted deltas of `targets`, 3 floats per vertex.
+// Targets with zero weight are skipped and the others only touch the vertices they move, so the cost
+// grows with the deltas of the active targets rather than with targets times vertices.
+// Returns the number of deltas applied.
+std::size_t blend_morph_targets(skinning_source const & source, std::vector<gltf_model::morph_target> const & targets,
+    float const * weights, float * positions, float * normals);
+
+// Morph weights of model.meshes[mesh] at `time`: from the weights channel of `animation` if it has one
+// for the mesh (`animation` may be null), from the mesh's default weights otherwise
+void sample_morph_weights(gltf_model const & model, std::size_t mesh, gltf_model::animation const * animation, float time, float * weights);
+
+// Number of morph targets of a mesh (all primitives of a mesh have the same number of targets)
+std::size_t morph_target_count(gltf_model::mesh const & mesh);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#define GLM_FORCE_SWIZZLE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/vec3.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include "simd.hpp"
+
+// Local (parent-relative) TRS of every bone of a skeleton, stored as struct-of-arrays:
+// ten channels (tx, ty, tz, rx, ry, rz, rw, sx, sy, sz), each holding `stride` floats.
+// The stride is the bone count padded to simd::width, padding lanes hold the identity transform.
+struct pose
+{
+    enum channel : std::size_t
+    {
+        tx, ty, tz,
+        rx, ry, rz, rw,
+        sx, sy, sz,
+        channel_count,
+    };
+
+    std::size_t bone_count = 0;
+    std::size_t stride = 0;
+    std::vector<float> data;
+
+    pose() = default;
+
+    explicit pose(std::size_t bone_count)
+    {
+        resize(bone_count);
+    }
+
+    void resize(std::size_t bone_count)
+    {
+        this->bone_count = bone_count;
+        stride = simd::padded(bone_count);
+        data.assign(channel_count * stride, 0.f);
+        for (std::size_t i = 0; i < stride; ++i)
+        {
+            channel(rw)[i] = 1.f;
+            channel(sx)[i] = 1.f;
+            channel(sy)[i] = 1.f;
+            channel(sz)[i] = 1.f;
+        }
+    }
+
+    float * channel(std::size_t c) { return data.data() + c * stride; }
+    float const * channel(std::size_t c) const { return data.data() + c * stride; }
+
+    glm::vec3 translation(std::size_t bone) const
+    {
+        return {channel(tx)[bone], channel(ty)[bone], channel(tz)[bone]};
+    }
+
+    glm::quat rotation(std::size_t bone) const
+    {
+        return glm::quat(channel(rw)[bone], channel(rx)[bone], channel(ry)[bone], channel(rz)[bone]);
+    }
+
+    glm::vec3 scale(std::size_t bone) const
+    {
+        return {channel(sx)[bone], channel(sy)[bone], channel(sz)[bone]};
+    }
+
+    void set(std::size_t bone, glm::vec3 const & translation, glm::quat const & rotation, glm::vec3 const & scale)
+    {
+        channel(tx)[bone] = translation.x;
+        channel(ty)[bone] = translation.y;
+        channel(tz)[bone] = translation.z;
+        channel(rx)[bone] = rotation.x;
+        channel(ry)[bone] = rotation.y;
+        channel(rz)[bone] = rotation.z;
+        channel(rw)[bone] = rotation.w;
+        channel(sx)[bone] = scale.x;
+        channel(sy)[bone] = scale.y;
+        channel(sz)[bone] = scale.z;
+    }
+};
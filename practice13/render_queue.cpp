@@ -0,0 +1,100 @@
+#include "render_queue.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace
+{
+
+    constexpr std::uint64_t depth_bits = 24;
+    constexpr std::uint64_t cull_bits = 1;
+    constexpr std::uint64_t texture_bits = 16;
+    constexpr std::uint64_t program_bits = 8;
+
+    constexpr std::uint64_t mask(std::uint64_t bits)
+    {
+        return (std::uint64_t(1) << bits) - 1;
+    }
+
+    // Bit offsets of the fields that depend on the pass
+    constexpr std::uint64_t state_shift(render_queue::pass_type pass)
+    {
+        return (pass == render_queue::opaque) ? depth_bits : 0;
+    }
+
+    constexpr std::uint64_t depth_shift(render_queue::pass_type pass)
+    {
+        return (pass == render_queue::opaque) ? 0 : cull_bits + texture_bits + program_bits;
+    }
+
+    constexpr std::uint64_t pass_shift = depth_bits + cull_bits + texture_bits + program_bits;
+
+}
+
+std::uint64_t render_queue::make_key(pass_type pass, std::uint32_t program, std::uint32_t texture, bool cull, float depth)
+{
+    std::uint64_t quantized_depth = std::lround(std::clamp(depth, 0.f, 1.f) * float(mask(depth_bits)));
+    if (pass == transparent)
+        quantized_depth = mask(depth_bits) - quantized_depth;
+
+    std::uint64_t const state = (std::uint64_t(program & mask(program_bits)) << (texture_bits + cull_bits))
+        | (std::uint64_t(texture & mask(texture_bits)) << cull_bits)
+        | std::uint64_t(cull);
+
+    return (std::uint64_t(pass) << pass_shift) | (state << state_shift(pass)) | (quantized_depth << depth_shift(pass));
+}
+
+render_queue::pass_type render_queue::pass(std::uint64_t key)
+{
+    return static_cast<pass_type>(key >> pass_shift);
+}
+
+std::uint32_t render_queue::program(std::uint64_t key)
+{
+    return (key >> (state_shift(pass(key)) + texture_bits + cull_bits)) & mask(program_bits);
+}
+
+std::uint32_t render_queue::texture(std::uint64_t key)
+{
+    return (key >> (state_shift(pass(key)) + cull_bits)) & mask(texture_bits);
+}
+
+bool render_queue::cull(std::uint64_t key)
+{
+    return (key >> state_shift(pass(key))) & 1;
+}
+
+void render_queue::sort()
+{
+    if (queue.size() < 2)
+        return;
+
+    // Histograms of all eight key bytes in a single pass
+    std::array<std::array<std::uint32_t, 256>, 8> counts{};
+    for (auto const & item : queue)
+        for (int b = 0; b < 8; ++b)
+            ++counts[b][(item.key >> (8 * b)) & 255];
+
+    scratch.resize(queue.size());
+    for (int b = 0; b < 8; ++b)
+    {
+        auto & histogram = counts[b];
+
+        // A byte that all keys share doesn't change the order
+        if (histogram[(queue.front().key >> (8 * b)) & 255] == queue.size())
+            continue;
+
+        std::uint32_t offset = 0;
+        for (auto & count : histogram)
+        {
+            std::uint32_t const next = offset + count;
+            count = offset;
+            offset = next;
+        }
+
+        for (auto const & item : queue)
+            scratch[histogram[(item.key >> (8 * b)) & 255]++] = item;
+        queue.swap(scratch);
+    }
+}
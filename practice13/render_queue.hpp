@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Draw items of one frame, ordered by 64-bit sort keys. Opaque items are grouped by state
+// (program, texture, cull mode) and drawn front to back within a group; transparent items are
+// drawn back to front first and grouped by state only among equal depths. From the most
+// significant bit:
+//
+//     opaque:      pass:2 | program:8 | texture:16 | cull:1 | depth:24
+//     transparent: pass:2 | inverted depth:24 | program:8 | texture:16 | cull:1
+//
+// Keys are sorted with an LSD radix sort that skips the bytes all keys agree on, and storage
+// is reused between frames, so building and sorting the queue never allocates once warmed up.
+class render_queue
+{
+public:
+    enum pass_type : std::uint32_t
+    {
+        opaque = 0,
+        transparent = 1,
+    };
+
+    struct item
+    {
+        std::uint64_t key;
+        // Meaning is up to the caller, e.g. an index into its own draw list
+        std::uint32_t index;
+    };
+
+    // `depth` is normalized to [0, 1] (e.g. view distance / far plane) and clamped
+    static std::uint64_t make_key(pass_type pass, std::uint32_t program, std::uint32_t texture, bool cull, float depth);
+
+    static pass_type pass(std::uint64_t key);
+    static std::uint32_t program(std::uint64_t key);
+    static std::uint32_t texture(std::uint64_t key);
+    static bool cull(std::uint64_t key);
+
+    void clear() { queue.clear(); }
+    void push(std::uint64_t key, std::uint32_t index) { queue.push_back({key, index}); }
+
+    void sort();
+
+    std::vector<item> const & items() const { return queue; }
+
+private:
+    std::vector<item> queue;
+    std::vector<item> scratch;
+};
@@ -0,0 +1,135 @@
+#include "skeleton.hpp"
+
+namespace
+{
+
+    // Local matrices are kept as struct-of-arrays over bones, one channel per entry of the upper 3x4 part
+    enum local_channel : std::size_t
+    {
+        c0x, c0y, c0z,
+        c1x, c1y, c1z,
+        c2x, c2y, c2z,
+        c3x, c3y, c3z,
+        local_channel_count,
+    };
+
+    // TRS -> matrix for simd::width bones at once
+    void compute_local_matrices(pose const & pose, float * local)
+    {
+        std::size_t const stride = pose.stride;
+        auto channel = [&](std::size_t c){ return local + c * stride; };
+
+        auto const one = simd::splat(1.f);
+        auto const two = simd::splat(2.f);
+
+        for (std::size_t k = 0; k < stride; k += simd::width)
+        {
+            auto x = simd::load(pose.channel(pose::rx) + k);
+            auto y = simd::load(pose.channel(pose::ry) + k);
+            auto z = simd::load(pose.channel(pose::rz) + k);
+            auto w = simd::load(pose.channel(pose::rw) + k);
+
+            auto sx = simd::load(pose.channel(pose::sx) + k);
+            auto sy = simd::load(pose.channel(pose::sy) + k);
+            auto sz = simd::load(pose.channel(pose::sz) + k);
+
+            auto xx = x * x, yy = y * y, zz = z * z;
+            auto xy = x * y, xz = x * z, yz = y * z;
+            auto wx = w * x, wy = w * y, wz = w * z;
+
+            simd::store(channel(c0x) + k, (one - two * (yy + zz)) * sx);
+            simd::store(channel(c0y) + k, two * (xy + wz) * sx);
+            simd::store(channel(c0z) + k, two * (xz - wy) * sx);
+
+            simd::store(channel(c1x) + k, two * (xy - wz) * sy);
+            simd::store(channel(c1y) + k, (one - two * (xx + zz)) * sy);
+            simd::store(channel(c1z) + k, two * (yz + wx) * sy);
+
+            simd::store(channel(c2x) + k, two * (xz + wy) * sz);
+            simd::store(channel(c2y) + k, two * (yz - wx) * sz);
+            simd::store(channel(c2z) + k, (one - two * (xx + yy)) * sz);
+
+            simd::store(channel(c3x) + k, simd::load(pose.channel(pose::tx) + k));
+            simd::store(channel(c3y) + k, simd::load(pose.channel(pose::ty) + k));
+            simd::store(channel(c3z) + k, simd::load(pose.channel(pose::tz) + k));
+        }
+    }
+
+    // result = a * b for affine matrices (last row 0 0 0 1), one column per four-lane vector;
+    // b is given by its 12 upper entries b(column, row)
+    template <typename B>
+    void multiply_affine(float const * a, B && b, float * result)
+    {
+        auto const a0 = simd::load4(a + 0);
+        auto const a1 = simd::load4(a + 4);
+        auto const a2 = simd::load4(a + 8);
+        auto const a3 = simd::load4(a + 12);
+
+        for (int j = 0; j < 3; ++j)
+            simd::store(result + 4 * j, a0 * simd::splat4(b(j, 0)) + a1 * simd::splat4(b(j, 1)) + a2 * simd::splat4(b(j, 2)));
+        simd::store(result + 12, a0 * simd::splat4(b(3, 0)) + a1 * simd::splat4(b(3, 1)) + a2 * simd::splat4(b(3, 2)) + a3);
+    }
+
+}
+
+skeleton::skeleton(std::vector<gltf_model::bone> const & bones)
+{
+    parents.reserve(bones.size());
+    inverse_bind_matrices.reserve(bones.size());
+    for (auto const & bone : bones)
+    {
+        assert(bone.parent == no_parent || bone.parent < parents.size());
+        parents.push_back(bone.parent);
+        inverse_bind_matrices.push_back(bone.inverse_bind_matrix);
+    }
+}
+
+void compute_bone_matrices(skeleton const & skeleton, pose const & pose, skeleton_workspace & workspace, glm::mat4 * result)
+{
+    std::size_t const bone_count = skeleton.bone_count();
+    assert(pose.bone_count == bone_count);
+
+    std::size_t const stride = pose.stride;
+    workspace.local.resize(local_channel_count * stride);
+    workspace.model.resize(bone_count);
+
+    compute_local_matrices(pose, workspace.local.data());
+
+    float const * local = workspace.local.data();
+
+    for (std::size_t i = 0; i < bone_count; ++i)
+    {
+        float * model = &workspace.model[i][0][0];
+        auto local_entry = [&](int column, int row){ return local[(3 * column + row) * stride + i]; };
+
+        if (std::uint32_t const parent = skeleton.parents[i]; parent != skeleton::no_parent)
+            multiply_affine(&workspace.model[parent][0][0], local_entry, model);
+        else
+        {
+            for (int column = 0; column < 4; ++column)
+            {
+                for (int row = 0; row < 3; ++row)
+                    model[4 * column + row] = local_entry(column, row);
+                model[4 * column + 3] = (column == 3) ? 1.f : 0.f;
+            }
+        }
+
+        glm::mat4 const & inverse_bind = skeleton.inverse_bind_matrices[i];
+        multiply_affine(model, [&](int column, int row){ return inverse_bind[column][row]; }, &result[i][0][0]);
+    }
+}
+
+void compute_bone_matrices(skeleton const & skeleton, pose const * poses, std::size_t count, skeleton_workspace & workspace, glm::mat4 * result)
+{
+    for (std::size_t i = 0; i < count; ++i)
+        compute_bone_matrices(skeleton, poses[i], workspace, result + i * skeleton.bone_count());
+}
+
+void compute_bone_matrices(skeleton const & skeleton, pose const * poses, std::size_t count, thread_pool & pool, glm::mat4 * result)
+{
+    pool.parallel_for(count, 16, [&](std::size_t begin, std::size_t end)
+    {
+        thread_local skeleton_workspace workspace;
+        compute_bone_matrices(skeleton, poses + begin, end - begin, workspace, result + begin * skeleton.bone_count());
+    });
+}
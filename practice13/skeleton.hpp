@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include "gltf_loader.hpp"
+#include "pose.hpp"
+#include "thread_pool.hpp"
+
+// Flattened rig shared by all instances of a model: parents always precede their children
+// (guaranteed by load_gltf), so model-space transforms are computed in one linear pass.
+struct skeleton
+{
+    static constexpr std::uint32_t no_parent = -1;
+
+    std::vector<std::uint32_t> parents;
+    std::vector<glm::mat4> inverse_bind_matrices;
+
+    skeleton() = default;
+    explicit skeleton(std::vector<gltf_model::bone> const & bones);
+
+    std::size_t bone_count() const { return parents.size(); }
+};
+
+// Scratch buffers for evaluation, reused between calls to avoid allocations; one per thread
+struct skeleton_workspace
+{
+    std::vector<float> local;
+    std::vector<glm::mat4> model;
+};
+
+// Writes skinning matrices (model-space bone transform times inverse bind matrix) for every bone
+void compute_bone_matrices(skeleton const & skeleton, pose const & pose, skeleton_workspace & workspace, glm::mat4 * result);
+
+// Evaluates `count` instances of the same rig; result holds count * bone_count matrices, instance after instance
+void compute_bone_matrices(skeleton const & skeleton, pose const * poses, std::size_t count, skeleton_workspace & workspace, glm::mat4 * result);
+
+// Same as above, with instances spread across the pool
+void compute_bone_matrices(skeleton const & skeleton, pose const * poses, std::size_t count, thread_pool & pool, glm::mat4 * result);
@@ -0,0 +1,81 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+thread_pool::thread_pool(std::size_t thread_count)
+{
+    for (std::size_t i = 1; i < thread_count; ++i)
+        workers.emplace_back([this]{ worker_loop(); });
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+
+    for (auto & worker : workers)
+        worker.join();
+}
+
+void thread_pool::run(std::size_t count, std::size_t chunk_size, task_function function, void * context)
+{
+    if (count == 0)
+        return;
+
+    if (workers.empty() || count <= chunk_size)
+    {
+        for (std::size_t begin = 0; begin < count; begin += chunk_size)
+            function(context, begin, std::min(begin + chunk_size, count));
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        task = function;
+        task_context = context;
+        task_count = count;
+        task_chunk_size = std::max<std::size_t>(1, chunk_size);
+        next = 0;
+        busy = workers.size();
+        ++generation;
+    }
+    wake.notify_all();
+
+    work();
+
+    std::unique_lock lock(mutex);
+    done.wait(lock, [this]{ return busy == 0; });
+}
+
+void thread_pool::work()
+{
+    for (std::size_t begin; (begin = next.fetch_add(task_chunk_size)) < task_count;)
+        task(task_context, begin, std::min(begin + task_chunk_size, task_count));
+}
+
+void thread_pool::worker_loop()
+{
+    std::size_t seen_generation = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [&]{ return stop || generation != seen_generation; });
+            if (stop)
+                return;
+            seen_generation = generation;
+        }
+
+        work();
+
+        {
+            std::lock_guard lock(mutex);
+            if (--busy == 0)
+                done.notify_one();
+        }
+    }
+}
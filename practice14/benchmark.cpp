@@ -0,0 +1,718 @@
+// Measures the culling code on synthetic scenes, without creating a window
+
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <cmath>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+#include <glm/geometric.hpp>
+
+#include "aabb.hpp"
+#include "frustum.hpp"
+#include "intersect.hpp"
+#include "culling.hpp"
+#include "bvh.hpp"
+#include "temporal_culling.hpp"
+#include "occlusion.hpp"
+#include "parallel_culling.hpp"
+#include "raycast.hpp"
+#include "obb.hpp"
+#include "broadphase.hpp"
+#include "gltf_loader.hpp"
+#include "thread_pool.hpp"
+
+template <typename F>
+double measure_ms(int repetitions, F && f)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < repetitions; ++i)
+        f();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count() / repetitions;
+}
+
+// `count` boxes of size 0.5..2 scattered uniformly in a 400 x 50 x 400 block around the origin
+aabb_set random_boxes(std::size_t count)
+{
+    std::default_random_engine rng;
+    std::uniform_real_distribution<float> position(-200.f, 200.f);
+    std::uniform_real_distribution<float> height(-25.f, 25.f);
+    std::uniform_real_distribution<float> size(0.5f, 2.f);
+
+    aabb_set boxes;
+    boxes.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 const min{position(rng), height(rng), position(rng)};
+        boxes.push_back(min, min + glm::vec3(size(rng), size(rng), size(rng)));
+    }
+    return boxes;
+}
+
+glm::mat4 camera_matrix(float rotation, float fov = glm::pi<float>() / 2.f)
+{
+    glm::mat4 view = glm::rotate(glm::mat4(1.f), rotation, {0.f, 1.f, 0.f});
+    glm::mat4 projection = glm::perspective(fov, 16.f / 9.f, 0.1f, 100.f);
+    return projection * view;
+}
+
+frustum camera_frustum(float rotation, float fov = glm::pi<float>() / 2.f)
+{
+    return frustum(camera_matrix(rotation, fov));
+}
+
+void benchmark_frustum_culling(std::size_t count)
+{
+    auto const boxes = random_boxes(count);
+    frustum const frustum = camera_frustum(0.3f);
+    std::vector<std::uint32_t> visible(boxes.size());
+
+    std::size_t planes_visible = 0;
+    std::size_t exact_visible = 0;
+    double const planes_ms = measure_ms(20, [&]{ planes_visible = cull(frustum, boxes, visible.data()); });
+    double const exact_ms = measure_ms(20, [&]{ exact_visible = cull(frustum, boxes, visible.data(), true); });
+
+    // The one-object-at-a-time separating axis test over all boxes, as the reference
+    std::vector<std::uint32_t> reference;
+    double const sat_ms = measure_ms(1, [&]{
+        reference.clear();
+        for (std::size_t i = 0; i < boxes.size(); ++i)
+            if (intersect(frustum, boxes.body(i)))
+                reference.push_back(i);
+    });
+
+    // The planes and the separating axis test see the frustum through differently rounded matrices,
+    // so boxes touching its boundary may go either way
+    std::vector<std::uint32_t> differences;
+    std::set_symmetric_difference(visible.begin(), visible.begin() + exact_visible, reference.begin(), reference.end(), std::back_inserter(differences));
+
+    std::cout << "frustum culling, " << count << " boxes:" << std::endl;
+    std::cout << "    planes: " << planes_ms << " ms, " << planes_visible << " visible" << std::endl;
+    std::cout << "    planes + exact: " << exact_ms << " ms, " << exact_visible << " visible" << std::endl;
+    std::cout << "    separating axis per box: " << sat_ms << " ms, " << reference.size() << " visible, "
+        << differences.size() << " boxes classified differently" << std::endl;
+}
+
+void benchmark_bvh(std::size_t count, thread_pool & pool)
+{
+    auto boxes = random_boxes(count);
+    std::vector<std::uint32_t> visible(boxes.size());
+    std::vector<std::uint32_t> reference(boxes.size());
+
+    bvh hierarchy;
+    double const build_ms = measure_ms(3, [&]{ hierarchy.build(boxes, pool); });
+
+    std::cout << "bvh, " << count << " boxes:" << std::endl;
+    std::cout << "    build: " << build_ms << " ms on " << pool.size() << " threads, " << hierarchy.nodes.size() << " nodes" << std::endl;
+
+    for (float fov : {glm::pi<float>() / 2.f, glm::pi<float>() / 8.f, glm::pi<float>() / 64.f})
+    {
+        frustum const frustum = camera_frustum(0.3f, fov);
+
+        std::size_t linear_visible = 0;
+        std::size_t bvh_visible = 0;
+        double const linear_ms = measure_ms(20, [&]{ linear_visible = cull(frustum, boxes, reference.data()); });
+        double const bvh_ms = measure_ms(20, [&]{ bvh_visible = cull(frustum, hierarchy, boxes, visible.data()); });
+
+        std::sort(visible.begin(), visible.begin() + bvh_visible);
+        bool const same = bvh_visible == linear_visible && std::equal(visible.begin(), visible.begin() + bvh_visible, reference.begin());
+
+        std::cout << "    fov " << glm::degrees(fov) << ": " << linear_visible << " visible, linear " << linear_ms << " ms, bvh " << bvh_ms << " ms, "
+            << (same ? "same result" : "DIFFERENT RESULT") << std::endl;
+    }
+
+    // Move every box a little, as animated objects would between frames
+    std::default_random_engine rng;
+    std::uniform_real_distribution<float> offset(-0.1f, 0.1f);
+    for (std::size_t i = 0; i < boxes.size(); ++i)
+    {
+        float const dx = offset(rng);
+        float const dz = offset(rng);
+        boxes.min_x[i] += dx;
+        boxes.max_x[i] += dx;
+        boxes.min_z[i] += dz;
+        boxes.max_z[i] += dz;
+    }
+
+    double const refit_ms = measure_ms(3, [&]{ hierarchy.refit(boxes); });
+
+    frustum const frustum = camera_frustum(0.3f);
+    std::size_t const linear_visible = cull(frustum, boxes, reference.data());
+    std::size_t const bvh_visible = cull(frustum, hierarchy, boxes, visible.data());
+    std::sort(visible.begin(), visible.begin() + bvh_visible);
+    bool const same = bvh_visible == linear_visible && std::equal(visible.begin(), visible.begin() + bvh_visible, reference.begin());
+
+    std::cout << "    refit: " << refit_ms << " ms, " << (same ? "same result" : "DIFFERENT RESULT") << " after moving all boxes" << std::endl;
+}
+
+// A camera flying forward at 3 units per second and turning at `turn_rate` radians per second, at 60 frames per second
+void benchmark_temporal_culling(std::size_t count, float turn_rate, thread_pool & pool)
+{
+    // Boxes in the leaf order of a hierarchy, as in a scene stored in a spatially coherent order
+    auto const scattered = random_boxes(count);
+    bvh hierarchy;
+    hierarchy.build(scattered, pool);
+
+    aabb_set boxes;
+    boxes.reserve(count);
+    for (std::uint32_t i : hierarchy.primitives)
+        boxes.push_back({scattered.min_x[i], scattered.min_y[i], scattered.min_z[i]}, {scattered.max_x[i], scattered.max_y[i], scattered.max_z[i]});
+
+    std::vector<std::uint32_t> visible(boxes.size());
+    std::vector<std::uint32_t> reference(boxes.size());
+
+    temporal_culler culler;
+    temporal_culler::statistics total;
+
+    int const frames = 300;
+    double linear_ms = 0.0;
+    double temporal_ms = 0.0;
+    std::size_t visible_sum = 0;
+    std::size_t differences = 0;
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        float const t = frame / 60.f;
+        float const rotation = turn_rate * t;
+        glm::vec3 const eye = glm::vec3(std::sin(rotation), 0.f, -std::cos(rotation)) * (3.f * t);
+
+        glm::mat4 view = glm::rotate(glm::mat4(1.f), rotation, {0.f, 1.f, 0.f});
+        view = glm::translate(view, -eye);
+        glm::mat4 projection = glm::perspective(glm::pi<float>() / 2.f, 16.f / 9.f, 0.1f, 100.f);
+        frustum const frustum(projection * view);
+
+        std::size_t linear_visible = 0;
+        std::size_t temporal_visible = 0;
+        linear_ms += measure_ms(1, [&]{ linear_visible = cull(frustum, boxes, reference.data()); });
+        temporal_ms += measure_ms(1, [&]{ temporal_visible = culler.cull(frustum, eye, boxes, visible.data()); });
+
+        std::vector<std::uint32_t> difference;
+        std::set_symmetric_difference(visible.begin(), visible.begin() + temporal_visible, reference.begin(), reference.begin() + linear_visible,
+            std::back_inserter(difference));
+        differences += difference.size();
+        visible_sum += temporal_visible;
+
+        // The first frame tests everything
+        if (frame > 0)
+        {
+            auto const & stats = culler.last_statistics();
+            total.skipped += stats.skipped;
+            total.cached_plane += stats.cached_plane;
+            total.full_tests += stats.full_tests;
+        }
+    }
+
+    double const tested = double(count) * (frames - 1) / 100.0;
+    std::cout << "temporal culling, " << count << " boxes, turning at " << turn_rate << " rad/s, " << visible_sum / frames << " visible:" << std::endl;
+    std::cout << "    linear: " << linear_ms / frames << " ms per frame" << std::endl;
+    std::cout << "    temporal: " << temporal_ms / frames << " ms per frame, " << total.skipped / tested << "% skipped, "
+        << total.cached_plane / tested << "% rejected by the cached plane, " << total.full_tests / tested << "% fully tested, "
+        << differences << " boxes classified differently" << std::endl;
+}
+
+// The test of occlusion_buffer::visible against every pixel of the depth buffer instead of the pyramid
+bool visible_per_pixel(occlusion_buffer const & buffer, glm::mat4 const & view_projection, glm::vec3 const & min, glm::vec3 const & max)
+{
+    glm::vec3 screen_min(std::numeric_limits<float>::infinity());
+    glm::vec3 screen_max(-std::numeric_limits<float>::infinity());
+    for (int k = 0; k < 8; ++k)
+    {
+        glm::vec4 const p = view_projection * glm::vec4((k & 1) ? max.x : min.x, (k & 2) ? max.y : min.y, (k & 4) ? max.z : min.z, 1.f);
+        if (!(p.z >= -p.w))
+            return true;
+        screen_min = glm::min(screen_min, glm::vec3(p) / p.w);
+        screen_max = glm::max(screen_max, glm::vec3(p) / p.w);
+    }
+
+    glm::vec2 const size(buffer.width(), buffer.height());
+    glm::vec2 const pixel_min = (glm::vec2(screen_min) * 0.5f + 0.5f) * size;
+    glm::vec2 const pixel_max = (glm::vec2(screen_max) * 0.5f + 0.5f) * size;
+    if (pixel_max.x < 0.f || pixel_max.y < 0.f || pixel_min.x >= size.x || pixel_min.y >= size.y)
+        return true;
+
+    for (int y = std::max(0, int(std::floor(pixel_min.y))); y <= std::min(buffer.height() - 1, int(std::floor(pixel_max.y))); ++y)
+        for (int x = std::max(0, int(std::floor(pixel_min.x))); x <= std::min(buffer.width() - 1, int(std::floor(pixel_max.x))); ++x)
+            if (buffer.depth()[y * buffer.width() + x] >= screen_min.z)
+                return true;
+    return false;
+}
+
+// A row of tall walls 10 units in front of the camera, with gaps between them, hiding the boxes behind
+void benchmark_occlusion(std::size_t count, thread_pool & pool)
+{
+    auto const boxes = random_boxes(count);
+    glm::mat4 const view_projection = camera_matrix(0.3f);
+    frustum const frustum(view_projection);
+
+    std::vector<std::uint32_t> in_frustum(boxes.size());
+    std::size_t const frustum_visible = cull(frustum, boxes, in_frustum.data());
+
+    // Unit cube with counterclockwise faces seen from outside
+    std::vector<glm::vec3> const cube_vertices = {
+        {-1.f, -1.f, -1.f}, {1.f, -1.f, -1.f}, {-1.f, 1.f, -1.f}, {1.f, 1.f, -1.f},
+        {-1.f, -1.f, 1.f}, {1.f, -1.f, 1.f}, {-1.f, 1.f, 1.f}, {1.f, 1.f, 1.f},
+    };
+    std::vector<std::uint32_t> const cube_indices = {
+        0, 2, 1, 1, 2, 3,
+        4, 5, 6, 5, 7, 6,
+        0, 1, 4, 1, 5, 4,
+        2, 6, 3, 3, 6, 7,
+        0, 4, 2, 2, 4, 6,
+        1, 3, 5, 3, 7, 5,
+    };
+
+    std::vector<glm::mat4> walls;
+    for (float x : {-24.f, -8.f, 8.f, 24.f})
+    {
+        glm::mat4 wall = glm::rotate(glm::mat4(1.f), -0.3f, {0.f, 1.f, 0.f});
+        wall = glm::translate(wall, {x, 0.f, -10.f});
+        walls.push_back(glm::scale(wall, {6.f, 30.f, 0.5f}));
+    }
+
+    occlusion_buffer buffer;
+    occlusion_buffer::timings total;
+    std::vector<std::uint32_t> visible(boxes.size());
+    std::size_t occlusion_visible = 0;
+
+    int const repetitions = 20;
+    double const total_ms = measure_ms(repetitions, [&]{
+        buffer.begin(view_projection);
+        for (auto const & wall : walls)
+            buffer.add_occluder(cube_vertices, cube_indices, wall);
+        buffer.rasterize(pool);
+
+        std::copy(in_frustum.begin(), in_frustum.begin() + frustum_visible, visible.begin());
+        occlusion_visible = buffer.cull(boxes, visible.data(), frustum_visible, pool);
+
+        auto const & times = buffer.last_timings();
+        total.setup_ms += times.setup_ms;
+        total.raster_ms += times.raster_ms;
+        total.pyramid_ms += times.pyramid_ms;
+        total.test_ms += times.test_ms;
+        total.triangles = times.triangles;
+    });
+
+    // The pyramid must never hide a box the full resolution test sees
+    std::size_t pixel_visible = 0;
+    std::size_t wrongly_hidden = 0;
+    for (std::size_t k = 0, j = 0; k < frustum_visible; ++k)
+    {
+        std::uint32_t const i = in_frustum[k];
+        bool const expected = visible_per_pixel(buffer, view_projection, {boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]}, {boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]});
+        bool const kept = j < occlusion_visible && visible[j] == i;
+        pixel_visible += expected;
+        wrongly_hidden += expected && !kept;
+        j += kept;
+    }
+
+    std::cout << "occlusion culling, " << frustum_visible << " of " << count << " boxes in the frustum, " << walls.size() << " walls, "
+        << buffer.width() << "x" << buffer.height() << " on " << pool.size() << " threads:" << std::endl;
+    std::cout << "    total " << total_ms << " ms: setup " << total.setup_ms / repetitions << " ms (" << total.triangles << " triangles), raster "
+        << total.raster_ms / repetitions << " ms, pyramid " << total.pyramid_ms / repetitions << " ms, test " << total.test_ms / repetitions << " ms" << std::endl;
+    std::cout << "    " << occlusion_visible << " visible, " << pixel_visible << " visible per pixel, "
+        << wrongly_hidden << " hidden although visible per pixel" << std::endl;
+}
+
+// Times the generic and the specialized separating axis test on the same pairs of bodies
+template <typename Body1, typename Body2>
+void benchmark_intersection_pair(char const * name, std::vector<Body1> const & first, std::vector<Body2> const & second)
+{
+    std::size_t const count = first.size();
+    std::vector<std::uint8_t> generic(count);
+    std::vector<std::uint8_t> specialized(count);
+
+    double const generic_ms = measure_ms(5, [&]{
+        for (std::size_t i = 0; i < count; ++i)
+            generic[i] = intersect_generic(first[i], second[i]);
+    });
+    double const specialized_ms = measure_ms(5, [&]{
+        for (std::size_t i = 0; i < count; ++i)
+            specialized[i] = intersect(first[i], second[i]);
+    });
+
+    std::size_t const intersecting = std::count(specialized.begin(), specialized.end(), 1);
+    std::size_t differences = 0;
+    for (std::size_t i = 0; i < count; ++i)
+        differences += generic[i] != specialized[i];
+
+    std::cout << "    " << name << ": generic " << generic_ms * 1e6 / count << " ns, specialized " << specialized_ms * 1e6 / count << " ns per pair, "
+        << intersecting << " intersecting, " << differences << " classified differently" << std::endl;
+}
+
+// The separating axis test for every pair of body types, on `count` random pairs each
+void benchmark_intersection(std::size_t count)
+{
+    std::default_random_engine rng;
+    std::uniform_real_distribution<float> angle(0.f, 2.f * glm::pi<float>());
+
+    // Small boxes close together, so that a good share of the pairs intersect
+    std::uniform_real_distribution<float> near_position(-2.f, 2.f);
+    std::uniform_real_distribution<float> near_size(0.5f, 2.f);
+    std::vector<aabb> boxes1;
+    std::vector<aabb> boxes2;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        for (auto * boxes : {&boxes1, &boxes2})
+        {
+            glm::vec3 const min{near_position(rng), near_position(rng), near_position(rng)};
+            boxes->emplace_back(min, min + glm::vec3(near_size(rng), near_size(rng), near_size(rng)));
+        }
+    }
+
+    // Cameras at the origin and boxes around them, some inside, some outside and some crossing the frustum
+    std::uniform_real_distribution<float> far_position(-100.f, 100.f);
+    std::uniform_real_distribution<float> far_size(1.f, 20.f);
+    std::vector<frustum> frustums;
+    std::vector<aabb> boxes;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        frustums.emplace_back(camera_matrix(angle(rng)));
+
+        glm::vec3 const min{far_position(rng), far_position(rng) * 0.25f, far_position(rng)};
+        boxes.emplace_back(min, min + glm::vec3(far_size(rng), far_size(rng), far_size(rng)));
+    }
+
+    // Cameras moved apart, for the fallback
+    std::vector<frustum> moved_frustums;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 const eye{far_position(rng), 0.f, far_position(rng)};
+        moved_frustums.emplace_back(camera_matrix(angle(rng)) * glm::translate(glm::mat4(1.f), -eye));
+    }
+
+    std::cout << "separating axis test, " << count << " pairs of each kind:" << std::endl;
+    benchmark_intersection_pair("aabb / aabb", boxes1, boxes2);
+    benchmark_intersection_pair("frustum / aabb", frustums, boxes);
+    benchmark_intersection_pair("aabb / frustum", boxes, frustums);
+    benchmark_intersection_pair("frustum / frustum (fallback)", frustums, moved_frustums);
+}
+
+// Frustum and distance culling split across pools of increasing size
+void benchmark_parallel_culling(std::size_t count)
+{
+    auto const boxes = random_boxes(count);
+    frustum const frustum = camera_frustum(0.3f);
+    glm::vec3 const eye(0.f);
+    float const max_distance = 60.f;
+
+    std::vector<std::uint32_t> reference(boxes.size());
+    std::size_t const reference_visible = cull(frustum, eye, max_distance, boxes, 0, boxes.size(), reference.data());
+    double const serial_ms = measure_ms(20, [&]{ cull(frustum, eye, max_distance, boxes, 0, boxes.size(), reference.data()); });
+
+    std::cout << "parallel culling, " << count << " boxes, " << reference_visible << " visible within " << max_distance << " units:" << std::endl;
+    std::cout << "    single call: " << serial_ms << " ms, " << count / serial_ms << " boxes per ms" << std::endl;
+
+    std::vector<std::uint32_t> visible(boxes.size());
+    for (std::size_t threads : {1, 2, 4, 8, 16})
+    {
+        thread_pool pool(threads);
+        parallel_culler culler;
+
+        std::size_t visible_count = 0;
+        double const ms = measure_ms(20, [&]{ visible_count = culler.cull(frustum, eye, boxes, visible.data(), pool, max_distance); });
+        bool const same = visible_count == reference_visible && std::equal(visible.begin(), visible.begin() + visible_count, reference.begin());
+
+        std::cout << "    " << threads << " threads: " << ms << " ms, " << count / ms << " boxes per ms, "
+            << (same ? "same result" : "DIFFERENT RESULT") << std::endl;
+    }
+}
+
+// Nearest hit of the ray among all triangles, without any hierarchy, as the reference
+float brute_force_cast(std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices, ray const & r)
+{
+    float nearest = std::numeric_limits<float>::infinity();
+    for (std::size_t i = 0; i < indices.size(); i += 3)
+    {
+        glm::vec3 const v0 = positions[indices[i]];
+        glm::vec3 const e1 = positions[indices[i + 1]] - v0;
+        glm::vec3 const e2 = positions[indices[i + 2]] - v0;
+
+        glm::vec3 const p = glm::cross(r.direction, e2);
+        float const inverse_det = 1.f / glm::dot(e1, p);
+        glm::vec3 const s = r.origin - v0;
+        float const u = glm::dot(s, p) * inverse_det;
+        glm::vec3 const q = glm::cross(s, e1);
+        float const v = glm::dot(r.direction, q) * inverse_det;
+        float const t = glm::dot(e2, q) * inverse_det;
+        if (u >= 0.f && v >= 0.f && u + v <= 1.f && t > 0.f && t < nearest)
+            nearest = t;
+    }
+    return nearest;
+}
+
+// Camera rays through a width x height image, looking from `eye` at `target`
+std::vector<ray> camera_rays(glm::vec3 const & eye, glm::vec3 const & target, int width, int height)
+{
+    glm::mat4 const view_projection = glm::perspective(glm::pi<float>() / 3.f, (1.f * width) / height, 0.1f, 100.f)
+        * glm::lookAt(eye, target, {0.f, 1.f, 0.f});
+    glm::mat4 const inverse = glm::inverse(view_projection);
+
+    std::vector<ray> rays;
+    rays.reserve(width * height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+        {
+            glm::vec4 const ndc{(x + 0.5f) / width * 2.f - 1.f, (y + 0.5f) / height * 2.f - 1.f, 1.f, 1.f};
+            glm::vec4 const far = inverse * ndc;
+            rays.push_back({eye, far.xyz() / far.w - eye});
+        }
+    return rays;
+}
+
+// Rays between random points of the box [min, max], of length 1 in t
+std::vector<ray> random_rays(glm::vec3 const & min, glm::vec3 const & max, std::size_t count)
+{
+    std::default_random_engine rng;
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    auto point = [&]{ return min + (max - min) * glm::vec3(unit(rng), unit(rng), unit(rng)); };
+
+    std::vector<ray> rays;
+    rays.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        glm::vec3 const from = point();
+        rays.push_back({from, point() - from});
+    }
+    return rays;
+}
+
+// Casts the rays one at a time, in packets and in packets across the pool, and checks that all three agree
+void benchmark_ray_set(char const * name, ray_caster const & caster, std::vector<ray> const & rays, thread_pool & pool)
+{
+    std::vector<ray_hit> single(rays.size());
+    std::vector<ray_hit> packets(rays.size());
+    std::vector<ray_hit> parallel(rays.size());
+
+    double const single_ms = measure_ms(3, [&]{
+        for (std::size_t i = 0; i < rays.size(); ++i)
+            single[i] = caster.cast(rays[i]);
+    });
+    double const packets_ms = measure_ms(3, [&]{ caster.cast(rays.data(), rays.size(), packets.data()); });
+    double const parallel_ms = measure_ms(3, [&]{ caster.cast(rays.data(), rays.size(), parallel.data(), pool); });
+
+    std::size_t found = 0;
+    std::size_t differences = 0;
+    for (std::size_t i = 0; i < rays.size(); ++i)
+    {
+        found += single[i].found();
+        differences += single[i].t != packets[i].t || packets[i].t != parallel[i].t;
+    }
+
+    std::size_t blocked = 0;
+    double const occluded_ms = measure_ms(3, [&]{
+        blocked = 0;
+        for (auto const & r : rays)
+            blocked += caster.occluded(r, 1.f);
+    });
+
+    std::size_t blocked_differences = 0;
+    for (std::size_t i = 0; i < rays.size(); ++i)
+        blocked_differences += caster.occluded(rays[i], 1.f) != (single[i].t < 1.f);
+
+    auto rate = [&](double ms){ return rays.size() / ms / 1000.0; };
+    std::cout << "    " << name << ", " << rays.size() << " rays, " << found << " hits: single " << rate(single_ms) << ", packets "
+        << rate(packets_ms) << ", packets on " << pool.size() << " threads " << rate(parallel_ms) << " Mrays/s, "
+        << (differences == 0 ? "same hits" : "DIFFERENT HITS") << std::endl;
+    std::cout << "        line of sight: " << rate(occluded_ms) << " Mrays/s, " << blocked << " blocked, "
+        << (blocked_differences == 0 ? "agrees with the nearest hits" : "DISAGREES WITH THE NEAREST HITS") << std::endl;
+}
+
+void benchmark_raycast(thread_pool & pool)
+{
+    auto const model = load_gltf(std::string(PROJECT_ROOT) + "/bunny/bunny.gltf");
+    auto const & mesh = model.meshes[0];
+    auto const positions = mesh_positions(model, mesh);
+    auto const indices = mesh_indices(model, mesh);
+
+    ray_caster bunny;
+    double const build_ms = measure_ms(1, [&]{ bunny.add_mesh(positions, indices, pool); });
+    bunny.set_instances({0}, {glm::mat4(1.f)}, pool);
+
+    glm::vec3 const center = 0.5f * (mesh.min + mesh.max);
+    float const size = glm::length(mesh.max - mesh.min);
+
+    std::cout << "ray casting, " << indices.size() / 3 << " triangles:" << std::endl;
+    std::cout << "    triangle hierarchy build: " << build_ms << " ms" << std::endl;
+
+    // The hierarchy against testing every triangle, on a few incoherent rays through the mesh
+    auto const checked = random_rays(mesh.min - 0.5f * size, mesh.max + 0.5f * size, 1000);
+    std::size_t wrong = 0;
+    for (auto const & r : checked)
+    {
+        float const reference = brute_force_cast(positions, indices, r);
+        float const t = bunny.cast(r).t;
+        wrong += !(t == reference || std::abs(t - reference) <= 1e-5f * reference);
+    }
+    std::cout << "    " << checked.size() << " rays checked against all triangles, " << wrong << " wrong" << std::endl;
+
+    benchmark_ray_set("camera rays", bunny, camera_rays(center + glm::vec3(0.f, 0.f, size), center, 512, 512), pool);
+    benchmark_ray_set("random rays", bunny, random_rays(mesh.min - 0.5f * size, mesh.max + 0.5f * size, 1 << 18), pool);
+
+    // The field of bunnies of the demo, through the two levels of the hierarchy
+    ray_caster field;
+    field.add_mesh(positions, indices, pool);
+    std::vector<std::uint32_t> meshes;
+    std::vector<glm::mat4> transforms;
+    for (int x = 0; x < 32; ++x)
+        for (int z = 0; z < 32; ++z)
+        {
+            meshes.push_back(0);
+            transforms.push_back(glm::translate(glm::mat4(1.f), {-24.f + 1.5f * x, 0.f, -4.f - 1.5f * z}));
+        }
+    field.set_instances(meshes, transforms, pool);
+
+    std::cout << "  " << field.instance_count() << " instances:" << std::endl;
+    benchmark_ray_set("camera rays", field, camera_rays({0.f, 1.5f, 3.f}, {0.f, 0.f, -20.f}, 512, 512), pool);
+    benchmark_ray_set("random rays", field, random_rays({-24.f, 0.f, -52.f}, {24.f, 2.f, -4.f}, 1 << 18), pool);
+}
+
+// Oriented boxes drifting and bouncing around a cube for a number of frames, paired by sweep and prune
+// along one and three axes and by testing all pairs of their bounds
+void benchmark_broadphase(std::size_t count, int frames)
+{
+    // About one box per 8 units of volume, so that each box overlaps a few others
+    float const side = std::cbrt(8.f * count);
+
+    std::default_random_engine rng;
+    std::uniform_real_distribution<float> position(0.f, side);
+    std::uniform_real_distribution<float> speed(-0.05f, 0.05f);
+    std::uniform_real_distribution<float> size(0.25f, 1.f);
+    std::uniform_real_distribution<float> angle(0.f, 2.f * glm::pi<float>());
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+    std::vector<glm::vec3> centers;
+    std::vector<glm::vec3> velocities;
+    std::vector<glm::mat4> orientations;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        centers.push_back({position(rng), position(rng), position(rng)});
+        velocities.push_back({speed(rng), speed(rng), speed(rng)});
+
+        glm::vec3 const axis = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.f, 0.f, 1e-3f));
+        orientations.push_back(glm::scale(glm::rotate(glm::mat4(1.f), angle(rng), axis), {size(rng), size(rng), size(rng)}));
+    }
+
+    std::vector<obb> bodies;
+    std::vector<aabb> boxes;
+    auto place = [&]
+    {
+        bodies.clear();
+        boxes.clear();
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            bodies.emplace_back(glm::translate(glm::mat4(1.f), centers[i]) * orientations[i]);
+            boxes.emplace_back(bodies.back().min, bodies.back().max);
+        }
+    };
+
+    auto all_pairs = [&]
+    {
+        std::vector<sweep_and_prune::pair> pairs;
+        for (std::uint32_t a = 0; a < count; ++a)
+            for (std::uint32_t b = a + 1; b < count; ++b)
+                if (intersect(boxes[a], boxes[b]))
+                    pairs.push_back({a, b});
+        return pairs;
+    };
+
+    auto same_pairs = [](std::vector<sweep_and_prune::pair> pairs, std::vector<sweep_and_prune::pair> reference)
+    {
+        std::sort(pairs.begin(), pairs.end());
+        std::sort(reference.begin(), reference.end());
+        return pairs == reference;
+    };
+
+    place();
+
+    sweep_and_prune one_axis(1);
+    sweep_and_prune three_axes(3);
+    double const one_build_ms = measure_ms(1, [&]{
+        for (auto const & box : boxes)
+            one_axis.add(box);
+        one_axis.update();
+    });
+    double const three_build_ms = measure_ms(1, [&]{
+        for (auto const & box : boxes)
+            three_axes.add(box);
+        three_axes.update();
+    });
+
+    std::vector<sweep_and_prune::pair> reference;
+    double const all_pairs_ms = measure_ms(1, [&]{ reference = all_pairs(); });
+    bool same = same_pairs(one_axis.pairs(), reference) && same_pairs(three_axes.pairs(), reference);
+
+    double one_ms = 0.0;
+    double three_ms = 0.0;
+    double narrow_ms = 0.0;
+    std::size_t one_swaps = 0;
+    std::size_t three_swaps = 0;
+    std::size_t pairs = 0;
+    std::size_t touching = 0;
+    std::vector<sweep_and_prune::pair> narrow;
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            centers[i] += velocities[i];
+            for (int axis = 0; axis < 3; ++axis)
+                if (centers[i][axis] < 0.f || centers[i][axis] > side)
+                    velocities[i][axis] = -velocities[i][axis];
+        }
+        place();
+
+        one_ms += measure_ms(1, [&]{
+            for (std::size_t i = 0; i < count; ++i)
+                one_axis.move(i, boxes[i]);
+            one_swaps += one_axis.update();
+        });
+        three_ms += measure_ms(1, [&]{
+            for (std::size_t i = 0; i < count; ++i)
+                three_axes.move(i, boxes[i]);
+            three_swaps += three_axes.update();
+        });
+        narrow_ms += measure_ms(1, [&]{ narrow_phase(three_axes.pairs(), bodies, narrow); });
+
+        pairs += three_axes.pairs().size();
+        touching += narrow.size();
+    }
+
+    reference = all_pairs();
+    same = same && same_pairs(one_axis.pairs(), reference) && same_pairs(three_axes.pairs(), reference);
+
+    std::cout << "broadphase, " << count << " moving boxes, " << pairs / frames << " overlapping bounds and "
+        << touching / frames << " intersecting oriented boxes per frame:" << std::endl;
+    std::cout << "    all pairs: " << all_pairs_ms << " ms" << std::endl;
+    std::cout << "    one axis: build " << one_build_ms << " ms, update " << one_ms / frames << " ms, "
+        << one_swaps / frames << " swaps per frame" << std::endl;
+    std::cout << "    three axes: build " << three_build_ms << " ms, update " << three_ms / frames << " ms, "
+        << three_swaps / frames << " swaps per frame" << std::endl;
+    std::cout << "    narrow phase: " << narrow_ms / frames << " ms per frame; "
+        << (same ? "same pairs as all pairs" : "DIFFERENT PAIRS") << " on the first and last frame" << std::endl;
+}
+
+int main()
+{
+    thread_pool pool;
+
+    benchmark_intersection(1 << 16);
+    benchmark_frustum_culling(1 << 20);
+    benchmark_bvh(1 << 20, pool);
+    benchmark_temporal_culling(1 << 20, 0.f, pool);
+    benchmark_temporal_culling(1 << 20, 0.1f, pool);
+    benchmark_temporal_culling(1 << 20, 0.5f, pool);
+    benchmark_occlusion(1 << 20, pool);
+    benchmark_parallel_culling(1 << 22);
+    benchmark_raycast(pool);
+    benchmark_broadphase(1024, 100);
+    benchmark_broadphase(4096, 100);
+    benchmark_broadphase(16384, 100);
+}
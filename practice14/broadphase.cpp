@@ -0,0 +1,268 @@
+#include "broadphase.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+	std::uint64_t pair_key(std::uint32_t a, std::uint32_t b)
+	{
+		if (a > b)
+			std::swap(a, b);
+		return (static_cast<std::uint64_t>(a) << 32) | b;
+	}
+
+	// Endpoints by value, minima before maxima of equal value, so that touching boxes overlap as in intersect()
+	template <typename Endpoint>
+	bool precedes(Endpoint const & a, Endpoint const & b)
+	{
+		return a.value < b.value || (a.value == b.value && !(a.id & 1) && (b.id & 1));
+	}
+
+}
+
+sweep_and_prune::sweep_and_prune(int axes)
+	: axes(axes)
+{}
+
+std::uint32_t sweep_and_prune::add(aabb const & box)
+{
+	std::uint32_t object;
+	if (!free_objects.empty())
+	{
+		object = free_objects.back();
+		free_objects.pop_back();
+		mins[object] = box.vertices[0];
+		maxs[object] = box.vertices[7];
+	}
+	else
+	{
+		object = mins.size();
+		mins.push_back(box.vertices[0]);
+		maxs.push_back(box.vertices[7]);
+	}
+
+	++added;
+
+	// New entries start at the end, past everything, where they overlap nothing; the next update sorts them into place
+	if (axes == 1)
+		order.push_back(object);
+	else
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			endpoints[axis].push_back({mins[object][axis], 2 * object});
+			endpoints[axis].push_back({maxs[object][axis], 2 * object + 1});
+		}
+	}
+
+	return object;
+}
+
+void sweep_and_prune::remove(std::uint32_t object)
+{
+	if (axes == 1)
+		order.erase(std::find(order.begin(), order.end(), object));
+	else
+	{
+		for (auto & list : endpoints)
+			std::erase_if(list, [object](endpoint const & e){ return (e.id >> 1) == object; });
+
+		for (auto it = pair_set.begin(); it != pair_set.end();)
+		{
+			if ((*it >> 32) == object || static_cast<std::uint32_t>(*it) == object)
+				it = pair_set.erase(it);
+			else
+				++it;
+		}
+	}
+
+	free_objects.push_back(object);
+}
+
+void sweep_and_prune::move(std::uint32_t object, aabb const & box)
+{
+	mins[object] = box.vertices[0];
+	maxs[object] = box.vertices[7];
+}
+
+std::size_t sweep_and_prune::update()
+{
+	std::size_t const swaps = (axes == 1) ? update_one_axis() : update_three_axes();
+	added = 0;
+	return swaps;
+}
+
+bool sweep_and_prune::overlap(std::uint32_t a, std::uint32_t b) const
+{
+	return mins[a].x <= maxs[b].x && mins[b].x <= maxs[a].x
+		&& mins[a].y <= maxs[b].y && mins[b].y <= maxs[a].y
+		&& mins[a].z <= maxs[b].z && mins[b].z <= maxs[a].z;
+}
+
+std::size_t sweep_and_prune::update_one_axis()
+{
+	overlapping.clear();
+	if (order.empty())
+		return 0;
+
+	// The axis along which box centers vary the most, changed only when another one clearly wins, as
+	// changing it sorts from scratch
+	glm::vec3 sum(0.f);
+	glm::vec3 sum_squares(0.f);
+	for (std::uint32_t object : order)
+	{
+		glm::vec3 const c = mins[object] + maxs[object];
+		sum += c;
+		sum_squares += c * c;
+	}
+	glm::vec3 const mean = sum / float(order.size());
+	glm::vec3 const variance = sum_squares / float(order.size()) - mean * mean;
+
+	int widest = 0;
+	for (int axis = 1; axis < 3; ++axis)
+		if (variance[axis] > variance[widest])
+			widest = axis;
+
+	int const axis = sweep_axis;
+	std::size_t swaps = 0;
+	if (variance[widest] > 1.5f * variance[axis] || 4 * added > order.size())
+	{
+		if (variance[widest] > 1.5f * variance[axis])
+			sweep_axis = widest;
+		std::sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b){ return mins[a][sweep_axis] < mins[b][sweep_axis]; });
+	}
+	else
+	{
+		for (std::size_t i = 1; i < order.size(); ++i)
+		{
+			std::uint32_t const object = order[i];
+			float const value = mins[object][axis];
+
+			std::size_t j = i;
+			for (; j > 0 && mins[order[j - 1]][axis] > value; --j)
+				order[j] = order[j - 1];
+			order[j] = object;
+			swaps += i - j;
+		}
+	}
+
+	sorted_mins.resize(order.size());
+	sorted_maxs.resize(order.size());
+	for (std::size_t k = 0; k < order.size(); ++k)
+	{
+		sorted_mins[k] = mins[order[k]];
+		sorted_maxs[k] = maxs[order[k]];
+	}
+
+	int const other1 = (sweep_axis + 1) % 3;
+	int const other2 = (sweep_axis + 2) % 3;
+	for (std::size_t k = 0; k < order.size(); ++k)
+	{
+		glm::vec3 const min = sorted_mins[k];
+		glm::vec3 const max = sorted_maxs[k];
+		for (std::size_t m = k + 1; m < order.size() && sorted_mins[m][sweep_axis] <= max[sweep_axis]; ++m)
+		{
+			if (sorted_mins[m][other1] <= max[other1] && min[other1] <= sorted_maxs[m][other1]
+				&& sorted_mins[m][other2] <= max[other2] && min[other2] <= sorted_maxs[m][other2])
+			{
+				std::uint32_t const a = order[k];
+				std::uint32_t const b = order[m];
+				overlapping.push_back({std::min(a, b), std::max(a, b)});
+			}
+		}
+	}
+
+	return swaps;
+}
+
+std::size_t sweep_and_prune::update_three_axes()
+{
+	// Each added object would cross most endpoints on its way from the end of the lists
+	if (4 * added > endpoints[0].size() / 2)
+	{
+		rebuild_three_axes();
+		return 0;
+	}
+
+	std::size_t swaps = 0;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		auto & list = endpoints[axis];
+		for (auto & e : list)
+			e.value = (e.id & 1) ? maxs[e.id >> 1][axis] : mins[e.id >> 1][axis];
+
+		// Every pair of endpoints out of order is swapped exactly once, so a minimum passing a maximum
+		// means that two boxes now overlap along the axis, and a maximum passing a minimum that they no
+		// longer do. Pairs are added once they overlap along all axes, whether or not the other axes are
+		// sorted yet, since the boxes are final.
+		for (std::size_t i = 1; i < list.size(); ++i)
+		{
+			endpoint const e = list[i];
+			std::uint32_t const a = e.id >> 1;
+
+			std::size_t j = i;
+			for (; j > 0 && precedes(e, list[j - 1]); --j)
+			{
+				endpoint const & other = list[j - 1];
+				std::uint32_t const b = other.id >> 1;
+
+				if (a != b)
+				{
+					bool const e_max = e.id & 1;
+					bool const other_max = other.id & 1;
+					if (!e_max && other_max)
+					{
+						if (overlap(a, b))
+							pair_set.insert(pair_key(a, b));
+					}
+					else if (e_max && !other_max)
+						pair_set.erase(pair_key(a, b));
+				}
+
+				list[j] = other;
+			}
+			list[j] = e;
+			swaps += i - j;
+		}
+	}
+
+	overlapping.clear();
+	for (std::uint64_t key : pair_set)
+		overlapping.push_back({static_cast<std::uint32_t>(key >> 32), static_cast<std::uint32_t>(key)});
+
+	return swaps;
+}
+
+void sweep_and_prune::rebuild_three_axes()
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		auto & list = endpoints[axis];
+		for (auto & e : list)
+			e.value = (e.id & 1) ? maxs[e.id >> 1][axis] : mins[e.id >> 1][axis];
+		std::sort(list.begin(), list.end(), precedes<endpoint>);
+	}
+
+	// A sweep along the first axis, keeping the objects whose interval is open
+	pair_set.clear();
+	std::vector<std::uint32_t> open;
+	for (auto const & e : endpoints[0])
+	{
+		std::uint32_t const a = e.id >> 1;
+		if (e.id & 1)
+		{
+			open.erase(std::find(open.begin(), open.end(), a));
+			continue;
+		}
+
+		for (std::uint32_t b : open)
+			if (overlap(a, b))
+				pair_set.insert(pair_key(a, b));
+		open.push_back(a);
+	}
+
+	overlapping.clear();
+	for (std::uint64_t key : pair_set)
+		overlapping.push_back({static_cast<std::uint32_t>(key >> 32), static_cast<std::uint32_t>(key)});
+}
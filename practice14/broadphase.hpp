@@ -0,0 +1,90 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+#include <unordered_set>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+#include "aabb.hpp"
+#include "intersect.hpp"
+
+// Sweep and prune broadphase over moving boxes. Sorted orders are kept between updates and repaired with
+// insertion sort, which costs close to O(n) when objects move a little per frame.
+//
+// With one axis, objects are sorted by their minimum along the axis where they are spread the most, and
+// each update sweeps that order, pairing every object with those starting before it ends. With three
+// axes, the minima and maxima of all objects are sorted along every axis, and pairs are only added or
+// removed when the sort swaps a minimum and a maximum, so the cost follows the changes instead of the
+// number of pairs. When many objects were added since the last update, it sorts from scratch instead.
+class sweep_and_prune
+{
+public:
+	using pair = std::pair<std::uint32_t, std::uint32_t>;
+
+	explicit sweep_and_prune(int axes = 3);
+
+	// Adds a box and returns the object's index; indices of removed objects are reused
+	std::uint32_t add(aabb const & box);
+	void remove(std::uint32_t object);
+
+	// Sets the box of an object; the pairs change at the next update
+	void move(std::uint32_t object, aabb const & box);
+
+	// Re-sorts after objects were added, moved or removed and updates the pairs; returns the number of swaps
+	std::size_t update();
+
+	// Overlapping objects as of the last update, the smaller index first, in no particular order
+	std::vector<pair> const & pairs() const { return overlapping; }
+
+private:
+	struct endpoint
+	{
+		float value;
+
+		// 2 * object + 1 for a maximum, 2 * object for a minimum
+		std::uint32_t id;
+	};
+
+	bool overlap(std::uint32_t a, std::uint32_t b) const;
+
+	std::size_t update_one_axis();
+	std::size_t update_three_axes();
+	void rebuild_three_axes();
+
+	int axes;
+
+	std::vector<glm::vec3> mins;
+	std::vector<glm::vec3> maxs;
+	std::vector<std::uint32_t> free_objects;
+
+	// Objects added since the last update
+	std::size_t added = 0;
+
+	// One axis: objects by their minimum along sweep_axis, and their boxes copied in that order for the sweep
+	int sweep_axis = 0;
+	std::vector<std::uint32_t> order;
+	std::vector<glm::vec3> sorted_mins;
+	std::vector<glm::vec3> sorted_maxs;
+
+	// Three axes: sorted endpoints per axis, and the overlapping pairs as (a << 32) | b
+	std::vector<endpoint> endpoints[3];
+	std::unordered_set<std::uint64_t> pair_set;
+
+	std::vector<pair> overlapping;
+};
+
+// Narrow phase over broadphase pairs: writes the pairs whose bodies pass the separating axis test of
+// intersect.hpp to `result`; bodies[i] is the body of object i, which its broadphase box must bound
+template <typename Body>
+void narrow_phase(std::vector<sweep_and_prune::pair> const & pairs, std::vector<Body> const & bodies, std::vector<sweep_and_prune::pair> & result)
+{
+	result.clear();
+	for (auto const & p : pairs)
+	{
+		if (intersect(bodies[p.first], bodies[p.second]))
+			result.push_back(p);
+	}
+}
@@ -0,0 +1,432 @@
+#include "bvh.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+namespace
+{
+
+	constexpr float inf = std::numeric_limits<float>::infinity();
+
+	struct bounds
+	{
+		glm::vec3 min{inf};
+		glm::vec3 max{-inf};
+
+		void extend(glm::vec3 const & p)
+		{
+			min = glm::min(min, p);
+			max = glm::max(max, p);
+		}
+
+		void extend(glm::vec3 const & box_min, glm::vec3 const & box_max)
+		{
+			min = glm::min(min, box_min);
+			max = glm::max(max, box_max);
+		}
+
+		void extend(bounds const & b)
+		{
+			extend(b.min, b.max);
+		}
+
+		// Half of the surface area, which is all the heuristic needs; 0 for empty bounds
+		float area() const
+		{
+			glm::vec3 const d = glm::max(max - min, glm::vec3(0.f));
+			return d.x * d.y + d.y * d.z + d.z * d.x;
+		}
+	};
+
+	struct bin
+	{
+		bounds boxes;
+		std::uint32_t count = 0;
+	};
+
+	using bin_grid = std::array<std::array<bin, bvh::bin_count>, 3>;
+
+	// A box with its index, moved around as a whole while partitioning so that binning reads memory in order
+	struct reference
+	{
+		glm::vec3 min;
+		std::uint32_t index;
+		glm::vec3 max;
+
+		glm::vec3 centroid() const { return 0.5f * (min + max); }
+	};
+
+	struct split
+	{
+		int axis = -1;
+		std::size_t last_left_bin = 0;
+		float cost = inf;
+		bin left;
+		bin right;
+	};
+
+	// Subdivides nodes whose bounds, primitive range and centroid bounds are already set
+	struct builder
+	{
+		std::vector<reference> references;
+		thread_pool & pool;
+
+		// Nodes up to this size are left for the parallel subtree phase
+		std::size_t task_size;
+
+		// A node to subdivide, at level `depth` of the tree
+		struct task
+		{
+			std::uint32_t node;
+			bounds centroids;
+			std::size_t depth;
+		};
+
+		std::vector<task> tasks;
+
+		// Index of the bin of centroid coordinate c along an axis
+		static std::size_t bin_index(float c, float min, float scale)
+		{
+			return std::min<std::size_t>(static_cast<std::size_t>((c - min) * scale), bvh::bin_count - 1);
+		}
+
+		void bin_range(std::size_t begin, std::size_t end, bounds const & centroid_bounds, glm::vec3 const & scale, bin_grid & grid) const
+		{
+			for (std::size_t k = begin; k < end; ++k)
+			{
+				auto const & r = references[k];
+				glm::vec3 const c = r.centroid();
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					auto & b = grid[axis][bin_index(c[axis], centroid_bounds.min[axis], scale[axis])];
+					b.boxes.extend(r.min, r.max);
+					++b.count;
+				}
+			}
+		}
+
+		split find_split(bvh::node const & node, bounds const & centroid_bounds, bool parallel)
+		{
+			glm::vec3 const extent = centroid_bounds.max - centroid_bounds.min;
+			glm::vec3 scale;
+			for (int axis = 0; axis < 3; ++axis)
+				scale[axis] = extent[axis] > 0.f ? bvh::bin_count / extent[axis] : 0.f;
+
+			bin_grid grid;
+			if (parallel)
+			{
+				std::size_t const chunk_size = 16384;
+				std::vector<bin_grid> partial((node.count + chunk_size - 1) / chunk_size);
+				pool.parallel_for(node.count, chunk_size, [&](std::size_t begin, std::size_t end)
+				{
+					bin_range(node.first + begin, node.first + end, centroid_bounds, scale, partial[begin / chunk_size]);
+				});
+				for (auto const & p : partial)
+					for (int axis = 0; axis < 3; ++axis)
+						for (std::size_t b = 0; b < bvh::bin_count; ++b)
+						{
+							grid[axis][b].boxes.extend(p[axis][b].boxes);
+							grid[axis][b].count += p[axis][b].count;
+						}
+			}
+			else
+				bin_range(node.first, node.first + node.count, centroid_bounds, scale, grid);
+
+			split best;
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				if (extent[axis] <= 0.f)
+					continue;
+
+				auto const & bins = grid[axis];
+
+				// Sizes and costs of bins b + 1 .. bin_count - 1, the right side of a split after bin b
+				std::array<std::uint32_t, bvh::bin_count> right_count;
+				std::array<float, bvh::bin_count> right_cost;
+				bin right;
+				for (std::size_t b = bvh::bin_count - 1; b > 0; --b)
+				{
+					right.boxes.extend(bins[b].boxes);
+					right.count += bins[b].count;
+					right_count[b - 1] = right.count;
+					right_cost[b - 1] = right.boxes.area() * right.count;
+				}
+
+				bin left;
+				for (std::size_t b = 0; b + 1 < bvh::bin_count; ++b)
+				{
+					left.boxes.extend(bins[b].boxes);
+					left.count += bins[b].count;
+
+					if (left.count == 0 || right_count[b] == 0)
+						continue;
+
+					float const cost = left.boxes.area() * left.count + right_cost[b];
+					if (cost < best.cost)
+					{
+						best.axis = axis;
+						best.last_left_bin = b;
+						best.cost = cost;
+					}
+				}
+			}
+
+			if (best.axis >= 0)
+			{
+				auto const & bins = grid[best.axis];
+				for (std::size_t b = 0; b < bvh::bin_count; ++b)
+				{
+					bin & side = (b <= best.last_left_bin) ? best.left : best.right;
+					side.boxes.extend(bins[b].boxes);
+					side.count += bins[b].count;
+				}
+			}
+
+			return best;
+		}
+
+		// Splits the node and its descendants, keeping a stack of nodes to split so that the node order is
+		// that of a depth-first recursion: the left subtree right after its parent, then the right one
+		void subdivide(std::vector<bvh::node> & nodes, task const & root, bool top)
+		{
+			std::vector<task> stack{root};
+			while (!stack.empty())
+			{
+				task const current = stack.back();
+				stack.pop_back();
+
+				std::uint32_t const index = current.node;
+				bounds const & centroid_bounds = current.centroids;
+
+				bvh::node const node = nodes[index];
+				if (node.count <= bvh::max_leaf_size || current.depth == bvh::max_depth)
+					continue;
+
+				if (top && node.count <= task_size)
+				{
+					tasks.push_back(current);
+					continue;
+				}
+
+				split const best = find_split(node, centroid_bounds, top);
+
+				auto const begin = references.begin() + node.first;
+				auto const end = begin + node.count;
+
+				bin left = best.left;
+				bin right = best.right;
+				if (best.axis >= 0)
+				{
+					float const min = centroid_bounds.min[best.axis];
+					float const scale = bvh::bin_count / (centroid_bounds.max[best.axis] - centroid_bounds.min[best.axis]);
+					std::partition(begin, end, [&](reference const & r)
+					{
+						return bin_index(r.centroid()[best.axis], min, scale) <= best.last_left_bin;
+					});
+				}
+				else
+				{
+					// All centroids coincide, so any split is as good as another
+					left = right = bin{};
+					left.count = node.count / 2;
+					right.count = node.count - left.count;
+					for (auto it = begin; it != end; ++it)
+					{
+						bin & half = (std::uint32_t(it - begin) < left.count) ? left : right;
+						half.boxes.extend(it->min, it->max);
+					}
+				}
+
+				// Bins only keep box bounds, the centroid bounds of the children take one more pass
+				bounds left_centroids;
+				bounds right_centroids;
+				for (auto it = begin; it != end; ++it)
+					(std::uint32_t(it - begin) < left.count ? left_centroids : right_centroids).extend(it->centroid());
+
+				std::uint32_t const children = nodes.size();
+				nodes[index].children = children;
+				nodes.push_back({left.boxes.min, node.first, left.boxes.max, left.count, 0});
+				nodes.push_back({right.boxes.min, node.first + left.count, right.boxes.max, right.count, 0});
+
+				stack.push_back({children + 1, right_centroids, current.depth + 1});
+				stack.push_back({children, left_centroids, current.depth + 1});
+			}
+		}
+	};
+
+}
+
+void bvh::build(aabb_set const & boxes, thread_pool & pool)
+{
+	nodes.clear();
+	primitives.resize(boxes.size());
+	if (boxes.size() == 0)
+		return;
+
+	builder b{std::vector<reference>(boxes.size()), pool, std::max<std::size_t>(boxes.size() / (8 * pool.size()), 4096), {}};
+
+	std::size_t const chunk_size = 16384;
+	std::vector<bounds> chunk_boxes((boxes.size() + chunk_size - 1) / chunk_size);
+	std::vector<bounds> chunk_centroids(chunk_boxes.size());
+	pool.parallel_for(boxes.size(), chunk_size, [&](std::size_t begin, std::size_t end)
+	{
+		auto & box_bounds = chunk_boxes[begin / chunk_size];
+		auto & centroid_bounds = chunk_centroids[begin / chunk_size];
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			auto & r = b.references[i];
+			r = {{boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]}, static_cast<std::uint32_t>(i), {boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]}};
+			box_bounds.extend(r.min, r.max);
+			centroid_bounds.extend(r.centroid());
+		}
+	});
+
+	bounds root;
+	bounds root_centroids;
+	for (std::size_t c = 0; c < chunk_boxes.size(); ++c)
+	{
+		root.extend(chunk_boxes[c]);
+		root_centroids.extend(chunk_centroids[c]);
+	}
+
+	nodes.push_back({root.min, 0, root.max, static_cast<std::uint32_t>(boxes.size()), 0});
+	b.subdivide(nodes, {0, root_centroids, 1}, true);
+
+	// Subtrees are built into separate arrays and appended after the top of the tree, which keeps
+	// every child after its parent
+	std::vector<std::vector<node>> subtrees(b.tasks.size());
+	pool.parallel_for(b.tasks.size(), 1, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t t = begin; t < end; ++t)
+		{
+			subtrees[t].push_back(nodes[b.tasks[t].node]);
+			b.subdivide(subtrees[t], {0, b.tasks[t].centroids, b.tasks[t].depth}, false);
+		}
+	});
+
+	for (std::size_t t = 0; t < subtrees.size(); ++t)
+	{
+		std::uint32_t const base = nodes.size() - 1;
+		auto relocate = [base](node n)
+		{
+			if (!n.leaf())
+				n.children += base;
+			return n;
+		};
+
+		nodes[b.tasks[t].node] = relocate(subtrees[t][0]);
+		for (std::size_t i = 1; i < subtrees[t].size(); ++i)
+			nodes.push_back(relocate(subtrees[t][i]));
+	}
+
+	for (std::size_t i = 0; i < primitives.size(); ++i)
+		primitives[i] = b.references[i].index;
+}
+
+void bvh::refit(aabb_set const & boxes)
+{
+	for (std::size_t i = nodes.size(); i --> 0;)
+	{
+		bounds b;
+		node & n = nodes[i];
+		if (n.leaf())
+		{
+			for (std::uint32_t k = n.first; k < n.first + n.count; ++k)
+			{
+				std::uint32_t const j = primitives[k];
+				b.extend({boxes.min_x[j], boxes.min_y[j], boxes.min_z[j]}, {boxes.max_x[j], boxes.max_y[j], boxes.max_z[j]});
+			}
+		}
+		else
+		{
+			b.extend(nodes[n.children].min, nodes[n.children].max);
+			b.extend(nodes[n.children + 1].min, nodes[n.children + 1].max);
+		}
+		n.min = b.min;
+		n.max = b.max;
+	}
+}
+
+std::size_t cull(frustum const & frustum, bvh const & hierarchy, aabb_set const & boxes, std::uint32_t * visible)
+{
+	if (hierarchy.nodes.empty())
+		return 0;
+
+	// Coordinates of the p-vertex come from the max corner where the plane normal is positive
+	std::array<glm::bvec3, 6> positive;
+	for (std::size_t j = 0; j < 6; ++j)
+		positive[j] = glm::greaterThanEqual(glm::vec3(frustum.planes[j]), glm::vec3(0.f));
+
+	auto distance = [&](std::size_t j, glm::vec3 const & p)
+	{
+		glm::vec4 const & plane = frustum.planes[j];
+		return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w;
+	};
+
+	struct entry
+	{
+		std::uint32_t node;
+		unsigned planes;
+	};
+
+	// Every level pushes two children in place of their parent, so the stack never holds more than one entry per level
+	std::array<entry, bvh::max_depth> stack;
+	std::size_t size = 0;
+	stack[size++] = {0, (1u << 6) - 1};
+
+	std::size_t count = 0;
+	while (size > 0)
+	{
+		auto [index, planes] = stack[--size];
+
+		auto const & node = hierarchy.nodes[index];
+
+		bool outside = false;
+		for (std::size_t j = 0; j < 6 && !outside; ++j)
+		{
+			if (!(planes & (1u << j)))
+				continue;
+
+			outside = distance(j, glm::mix(node.min, node.max, positive[j])) < 0.f;
+			if (distance(j, glm::mix(node.max, node.min, positive[j])) >= 0.f)
+				planes &= ~(1u << j);
+		}
+
+		if (outside)
+			continue;
+
+		if (planes == 0)
+		{
+			auto const first = hierarchy.primitives.begin() + node.first;
+			count = std::copy(first, first + node.count, visible + count) - visible;
+		}
+		else if (node.leaf())
+		{
+			for (std::uint32_t k = node.first; k < node.first + node.count; ++k)
+			{
+				std::uint32_t const i = hierarchy.primitives[k];
+				glm::vec3 const min{boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]};
+				glm::vec3 const max{boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]};
+
+				bool inside = true;
+				for (std::size_t j = 0; j < 6 && inside; ++j)
+					if (planes & (1u << j))
+						inside = distance(j, glm::mix(min, max, positive[j])) >= 0.f;
+
+				if (inside)
+					visible[count++] = i;
+			}
+		}
+		else
+		{
+			stack[size++] = {node.children + 1, planes};
+			stack[size++] = {node.children, planes};
+		}
+	}
+
+	return count;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "culling.hpp"
+#include "thread_pool.hpp"
+
+// Bounding volume hierarchy over the boxes of an aabb_set, built with the binned surface area heuristic.
+// Nodes are stored parents first with the two children of a node next to each other, and the boxes of
+// every subtree form a contiguous range of `primitives`, so a subtree found fully inside the frustum is
+// emitted without visiting it.
+struct bvh
+{
+	static constexpr std::size_t bin_count = 16;
+	static constexpr std::size_t max_leaf_size = 4;
+
+	// Nodes at this level become leaves whatever their size, which bounds the traversal stacks
+	static constexpr std::size_t max_depth = 64;
+
+	struct node
+	{
+		glm::vec3 min;
+		std::uint32_t first;
+		glm::vec3 max;
+		std::uint32_t count;
+
+		// Index of the left child, the right one follows it; 0 for leaves, as the root is nobody's child
+		std::uint32_t children;
+
+		bool leaf() const { return children == 0; }
+	};
+
+	std::vector<node> nodes;
+
+	// Box indices in subtree order: node n covers primitives[n.first .. n.first + n.count)
+	std::vector<std::uint32_t> primitives;
+
+	// Rebuilds the hierarchy from scratch. Large nodes near the root are binned in parallel, and the
+	// subtrees below them are built in parallel
+	void build(aabb_set const & boxes, thread_pool & pool);
+
+	// Recomputes node bounds after boxes have moved, keeping the tree structure; the set must
+	// hold the same boxes in the same order as at build()
+	void refit(aabb_set const & boxes);
+};
+
+// Writes the indices of boxes that intersect the frustum to `visible`, which must have room for
+// boxes.size() entries, and returns their count. Boxes are tested as in cull(frustum, aabb_set, ...),
+// but the traversal only tests a node against the planes its parent was crossing and emits subtrees that
+// are inside all of them at once, so its cost depends on the visible part of the scene. The indices come
+// in subtree order rather than increasing.
+std::size_t cull(frustum const & frustum, bvh const & hierarchy, aabb_set const & boxes, std::uint32_t * visible);
@@ -0,0 +1,191 @@
+#include "culling.hpp"
+#include "intersect.hpp"
+#include "simd.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <bit>
+
+void aabb_set::clear()
+{
+	for (auto * v : {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z})
+		v->clear();
+}
+
+void aabb_set::reserve(std::size_t count)
+{
+	for (auto * v : {&min_x, &min_y, &min_z, &max_x, &max_y, &max_z})
+		v->reserve(count);
+}
+
+void aabb_set::push_back(glm::vec3 const & min, glm::vec3 const & max)
+{
+	min_x.push_back(min.x);
+	min_y.push_back(min.y);
+	min_z.push_back(min.z);
+	max_x.push_back(max.x);
+	max_y.push_back(max.y);
+	max_z.push_back(max.z);
+}
+
+aabb aabb_set::body(std::size_t i) const
+{
+	return aabb({min_x[i], min_y[i], min_z[i]}, {max_x[i], max_y[i], max_z[i]});
+}
+
+void transform_bounds(glm::mat4 const & transform, glm::vec3 const & min, glm::vec3 const & max, glm::vec3 & result_min, glm::vec3 & result_max)
+{
+	// Each column contributes its smaller product to the min and its larger one to the max
+	result_min = result_max = glm::vec3(transform[3]);
+	for (int i = 0; i < 3; ++i)
+	{
+		glm::vec3 const a = glm::vec3(transform[i]) * min[i];
+		glm::vec3 const b = glm::vec3(transform[i]) * max[i];
+		result_min += glm::min(a, b);
+		result_max += glm::max(a, b);
+	}
+}
+
+namespace
+{
+
+	// For every plane, the arrays holding the coordinates of the box corner farthest along its normal
+	// (p-vertex) and of the nearest one (n-vertex)
+	struct plane_corners
+	{
+		simd::floatv n[3];
+		simd::floatv d;
+		float const * p[3];
+		float const * q[3];
+	};
+
+	// Boxes farther than `max_distance` from `eye` are culled when Distance is set
+	struct distance_limit
+	{
+		glm::vec3 eye;
+		float max_distance;
+	};
+
+	template <bool Exact, bool Distance>
+	std::size_t cull_boxes(frustum const & frustum, aabb_set const & boxes, std::size_t begin, std::size_t end, std::uint32_t * visible, distance_limit const & limit = {})
+	{
+		plane_corners corners[6];
+		for (std::size_t j = 0; j < 6; ++j)
+		{
+			glm::vec4 const & plane = frustum.planes[j];
+			float const * min[3] = {boxes.min_x.data(), boxes.min_y.data(), boxes.min_z.data()};
+			float const * max[3] = {boxes.max_x.data(), boxes.max_y.data(), boxes.max_z.data()};
+			for (int k = 0; k < 3; ++k)
+			{
+				corners[j].n[k] = simd::splat(plane[k]);
+				corners[j].p[k] = plane[k] >= 0.f ? max[k] : min[k];
+				corners[j].q[k] = plane[k] >= 0.f ? min[k] : max[k];
+			}
+			corners[j].d = simd::splat(plane.w);
+		}
+
+		simd::floatv const zero = simd::splat(0.f);
+		simd::floatv const eye[3] = {simd::splat(limit.eye.x), simd::splat(limit.eye.y), simd::splat(limit.eye.z)};
+		simd::floatv const max_distance_squared = simd::splat(limit.max_distance * limit.max_distance);
+
+		std::size_t count = 0;
+		auto emit = [&](std::size_t base, std::size_t lanes, unsigned inside, unsigned crossing)
+		{
+			// Most batches are either fully culled or fully visible in no particular order, which makes a
+			// loop over the set bits mispredict often: write every lane and advance past the visible ones
+			if (!Exact || !(inside & crossing))
+			{
+				for (std::size_t lane = 0; lane < lanes; ++lane)
+				{
+					visible[count] = base + lane;
+					count += (inside >> lane) & 1u;
+				}
+				return;
+			}
+
+			while (inside)
+			{
+				int const lane = std::countr_zero(inside);
+				std::size_t const i = base + lane;
+				if (!Exact || !((crossing >> lane) & 1u) || intersect(frustum, boxes.body(i)))
+					visible[count++] = i;
+				inside &= inside - 1;
+			}
+		};
+
+		std::size_t i = begin;
+		for (; i + simd::width <= end; i += simd::width)
+		{
+			// All lanes set, and all lanes clear
+			simd::maskv inside = zero >= zero;
+			simd::maskv crossing_one = zero < zero;
+			simd::maskv crossing = crossing_one;
+			for (auto const & c : corners)
+			{
+				simd::floatv const p = c.n[0] * simd::load(c.p[0] + i) + c.n[1] * simd::load(c.p[1] + i) + c.n[2] * simd::load(c.p[2] + i) + c.d;
+				inside = inside & (p >= zero);
+				if constexpr (Exact)
+				{
+					simd::floatv const q = c.n[0] * simd::load(c.q[0] + i) + c.n[1] * simd::load(c.q[1] + i) + c.n[2] * simd::load(c.q[2] + i) + c.d;
+					simd::maskv const outside = q < zero;
+					crossing = crossing | (crossing_one & outside);
+					crossing_one = crossing_one | outside;
+				}
+			}
+			if constexpr (Distance)
+			{
+				// Squared distance from the eye to the nearest point of the box
+				simd::floatv distance_squared = zero;
+				float const * mins[3] = {boxes.min_x.data(), boxes.min_y.data(), boxes.min_z.data()};
+				float const * maxs[3] = {boxes.max_x.data(), boxes.max_y.data(), boxes.max_z.data()};
+				for (int k = 0; k < 3; ++k)
+				{
+					simd::floatv const d = simd::max(simd::max(simd::load(mins[k] + i) - eye[k], eye[k] - simd::load(maxs[k] + i)), zero);
+					distance_squared = distance_squared + d * d;
+				}
+				inside = inside & (max_distance_squared >= distance_squared);
+			}
+			emit(i, simd::width, simd::movemask(inside), Exact ? simd::movemask(crossing) : 0u);
+		}
+
+		for (; i < end; ++i)
+		{
+			unsigned inside = 1;
+			unsigned crossing_one = 0;
+			unsigned crossing = 0;
+			for (std::size_t j = 0; j < 6; ++j)
+			{
+				glm::vec4 const & plane = frustum.planes[j];
+				auto const & c = corners[j];
+				inside &= plane.x * c.p[0][i] + plane.y * c.p[1][i] + plane.z * c.p[2][i] + plane.w >= 0.f;
+				if constexpr (Exact)
+				{
+					unsigned const outside = plane.x * c.q[0][i] + plane.y * c.q[1][i] + plane.z * c.q[2][i] + plane.w < 0.f;
+					crossing |= crossing_one & outside;
+					crossing_one |= outside;
+				}
+			}
+			if constexpr (Distance)
+			{
+				glm::vec3 const nearest = glm::clamp(limit.eye, glm::vec3(boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]), glm::vec3(boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]));
+				glm::vec3 const d = nearest - limit.eye;
+				inside &= limit.max_distance * limit.max_distance >= glm::dot(d, d);
+			}
+			emit(i, 1, inside, crossing);
+		}
+
+		return count;
+	}
+
+}
+
+std::size_t cull(frustum const & frustum, aabb_set const & boxes, std::uint32_t * visible, bool exact)
+{
+	return exact ? cull_boxes<true, false>(frustum, boxes, 0, boxes.size(), visible) : cull_boxes<false, false>(frustum, boxes, 0, boxes.size(), visible);
+}
+
+std::size_t cull(frustum const & frustum, glm::vec3 const & eye, float max_distance, aabb_set const & boxes, std::size_t begin, std::size_t end, std::uint32_t * visible)
+{
+	return cull_boxes<false, true>(frustum, boxes, begin, end, visible, {eye, max_distance});
+}
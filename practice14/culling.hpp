@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "aabb.hpp"
+#include "frustum.hpp"
+
+// Axis-aligned boxes stored as separate min/max coordinate arrays, so that the culling kernel
+// tests simd::width boxes per instruction without gathering
+struct aabb_set
+{
+	std::vector<float> min_x, min_y, min_z;
+	std::vector<float> max_x, max_y, max_z;
+
+	std::size_t size() const { return min_x.size(); }
+
+	void clear();
+	void reserve(std::size_t count);
+	void push_back(glm::vec3 const & min, glm::vec3 const & max);
+
+	// Box i as a body for the exact separating axis test
+	aabb body(std::size_t i) const;
+};
+
+// Bounds of the box [min, max] transformed by `transform`
+void transform_bounds(glm::mat4 const & transform, glm::vec3 const & min, glm::vec3 const & max, glm::vec3 & result_min, glm::vec3 & result_max);
+
+// Writes the indices of boxes that intersect the frustum, in increasing order, to `visible`, which must
+// have room for boxes.size() entries, and returns their count. Each box is tested against the frustum
+// planes with its p-vertex, which is conservative: a box near an edge or a corner of the frustum may be
+// kept although it lies outside. With `exact`, boxes whose n-vertex is outside of two or more planes
+// are confirmed with the separating axis test of intersect.hpp; a box that crosses a single plane and
+// is inside all the others always intersects the frustum.
+std::size_t cull(frustum const & frustum, aabb_set const & boxes, std::uint32_t * visible, bool exact = false);
+
+// Culls boxes[begin .. end) as cull(frustum, boxes, visible) does, also dropping boxes whose nearest point
+// is farther than `max_distance` from `eye`; `visible` must have room for end - begin entries
+std::size_t cull(frustum const & frustum, glm::vec3 const & eye, float max_distance, aabb_set const & boxes, std::size_t begin, std::size_t end, std::uint32_t * visible);
@@ -1,6 +1,7 @@
 #include "frustum.hpp"
 
 #include <glm/geometric.hpp>
+#include <glm/common.hpp>
 
 frustum::frustum(glm::mat4 const & view_projection)
 {
@@ -18,6 +19,13 @@ frustum::frustum(glm::mat4 const & view_projection)
 		vertices[i] = v.xyz();
 	}
 
+	bounds_min = bounds_max = vertices[0];
+	for (auto const & v : vertices)
+	{
+		bounds_min = glm::min(bounds_min, v);
+		bounds_max = glm::max(bounds_max, v);
+	}
+
 	auto n = [&](std::size_t i0, std::size_t i1, std::size_t i2) -> glm::vec3
 	{
 		return glm::cross(vertices[i1] - vertices[i0], vertices[i2] - vertices[i0]);
@@ -44,4 +52,15 @@ frustum::frustum(glm::mat4 const & view_projection)
 		e(2, 6),
 		e(3, 7),
 	};
+
+	// Clip space -w <= x, y, z <= w expressed with the rows of the view-projection matrix
+	glm::mat4 const t = glm::transpose(view_projection);
+	planes = {
+		t[3] + t[0],
+		t[3] - t[0],
+		t[3] + t[1],
+		t[3] - t[1],
+		t[3] + t[2],
+		t[3] - t[2],
+	};
 }
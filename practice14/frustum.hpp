@@ -1,6 +1,7 @@
 #pragma once
 
 #include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
 #include <glm/mat4x4.hpp>
 
 #include <array>
@@ -11,5 +12,12 @@ struct frustum
 	std::array<glm::vec3, 5> face_normals;
 	std::array<glm::vec3, 6> edge_directions;
 
+	// Bounding box of the vertices, i.e. their projections onto the coordinate axes
+	glm::vec3 bounds_min;
+	glm::vec3 bounds_max;
+
+	// Left, right, bottom, top, near and far planes as (n, d) with n.p + d >= 0 inside; not normalized
+	std::array<glm::vec4, 6> planes;
+
 	frustum(glm::mat4 const & view_projection);
 };
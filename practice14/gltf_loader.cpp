@@ -5,6 +5,10 @@
 
 #include <fstream>
 #include <stdexcept>
+#include <cstring>
+#include <cstdint>
+
+#include <glm/gtx/matrix_decompose.hpp>
 
 static unsigned int attribute_type_to_size(std::string const & type)
 {
@@ -120,5 +124,152 @@ gltf_model load_gltf(std::filesystem::path const & path)
             result_mesh.material.color = parse_color(pbr["baseColorFactor"].GetArray());
     }
 
+    // Reads a float or normalized integer accessor of up to four components; missing components come from `fallback`
+    auto read_accessor = [&](int index, glm::vec4 fallback)
+    {
+        auto accessor = document["accessors"].GetArray()[index].GetObject();
+        auto view = document["bufferViews"].GetArray()[accessor["bufferView"].GetInt()].GetObject();
+
+        unsigned int const type = accessor["componentType"].GetUint();
+        unsigned int const size = attribute_type_to_size(accessor["type"].GetString());
+        unsigned int const component_size = (type == 5126) ? 4 : (type == 5122 || type == 5123) ? 2 : 1;
+
+        std::size_t offset = (view.HasMember("byteOffset") ? view["byteOffset"].GetUint() : 0)
+            + (accessor.HasMember("byteOffset") ? accessor["byteOffset"].GetUint() : 0);
+        std::size_t const stride = view.HasMember("byteStride") ? view["byteStride"].GetUint() : size * component_size;
+
+        auto component = [&](char const * data) -> float
+        {
+            switch (type)
+            {
+            case 5126: { float v; std::memcpy(&v, data, 4); return v; }
+            case 5120: return std::max(-1.f, *reinterpret_cast<std::int8_t const *>(data) / 127.f);
+            case 5121: return *reinterpret_cast<std::uint8_t const *>(data) / 255.f;
+            case 5122: { std::int16_t v; std::memcpy(&v, data, 2); return std::max(-1.f, v / 32767.f); }
+            case 5123: { std::uint16_t v; std::memcpy(&v, data, 2); return v / 65535.f; }
+            }
+            throw std::runtime_error("Unsupported accessor component type: " + std::to_string(type));
+        };
+
+        std::vector<glm::vec4> values(accessor["count"].GetUint(), fallback);
+        for (auto & value : values)
+        {
+            if (offset + size * component_size > result.buffer.size())
+                throw std::runtime_error("Accessor is out of buffer bounds");
+            for (unsigned int c = 0; c < size; ++c)
+                value[c] = component(result.buffer.data() + offset + c * component_size);
+            offset += stride;
+        }
+        return values;
+    };
+
+    auto const & nodes = document["nodes"];
+
+    auto add_node = [&](auto const & self, unsigned int index, unsigned int parent) -> void
+    {
+        auto const & node = nodes[index];
+
+        auto & result_node = result.nodes.emplace_back();
+        result_node.parent = parent;
+        if (node.HasMember("name"))
+            result_node.name = node["name"].GetString();
+        if (node.HasMember("mesh"))
+            result_node.mesh = node["mesh"].GetUint();
+
+        if (node.HasMember("matrix"))
+        {
+            auto const & array = node["matrix"];
+            glm::mat4 matrix;
+            for (int i = 0; i < 16; ++i)
+                matrix[i / 4][i % 4] = array[i].GetFloat();
+
+            glm::vec3 skew;
+            glm::vec4 perspective;
+            glm::decompose(matrix, result_node.scale, result_node.rotation, result_node.translation, skew, perspective);
+        }
+
+        if (node.HasMember("translation"))
+            result_node.translation = parse_vector(node["translation"]);
+        if (node.HasMember("rotation"))
+        {
+            auto const & array = node["rotation"];
+            result_node.rotation = glm::quat(array[3].GetFloat(), array[0].GetFloat(), array[1].GetFloat(), array[2].GetFloat());
+        }
+        if (node.HasMember("scale"))
+            result_node.scale = parse_vector(node["scale"]);
+
+        if (node.HasMember("extensions") && node["extensions"].HasMember("EXT_mesh_gpu_instancing"))
+        {
+            auto const & attributes = node["extensions"]["EXT_mesh_gpu_instancing"]["attributes"];
+
+            auto read = [&](char const * name, glm::vec4 fallback)
+            {
+                std::vector<glm::vec4> values;
+                if (attributes.HasMember(name))
+                    values = read_accessor(attributes[name].GetInt(), fallback);
+                return values;
+            };
+
+            auto const translations = read("TRANSLATION", glm::vec4(0.f));
+            auto const rotations = read("ROTATION", glm::vec4(0.f, 0.f, 0.f, 1.f));
+            auto const scales = read("SCALE", glm::vec4(1.f));
+
+            std::size_t const count = std::max({translations.size(), rotations.size(), scales.size()});
+            if ((!translations.empty() && translations.size() != count) || (!rotations.empty() && rotations.size() != count)
+                || (!scales.empty() && scales.size() != count))
+                throw std::runtime_error("EXT_mesh_gpu_instancing attributes have different counts");
+
+            result_node.instances.resize(count, glm::mat4(1.f));
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                auto & instance = result_node.instances[i];
+                if (!rotations.empty())
+                    instance = glm::toMat4(glm::quat(rotations[i].w, rotations[i].x, rotations[i].y, rotations[i].z));
+                if (!scales.empty())
+                    for (int c = 0; c < 3; ++c)
+                        instance[c] *= scales[i][c];
+                if (!translations.empty())
+                    instance[3] = glm::vec4(glm::vec3(translations[i]), 1.f);
+            }
+        }
+
+        unsigned int const result_index = result.nodes.size() - 1;
+        if (node.HasMember("children"))
+            for (auto const & child : node["children"].GetArray())
+                self(self, child.GetUint(), result_index);
+    };
+
+    unsigned int const scene = document.HasMember("scene") ? document["scene"].GetUint() : 0;
+    for (auto const & root : document["scenes"][scene]["nodes"].GetArray())
+        add_node(add_node, root.GetUint(), gltf_model::node::no_parent);
+
+    return result;
+}
+
+std::vector<glm::vec3> mesh_positions(gltf_model const & model, gltf_model::mesh const & mesh)
+{
+    std::vector<glm::vec3> result(mesh.position.count);
+    std::memcpy(result.data(), model.buffer.data() + mesh.position.view.offset, result.size() * sizeof(glm::vec3));
+    return result;
+}
+
+std::vector<std::uint32_t> mesh_indices(gltf_model const & model, gltf_model::mesh const & mesh)
+{
+    char const * data = model.buffer.data() + mesh.indices.view.offset;
+
+    std::vector<std::uint32_t> result(mesh.indices.count);
+    for (std::size_t i = 0; i < result.size(); ++i)
+    {
+        if (mesh.indices.type == 5125)
+            std::memcpy(&result[i], data + 4 * i, 4);
+        else if (mesh.indices.type == 5123)
+        {
+            std::uint16_t index;
+            std::memcpy(&index, data + 2 * i, 2);
+            result[i] = index;
+        }
+        else
+            result[i] = static_cast<unsigned char>(data[i]);
+    }
     return result;
 }
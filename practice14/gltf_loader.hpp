@@ -6,6 +6,7 @@
 #include <optional>
 #include <unordered_map>
 #include <algorithm>
+#include <cstdint>
 
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
@@ -51,8 +52,32 @@ struct gltf_model
         glm::vec3 max;
     };
 
+    // Nodes of the default scene in depth-first order: parents precede their children,
+    // and the descendants of a node immediately follow it
+    struct node
+    {
+        static constexpr unsigned int no_parent = -1;
+
+        std::string name;
+        unsigned int parent = no_parent;
+
+        glm::vec3 translation{0.f};
+        glm::quat rotation{1.f, 0.f, 0.f, 0.f};
+        glm::vec3 scale{1.f};
+
+        std::optional<unsigned int> mesh;
+
+        // EXT_mesh_gpu_instancing: the mesh is drawn once per transform, relative to the node
+        std::vector<glm::mat4> instances;
+    };
+
     std::vector<char> buffer;
     std::vector<mesh> meshes;
+    std::vector<node> nodes;
 };
 
 gltf_model load_gltf(std::filesystem::path const & path);
+
+// Vertex positions and triangle indices of a mesh, copied out of the model's buffer
+std::vector<glm::vec3> mesh_positions(gltf_model const & model, gltf_model::mesh const & mesh);
+std::vector<std::uint32_t> mesh_indices(gltf_model const & model, gltf_model::mesh const & mesh);
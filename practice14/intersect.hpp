@@ -2,11 +2,16 @@
 
 #include <glm/vec3.hpp>
 #include <glm/geometric.hpp>
+#include <glm/common.hpp>
 
 #include <limits>
 #include <utility>
+#include <algorithm>
 #include <cmath>
 
+#include "aabb.hpp"
+#include "frustum.hpp"
+
 template <typename Body>
 std::pair<float, float> project(Body const & b, glm::vec3 const & n)
 {
@@ -34,8 +39,10 @@ bool intersect_along(Body1 const & b1, Body2 const & b2, glm::vec3 const & n)
 	return (min1 <= max2) && (min2 <= max1);
 }
 
+// The separating axis test along all face normals and all cross products of edge directions; the
+// fallback for pairs of bodies without a specialized path
 template <typename Body1, typename Body2>
-bool intersect(Body1 const & b1, Body2 const & b2)
+bool intersect_generic(Body1 const & b1, Body2 const & b2)
 {
 	for (auto const & n : b1.face_normals)
 	{
@@ -61,3 +68,151 @@ bool intersect(Body1 const & b1, Body2 const & b2)
 
 	return true;
 }
+
+// Bodies whose face normals and edge directions are the coordinate axes
+template <typename Body>
+inline constexpr bool is_axis_aligned = false;
+
+template <>
+inline constexpr bool is_axis_aligned<aabb> = true;
+
+// Projections of the body onto the coordinate axes, as its bounding box
+template <typename Body>
+std::pair<glm::vec3, glm::vec3> axis_bounds(Body const & b)
+{
+	glm::vec3 min = b.vertices[0];
+	glm::vec3 max = b.vertices[0];
+
+	for (auto const & p : b.vertices)
+	{
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	return {min, max};
+}
+
+inline std::pair<glm::vec3, glm::vec3> axis_bounds(aabb const & b)
+{
+	return {b.vertices[0], b.vertices[7]};
+}
+
+inline std::pair<glm::vec3, glm::vec3> axis_bounds(frustum const & f)
+{
+	return {f.bounds_min, f.bounds_max};
+}
+
+// The dot product of vectors whose component K is known to be zero in n
+template <int K>
+float dot_across(glm::vec3 const & p, glm::vec3 const & n)
+{
+	if constexpr (K == 0)
+		return p.y * n.y + p.z * n.z;
+	else if constexpr (K == 1)
+		return p.x * n.x + p.z * n.z;
+	else
+		return p.x * n.x + p.y * n.y;
+}
+
+// cross(e, axis K), with the zero component left out of the arithmetic
+template <int K>
+glm::vec3 cross_axis(glm::vec3 const & e)
+{
+	if constexpr (K == 0)
+		return {0.f, e.z, -e.y};
+	else if constexpr (K == 1)
+		return {-e.z, 0.f, e.x};
+	else
+		return {e.y, -e.x, 0.f};
+}
+
+// Projection of the box [min, max] onto n, from the two vertices extreme along n
+template <int K = -1>
+std::pair<float, float> project_box(glm::vec3 const & min, glm::vec3 const & max, glm::vec3 const & n)
+{
+	glm::vec3 const low{n.x >= 0.f ? min.x : max.x, n.y >= 0.f ? min.y : max.y, n.z >= 0.f ? min.z : max.z};
+	glm::vec3 const high{n.x >= 0.f ? max.x : min.x, n.y >= 0.f ? max.y : min.y, n.z >= 0.f ? max.z : min.z};
+
+	if constexpr (K < 0)
+		return {glm::dot(low, n), glm::dot(high, n)};
+	else
+		return {dot_across<K>(low, n), dot_across<K>(high, n)};
+}
+
+// The separating axes cross(e, axis K) for the body's edge directions e; edges parallel to the axis
+// give zero-length axes that can never separate and are skipped
+template <int K, typename Body>
+bool intersect_across(glm::vec3 const & min, glm::vec3 const & max, Body const & b)
+{
+	static constexpr float inf = std::numeric_limits<float>::infinity();
+
+	for (auto const & e : b.edge_directions)
+	{
+		glm::vec3 const n = cross_axis<K>(e);
+		if (n == glm::vec3(0.f))
+			continue;
+
+		auto [box_min, box_max] = project_box<K>(min, max, n);
+
+		float body_min = inf;
+		float body_max = -inf;
+		for (auto const & p : b.vertices)
+		{
+			float v = dot_across<K>(p, n);
+			body_min = std::min(body_min, v);
+			body_max = std::max(body_max, v);
+		}
+
+		if (box_max < body_min || body_max < box_min)
+			return false;
+	}
+
+	return true;
+}
+
+// The separating axis test of an axis-aligned box against any body. The box's face normals are the
+// coordinate axes, along which both bodies project to their bounds, and two such boxes need no other
+// axes. Against other bodies the box is projected from two of its vertices, and the cross products with
+// its edges are collapsed to the two components that can be non-zero.
+template <typename Box, typename Body>
+bool intersect_box(Box const & box, Body const & b)
+{
+	auto [min, max] = axis_bounds(box);
+	auto [body_min, body_max] = axis_bounds(b);
+
+	for (int k = 0; k < 3; ++k)
+	{
+		if (max[k] < body_min[k] || body_max[k] < min[k])
+			return false;
+	}
+
+	if constexpr (is_axis_aligned<Body>)
+		return true;
+	else
+	{
+		for (auto const & n : b.face_normals)
+		{
+			auto [box_min, box_max] = project_box(min, max, n);
+			auto [face_min, face_max] = project(b, n);
+
+			if (box_max < face_min || face_max < box_min)
+				return false;
+		}
+
+		return intersect_across<0>(min, max, b)
+			&& intersect_across<1>(min, max, b)
+			&& intersect_across<2>(min, max, b);
+	}
+}
+
+// The separating axis test, specialized at compile time for the pairs of bodies that allow it
+template <typename Body1, typename Body2>
+bool intersect(Body1 const & b1, Body2 const & b2)
+{
+	if constexpr (is_axis_aligned<Body1>)
+		return intersect_box(b1, b2);
+	else if constexpr (is_axis_aligned<Body2>)
+		return intersect_box(b2, b1);
+	else
+		return intersect_generic(b1, b2);
+}
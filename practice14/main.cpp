@@ -16,6 +16,8 @@
 #include <random>
 #include <map>
 #include <cmath>
+#include <limits>
+#include <optional>
 
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
@@ -28,8 +30,16 @@
 #include "gltf_loader.hpp"
 #include "stb_image.h"
 #include "aabb.hpp"
+#include "scene.hpp"
 #include "frustum.hpp"
 #include "intersect.hpp"
+#include "culling.hpp"
+#include "bvh.hpp"
+#include "temporal_culling.hpp"
+#include "occlusion.hpp"
+#include "occlusion_queries.hpp"
+#include "raycast.hpp"
+#include "thread_pool.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -49,13 +59,13 @@ void glew_fail(std::string_view message, GLenum error)
 const char vertex_shader_source[] =
 R"(#version 330 core
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
 layout (location = 2) in vec2 in_texcoord;
+layout (location = 3) in mat4 model;
 
 out vec3 normal;
 out vec2 texcoord;
@@ -91,6 +101,29 @@ void main()
 }
 )";
 
+const char box_vertex_shader_source[] =
+R"(#version 330 core
+
+uniform mat4 view_projection;
+uniform vec3 box_min;
+uniform vec3 box_max;
+
+layout (location = 0) in vec3 in_position;
+
+void main()
+{
+    gl_Position = view_projection * vec4(mix(box_min, box_max, in_position * 0.5 + 0.5), 1.0);
+}
+)";
+
+const char box_fragment_shader_source[] =
+R"(#version 330 core
+
+void main()
+{
+}
+)";
+
 GLuint create_shader(GLenum type, const char * source)
 {
     GLuint result = glCreateShader(type);
@@ -172,7 +205,6 @@ int main() try
     auto fragment_shader = create_shader(GL_FRAGMENT_SHADER, fragment_shader_source);
     auto program = create_program(vertex_shader, fragment_shader);
 
-    GLuint model_location = glGetUniformLocation(program, "model");
     GLuint view_location = glGetUniformLocation(program, "view");
     GLuint projection_location = glGetUniformLocation(program, "projection");
     GLuint albedo_location = glGetUniformLocation(program, "albedo");
@@ -181,6 +213,14 @@ int main() try
     GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
     GLuint bones_location = glGetUniformLocation(program, "bones");
 
+    auto box_vertex_shader = create_shader(GL_VERTEX_SHADER, box_vertex_shader_source);
+    auto box_fragment_shader = create_shader(GL_FRAGMENT_SHADER, box_fragment_shader_source);
+    auto box_program = create_program(box_vertex_shader, box_fragment_shader);
+
+    GLuint box_view_projection_location = glGetUniformLocation(box_program, "view_projection");
+    GLuint box_min_location = glGetUniformLocation(box_program, "box_min");
+    GLuint box_max_location = glGetUniformLocation(box_program, "box_max");
+
     const std::string project_root = PROJECT_ROOT;
     const std::string model_path = project_root + "/bunny/bunny.gltf";
 
@@ -233,6 +273,156 @@ int main() try
         stbi_image_free(data);
     }
 
+    // Walls standing in the field, drawn as instances of a cube with the bunny program; their cubes also
+    // serve as occluders for software occlusion culling
+    struct wall_vertex
+    {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec2 texcoord;
+    };
+
+    std::vector<wall_vertex> wall_vertices;
+    std::vector<glm::vec3> wall_positions;
+    std::vector<std::uint32_t> wall_indices;
+    for (int axis = 0; axis < 3; ++axis)
+        for (float sign : {-1.f, 1.f})
+        {
+            glm::vec3 normal(0.f);
+            normal[axis] = sign;
+            glm::vec3 u(0.f);
+            u[(axis + 1) % 3] = 1.f;
+            glm::vec3 const v = glm::cross(normal, u);
+
+            // Counterclockwise seen from outside, as cross(u, v) = normal
+            std::uint32_t const first = wall_vertices.size();
+            for (glm::vec2 const t : {glm::vec2(0.f, 0.f), glm::vec2(1.f, 0.f), glm::vec2(1.f, 1.f), glm::vec2(0.f, 1.f)})
+            {
+                wall_vertices.push_back({normal + (2.f * t.x - 1.f) * u + (2.f * t.y - 1.f) * v, normal, t});
+                wall_positions.push_back(wall_vertices.back().position);
+            }
+            for (std::uint32_t i : {0, 1, 2, 0, 2, 3})
+                wall_indices.push_back(first + i);
+        }
+
+    std::vector<glm::mat4> const walls =
+    {
+        glm::scale(glm::translate(glm::mat4(1.f), {-6.f, 1.5f, -10.f}), {6.f, 1.5f, 0.25f}),
+        glm::scale(glm::translate(glm::mat4(1.f), {10.f, 1.5f, -20.f}), {6.f, 1.5f, 0.25f}),
+        glm::scale(glm::translate(glm::mat4(1.f), {-14.f, 1.5f, -32.f}), {0.25f, 1.5f, 10.f}),
+    };
+
+    GLuint wall_vao;
+    {
+        glGenVertexArrays(1, &wall_vao);
+        glBindVertexArray(wall_vao);
+
+        GLuint wall_vbo, wall_ebo, wall_instance_vbo;
+        glGenBuffers(1, &wall_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, wall_vbo);
+        glBufferData(GL_ARRAY_BUFFER, wall_vertices.size() * sizeof(wall_vertex), wall_vertices.data(), GL_STATIC_DRAW);
+
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(wall_vertex), reinterpret_cast<void *>(offsetof(wall_vertex, position)));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(wall_vertex), reinterpret_cast<void *>(offsetof(wall_vertex, normal)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(wall_vertex), reinterpret_cast<void *>(offsetof(wall_vertex, texcoord)));
+
+        glGenBuffers(1, &wall_ebo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, wall_ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, wall_indices.size() * sizeof(std::uint32_t), wall_indices.data(), GL_STATIC_DRAW);
+
+        glGenBuffers(1, &wall_instance_vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, wall_instance_vbo);
+        glBufferData(GL_ARRAY_BUFFER, walls.size() * sizeof(glm::mat4), walls.data(), GL_STATIC_DRAW);
+        for (int column = 0; column < 4; ++column)
+        {
+            glEnableVertexAttribArray(3 + column);
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<void *>(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(3 + column, 1);
+        }
+    }
+
+    // A field of bunnies drawn through EXT_mesh_gpu_instancing-style instance transforms
+    auto nodes = input_model.nodes;
+    {
+        auto & field = nodes.emplace_back();
+        field.name = "field";
+        field.mesh = 0;
+        field.translation = {-24.f, 0.f, -4.f};
+        for (int x = 0; x < 32; ++x)
+            for (int z = 0; z < 32; ++z)
+                field.instances.push_back(glm::translate(glm::mat4(1.f), {1.5f * x, 0.f, -1.5f * z}));
+    }
+
+    scene scene(nodes);
+
+    // Transforms of all mesh instances, grouped by mesh; rebuilt whenever the scene changes
+    GLuint instance_vbo;
+    glGenBuffers(1, &instance_vbo);
+
+    std::vector<instance_batch> batches;
+    bool instances_changed = true;
+
+    // World-space bounds of every instance in batch order, batches[mesh] starting at batch_offsets[mesh],
+    // and a hierarchy over them, refit when instances move and rebuilt when their number changes;
+    // the instances that pass frustum culling are copied to the front of their batch's buffer range
+    thread_pool pool;
+    aabb_set instance_bounds;
+    bvh hierarchy;
+
+    // C switches between culling through the hierarchy and temporal culling over all instances
+    temporal_culler temporal;
+    bool use_temporal = false;
+
+    // O switches occlusion culling of the instances that pass frustum culling against the walls
+    occlusion_buffer occlusion;
+    bool use_occlusion = false;
+    occlusion_buffer::timings stats_occlusion;
+
+    // Q switches to drawing instances in groups of nearby instances of one mesh, frustum culled by the
+    // bounds of the group and occlusion culled with hardware queries drawing those bounds. Groups never
+    // change between rebuilds, so their transforms live in a separate buffer, uploaded once per rebuild with
+    // each mesh's range holding its instances group by group
+    struct instance_group
+    {
+        std::uint32_t mesh;
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    std::size_t const group_size = 32;
+    std::vector<instance_group> groups;
+    aabb_set group_bounds;
+    GLuint group_instance_vbo;
+    glGenBuffers(1, &group_instance_vbo);
+    std::vector<std::uint32_t> visible_groups;
+    occlusion_queries queries;
+    bool use_queries = false;
+    occlusion_queries::statistics stats_queries;
+
+    // Clicking picks the instance or wall under the cursor by casting a ray through it; the ray caster
+    // holds the model's meshes followed by the wall cube, and the instances in batch order followed by the walls
+    ray_caster picker;
+    for (auto const & mesh : input_model.meshes)
+        picker.add_mesh(mesh_positions(input_model, mesh), mesh_indices(input_model, mesh), pool);
+    std::uint32_t const wall_mesh = picker.add_mesh(wall_positions, wall_indices, pool);
+    std::vector<std::uint32_t> pick_meshes;
+    std::vector<glm::mat4> pick_transforms;
+    std::optional<glm::ivec2> pick;
+
+    std::vector<std::uint32_t> batch_offsets;
+    std::vector<std::uint32_t> instance_meshes;
+    std::vector<std::uint32_t> visible;
+    std::vector<glm::mat4> visible_transforms;
+    std::vector<std::uint32_t> visible_counts;
+
+    float stats_time = 0.f;
+    int stats_frames = 0;
+    double stats_cull_ms = 0.0;
+    std::size_t stats_visible = 0;
+
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
     float time = 0.f;
@@ -265,10 +455,23 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            if (event.key.keysym.sym == SDLK_c)
+                use_temporal = !use_temporal;
+            if (event.key.keysym.sym == SDLK_o)
+                use_occlusion = !use_occlusion;
+            if (event.key.keysym.sym == SDLK_q)
+            {
+                use_queries = !use_queries;
+                queries.resize(groups.size());
+            }
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
             break;
+        case SDL_MOUSEBUTTONDOWN:
+            if (event.button.button == SDL_BUTTON_LEFT)
+                pick = glm::ivec2(event.button.x, event.button.y);
+            break;
         }
 
         if (!running)
@@ -316,7 +519,98 @@ int main() try
         float near = 0.1f;
         float far = 100.f;
 
-        glm::mat4 model(1.f);
+        if (scene.update() > 0 || instances_changed)
+        {
+            collect_instances(scene, input_model.meshes.size(), batches);
+
+            instance_bounds.clear();
+            batch_offsets.clear();
+            instance_meshes.clear();
+            for (std::size_t mesh = 0; mesh < batches.size(); ++mesh)
+            {
+                batch_offsets.push_back(instance_bounds.size());
+                for (auto const & transform : batches[mesh].transforms)
+                {
+                    glm::vec3 min, max;
+                    transform_bounds(transform, input_model.meshes[mesh].min, input_model.meshes[mesh].max, min, max);
+                    instance_bounds.push_back(min, max);
+                    instance_meshes.push_back(mesh);
+                }
+            }
+            batch_offsets.push_back(instance_bounds.size());
+
+            if (hierarchy.primitives.size() == instance_bounds.size())
+                hierarchy.refit(instance_bounds);
+            else
+                hierarchy.build(instance_bounds, pool);
+            temporal.reset();
+
+            pick_meshes = instance_meshes;
+            pick_transforms.clear();
+            for (auto const & batch : batches)
+                pick_transforms.insert(pick_transforms.end(), batch.transforms.begin(), batch.transforms.end());
+            for (auto const & wall : walls)
+            {
+                pick_meshes.push_back(wall_mesh);
+                pick_transforms.push_back(wall);
+            }
+            picker.set_instances(pick_meshes, pick_transforms, pool);
+
+            std::size_t const instance_count = instance_bounds.size();
+            visible.resize(instance_count);
+            visible_transforms.resize(instance_count);
+
+            glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+            glBufferData(GL_ARRAY_BUFFER, instance_count * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
+
+            // Attribute pointers are set before every draw, as the two drawing modes read different buffers at different offsets
+            for (std::size_t mesh = 0; mesh < batches.size(); ++mesh)
+            {
+                glBindVertexArray(vaos[mesh]);
+                for (int column = 0; column < 4; ++column)
+                {
+                    glEnableVertexAttribArray(3 + column);
+                    glVertexAttribDivisor(3 + column, 1);
+                }
+            }
+
+            // Each mesh's instances in the order of the hierarchy's leaves, which keeps nearby instances together
+            std::vector<std::vector<std::uint32_t>> mesh_instances(batches.size());
+            for (std::uint32_t i : hierarchy.primitives)
+                mesh_instances[instance_meshes[i]].push_back(i);
+
+            groups.clear();
+            group_bounds.clear();
+            std::vector<glm::mat4> group_transforms(instance_count);
+            for (std::size_t mesh = 0; mesh < batches.size(); ++mesh)
+            {
+                auto const & instances = mesh_instances[mesh];
+                std::uint32_t const begin = batch_offsets[mesh];
+                for (std::size_t first = 0; first < instances.size(); first += group_size)
+                {
+                    std::size_t const count = std::min(group_size, instances.size() - first);
+                    groups.push_back({static_cast<std::uint32_t>(mesh), static_cast<std::uint32_t>(begin + first), static_cast<std::uint32_t>(count)});
+
+                    glm::vec3 min(std::numeric_limits<float>::infinity());
+                    glm::vec3 max(-std::numeric_limits<float>::infinity());
+                    for (std::size_t k = first; k < first + count; ++k)
+                    {
+                        std::uint32_t const i = instances[k];
+                        min = glm::min(min, glm::vec3(instance_bounds.min_x[i], instance_bounds.min_y[i], instance_bounds.min_z[i]));
+                        max = glm::max(max, glm::vec3(instance_bounds.max_x[i], instance_bounds.max_y[i], instance_bounds.max_z[i]));
+                        group_transforms[begin + k] = batches[mesh].transforms[i - begin];
+                    }
+                    group_bounds.push_back(min, max);
+                }
+            }
+            visible_groups.resize(groups.size());
+            queries.resize(groups.size());
+
+            glBindBuffer(GL_ARRAY_BUFFER, group_instance_vbo);
+            glBufferData(GL_ARRAY_BUFFER, group_transforms.size() * sizeof(glm::mat4), group_transforms.data(), GL_STATIC_DRAW);
+
+            instances_changed = false;
+        }
 
         glm::mat4 view(1.f);
         view = glm::rotate(view, camera_rotation, {0.f, 1.f, 0.f});
@@ -328,18 +622,201 @@ int main() try
 
         glm::vec3 light_direction = glm::normalize(glm::vec3(1.f, 2.f, 3.f));
 
-        glUseProgram(program);
-        glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
-        glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
-        glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
-        glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
+        if (pick)
+        {
+            glm::ivec2 const cursor = *pick;
+            pick.reset();
+
+            // The ray from the eye through the cursor's point on the far plane
+            glm::vec4 far_point = glm::inverse(projection * view)
+                * glm::vec4((cursor.x + 0.5f) / width * 2.f - 1.f, 1.f - (cursor.y + 0.5f) / height * 2.f, 1.f, 1.f);
+            glm::vec3 const direction = far_point.xyz() / far_point.w - camera_position;
+
+            ray_hit const hit = picker.cast({camera_position, direction});
+            if (!hit.found())
+                std::cout << "picked nothing" << std::endl;
+            else if (hit.instance >= instance_meshes.size())
+                std::cout << "picked wall " << hit.instance - instance_meshes.size() << " at distance " << hit.t * glm::length(direction) << std::endl;
+            else
+                std::cout << "picked instance " << hit.instance << " of mesh " << input_model.meshes[instance_meshes[hit.instance]].name
+                    << ", triangle " << hit.triangle << " at distance " << hit.t * glm::length(direction) << std::endl;
+        }
 
-        glBindTexture(GL_TEXTURE_2D, texture);
+        // Points the instance attributes of the bound vertex array at the transform of instance `first` in `buffer`
+        auto point_instances = [&](GLuint buffer, std::size_t first)
+        {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            for (int column = 0; column < 4; ++column)
+                glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<void *>(first * sizeof(glm::mat4) + column * sizeof(glm::vec4)));
+        };
+
+        if (use_queries)
+        {
+            auto const cull_start = std::chrono::high_resolution_clock::now();
+
+            queries.collect();
+            std::size_t const visible_group_count = cull(frustum(projection * view), group_bounds, visible_groups.data());
+
+            stats_cull_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - cull_start).count();
+
+            // Boxes the near plane may cut are not queried, as their query could miss them; for this
+            // projection, the near plane lies within near * sqrt(2 + aspect^2) of the eye
+            float const aspect = (1.f * width) / height;
+            float const margin = near * std::sqrt(2.f + aspect * aspect);
+            auto near_camera = [&](std::size_t group)
+            {
+                return camera_position.x > group_bounds.min_x[group] - margin && camera_position.x < group_bounds.max_x[group] + margin
+                    && camera_position.y > group_bounds.min_y[group] - margin && camera_position.y < group_bounds.max_y[group] + margin
+                    && camera_position.z > group_bounds.min_z[group] - margin && camera_position.z < group_bounds.max_z[group] + margin;
+            };
+
+            glUseProgram(program);
+            glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
+            glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+            glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
+
+            glBindTexture(GL_TEXTURE_2D, texture);
+
+            for (std::size_t k = 0; k < visible_group_count; ++k)
+            {
+                std::uint32_t const g = visible_groups[k];
+                if (!near_camera(g) && !queries.begin_draw(g))
+                    continue;
+
+                auto const & group = groups[g];
+                auto const & mesh = input_model.meshes[group.mesh];
+                glBindVertexArray(vaos[group.mesh]);
+                point_instances(group_instance_vbo, group.first);
+                glDrawElementsInstanced(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset),
+                    group.count);
+                queries.end_draw();
+
+                stats_visible += group.count;
+            }
+
+            glBindVertexArray(wall_vao);
+            glDrawElementsInstanced(GL_TRIANGLES, wall_indices.size(), GL_UNSIGNED_INT, nullptr, walls.size());
+
+            // All queries of the frame in one pass over the finished depth buffer, drawing group bounds
+            // with the wall cube, which spans [-1, 1]
+            glm::mat4 view_projection = projection * view;
+            glUseProgram(box_program);
+            glUniformMatrix4fv(box_view_projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&view_projection));
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_LEQUAL);
+
+            for (std::size_t k = 0; k < visible_group_count; ++k)
+            {
+                std::uint32_t const g = visible_groups[k];
+                if (near_camera(g) || !queries.due(g))
+                    continue;
+
+                glUniform3f(box_min_location, group_bounds.min_x[g], group_bounds.min_y[g], group_bounds.min_z[g]);
+                glUniform3f(box_max_location, group_bounds.max_x[g], group_bounds.max_y[g], group_bounds.max_z[g]);
+                queries.begin_query(g);
+                glDrawElements(GL_TRIANGLES, wall_indices.size(), GL_UNSIGNED_INT, nullptr);
+                queries.end_query();
+            }
+
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthMask(GL_TRUE);
+            glDepthFunc(GL_LESS);
+
+            queries.end_frame();
+
+            auto const & query_stats = queries.last_statistics();
+            stats_queries.issued += query_stats.issued;
+            stats_queries.conditional += query_stats.conditional;
+            stats_queries.unconditional += query_stats.unconditional;
+            stats_queries.skipped += query_stats.skipped;
+        }
+        else
+        {
+            auto const cull_start = std::chrono::high_resolution_clock::now();
+
+            frustum const view_frustum(projection * view);
+            std::size_t visible_count = use_temporal
+                ? temporal.cull(view_frustum, camera_position, instance_bounds, visible.data())
+                : cull(view_frustum, hierarchy, instance_bounds, visible.data());
+
+            if (use_occlusion)
+            {
+                occlusion.begin(projection * view);
+                for (auto const & wall : walls)
+                    occlusion.add_occluder(wall_positions, wall_indices, wall);
+                occlusion.rasterize(pool);
+                visible_count = occlusion.cull(instance_bounds, visible.data(), visible_count, pool);
+
+                auto const & times = occlusion.last_timings();
+                stats_occlusion.setup_ms += times.setup_ms;
+                stats_occlusion.raster_ms += times.raster_ms;
+                stats_occlusion.pyramid_ms += times.pyramid_ms;
+                stats_occlusion.test_ms += times.test_ms;
+                stats_occlusion.triangles += times.triangles;
+            }
+
+            visible_counts.assign(batches.size(), 0);
+            for (std::size_t k = 0; k < visible_count; ++k)
+            {
+                std::uint32_t const mesh = instance_meshes[visible[k]];
+                std::uint32_t const begin = batch_offsets[mesh];
+                visible_transforms[begin + visible_counts[mesh]++] = batches[mesh].transforms[visible[k] - begin];
+            }
+
+            stats_cull_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - cull_start).count();
+            stats_visible += visible_count;
+
+            glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+            for (std::size_t mesh = 0; mesh < batches.size(); ++mesh)
+                if (visible_counts[mesh] > 0)
+                    glBufferSubData(GL_ARRAY_BUFFER, batch_offsets[mesh] * sizeof(glm::mat4), visible_counts[mesh] * sizeof(glm::mat4),
+                        visible_transforms.data() + batch_offsets[mesh]);
+
+            glUseProgram(program);
+            glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
+            glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+            glUniform3fv(light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
+
+            glBindTexture(GL_TEXTURE_2D, texture);
+
+            for (std::size_t i = 0; i < batches.size(); ++i)
+            {
+                if (visible_counts[i] == 0)
+                    continue;
+
+                auto const & mesh = input_model.meshes[i];
+                glBindVertexArray(vaos[i]);
+                point_instances(instance_vbo, batch_offsets[i]);
+                glDrawElementsInstanced(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset),
+                    visible_counts[i]);
+            }
+
+            glBindVertexArray(wall_vao);
+            glDrawElementsInstanced(GL_TRIANGLES, wall_indices.size(), GL_UNSIGNED_INT, nullptr, walls.size());
+        }
 
+        ++stats_frames;
+        stats_time += dt;
+        if (stats_time >= 1.f)
         {
-            auto const & mesh = input_model.meshes[0];
-            glBindVertexArray(vaos[0]);
-            glDrawElements(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset));
+            char const * mode = use_queries ? "group" : use_temporal ? "temporal" : "hierarchical";
+            std::cout << stats_visible / stats_frames << " of " << instance_bounds.size() << " instances visible, "
+                << mode << " culling " << stats_cull_ms / stats_frames << " ms per frame" << std::endl;
+            if (use_queries)
+                std::cout << "    queries: " << stats_queries.issued / stats_frames << " issued, " << stats_queries.conditional / stats_frames
+                    << " conditional draws, " << stats_queries.unconditional / stats_frames << " unconditional, "
+                    << stats_queries.skipped / stats_frames << " skipped as hidden, of " << groups.size() << " groups" << std::endl;
+            else if (use_occlusion)
+                std::cout << "    occlusion: setup " << stats_occlusion.setup_ms / stats_frames << " ms (" << stats_occlusion.triangles / stats_frames
+                    << " triangles), raster " << stats_occlusion.raster_ms / stats_frames << " ms, pyramid " << stats_occlusion.pyramid_ms / stats_frames
+                    << " ms, test " << stats_occlusion.test_ms / stats_frames << " ms" << std::endl;
+            stats_time = 0.f;
+            stats_frames = 0;
+            stats_cull_ms = 0.0;
+            stats_visible = 0;
+            stats_occlusion = {};
+            stats_queries = {};
         }
 
         SDL_GL_SwapWindow(window);
@@ -0,0 +1,33 @@
+#include "obb.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+obb::obb(glm::mat4 const & transform)
+{
+	for (std::size_t i = 0; i < 8; ++i)
+	{
+		glm::vec4 v;
+		v.x = (i & 1) ? 1.f : -1.f;
+		v.y = (i & 2) ? 1.f : -1.f;
+		v.z = (i & 4) ? 1.f : -1.f;
+		v.w = 1.f;
+
+		vertices[i] = (transform * v).xyz();
+	}
+
+	glm::vec3 const x = transform[0].xyz();
+	glm::vec3 const y = transform[1].xyz();
+	glm::vec3 const z = transform[2].xyz();
+
+	// Faces of a sheared box are not perpendicular to its edges
+	face_normals = {glm::cross(y, z), glm::cross(z, x), glm::cross(x, y)};
+	edge_directions = {x, y, z};
+
+	min = max = vertices[0];
+	for (auto const & v : vertices)
+	{
+		min = glm::min(min, v);
+		max = glm::max(max, v);
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <array>
+
+// Oriented box, the cube [-1, 1]^3 placed by an affine transform, as a body for the separating axis test
+struct obb
+{
+	explicit obb(glm::mat4 const & transform);
+
+	std::array<glm::vec3, 8> vertices;
+	std::array<glm::vec3, 3> face_normals;
+	std::array<glm::vec3, 3> edge_directions;
+
+	// Axis-aligned bounds of the vertices
+	glm::vec3 min;
+	glm::vec3 max;
+};
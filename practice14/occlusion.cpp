@@ -0,0 +1,451 @@
+#include "occlusion.hpp"
+#include "simd.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/vec2.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+#include <limits>
+
+namespace
+{
+
+	using clock = std::chrono::high_resolution_clock;
+
+	double milliseconds_since(clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	}
+
+	// Triangles are clipped against the near plane and against a guard band around the screen,
+	// which keeps projected coordinates small enough for accurate edge functions
+	constexpr float guard_band = 4.f;
+
+	// Clip-space half-spaces dot(plane, v) >= 0
+	glm::vec4 const clip_planes[] =
+	{
+		{0.f, 0.f, 1.f, 1.f},
+		{1.f, 0.f, 0.f, guard_band},
+		{-1.f, 0.f, 0.f, guard_band},
+		{0.f, 1.f, 0.f, guard_band},
+		{0.f, -1.f, 0.f, guard_band},
+	};
+
+	// Half-spaces of the view volume, except for the near plane; a triangle outside of any of them is
+	// skipped
+	glm::vec4 const reject_planes[] =
+	{
+		{1.f, 0.f, 0.f, 1.f},
+		{-1.f, 0.f, 0.f, 1.f},
+		{0.f, 1.f, 0.f, 1.f},
+		{0.f, -1.f, 0.f, 1.f},
+		{0.f, 0.f, -1.f, 1.f},
+	};
+
+	constexpr std::size_t max_polygon_size = 3 + std::size(clip_planes);
+
+	// Sutherland-Hodgman clipping of a convex polygon against one half-space
+	std::size_t clip_polygon(glm::vec4 const * input, std::size_t size, glm::vec4 const & plane, glm::vec4 * output)
+	{
+		std::size_t result = 0;
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			glm::vec4 const & a = input[i];
+			glm::vec4 const & b = input[(i + 1) % size];
+			float const da = glm::dot(plane, a);
+			float const db = glm::dot(plane, b);
+			if (da >= 0.f)
+				output[result++] = a;
+			if ((da >= 0.f) != (db >= 0.f))
+				output[result++] = a + (b - a) * (da / (da - db));
+		}
+		return result;
+	}
+
+	float const lane_offsets[8] = {0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f};
+
+}
+
+occlusion_buffer::occlusion_buffer(int width, int height)
+	: tiles_x(width / tile_width)
+	, tiles_y(height / tile_height)
+	, tile_triangles(tiles_x * tiles_y)
+{
+	static_assert(tile_width % simd::width == 0);
+
+	levels.push_back({width, height, {}, std::vector<float>(width * height, 1.f)});
+	while (levels.back().width > 1 && levels.back().height > 1)
+	{
+		int const w = levels.back().width / 2;
+		int const h = levels.back().height / 2;
+		levels.push_back({w, h, std::vector<float>(w * h, 1.f), std::vector<float>(w * h, 1.f)});
+	}
+}
+
+void occlusion_buffer::begin(glm::mat4 const & view_projection)
+{
+	this->view_projection = view_projection;
+	triangles.clear();
+	for (auto & list : tile_triangles)
+		list.clear();
+	times = {};
+}
+
+void occlusion_buffer::add_occluder(std::vector<glm::vec3> const & vertices, std::vector<std::uint32_t> const & indices, glm::mat4 const & model)
+{
+	auto const start = clock::now();
+
+	glm::mat4 const transform = view_projection * model;
+
+	thread_local std::vector<glm::vec4> clip;
+	clip.resize(vertices.size());
+	for (std::size_t i = 0; i < vertices.size(); ++i)
+		clip[i] = transform * glm::vec4(vertices[i], 1.f);
+
+	for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		glm::vec4 polygon[2][max_polygon_size] = {{clip[indices[i]], clip[indices[i + 1]], clip[indices[i + 2]]}};
+
+		bool rejected = false;
+		for (auto const & plane : reject_planes)
+			rejected = rejected || (glm::dot(plane, polygon[0][0]) < 0.f && glm::dot(plane, polygon[0][1]) < 0.f && glm::dot(plane, polygon[0][2]) < 0.f);
+		if (rejected)
+			continue;
+
+		std::size_t size = 3;
+		int current = 0;
+		for (auto const & plane : clip_planes)
+		{
+			if (std::all_of(polygon[current], polygon[current] + size, [&](glm::vec4 const & v){ return glm::dot(plane, v) >= 0.f; }))
+				continue;
+			size = clip_polygon(polygon[current], size, plane, polygon[1 - current]);
+			current = 1 - current;
+		}
+
+		for (std::size_t k = 1; k + 1 < size; ++k)
+			setup_triangle(polygon[current][0], polygon[current][k], polygon[current][k + 1]);
+	}
+
+	times.setup_ms += milliseconds_since(start);
+	times.triangles = triangles.size();
+}
+
+void occlusion_buffer::setup_triangle(glm::vec4 const & p0, glm::vec4 const & p1, glm::vec4 const & p2)
+{
+	float const w = static_cast<float>(width());
+	float const h = static_cast<float>(height());
+
+	// Screen coordinates in pixels and NDC depth
+	glm::vec3 v[3];
+	glm::vec4 const * p[3] = {&p0, &p1, &p2};
+	for (int k = 0; k < 3; ++k)
+	{
+		float const inverse_w = 1.f / p[k]->w;
+		v[k] = {(p[k]->x * inverse_w * 0.5f + 0.5f) * w, (p[k]->y * inverse_w * 0.5f + 0.5f) * h, p[k]->z * inverse_w};
+	}
+
+	// Counterclockwise triangles have positive area
+	float const area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+	if (!(area > 0.f))
+		return;
+
+	triangle t;
+
+	// Pixels whose centers lie inside the bounding rectangle
+	t.min_x = std::max(0, static_cast<int>(std::ceil(std::min({v[0].x, v[1].x, v[2].x}) - 0.5f)));
+	t.min_y = std::max(0, static_cast<int>(std::ceil(std::min({v[0].y, v[1].y, v[2].y}) - 0.5f)));
+	t.max_x = std::min(width() - 1, static_cast<int>(std::floor(std::max({v[0].x, v[1].x, v[2].x}) - 0.5f)));
+	t.max_y = std::min(height() - 1, static_cast<int>(std::floor(std::max({v[0].y, v[1].y, v[2].y}) - 0.5f)));
+	if (t.min_x > t.max_x || t.min_y > t.max_y)
+		return;
+
+	// Edge k goes from vertex k to the next one, and the inside is on its left
+	for (int k = 0; k < 3; ++k)
+	{
+		glm::vec3 const & a = v[k];
+		glm::vec3 const & b = v[(k + 1) % 3];
+		t.edge_a[k] = a.y - b.y;
+		t.edge_b[k] = b.x - a.x;
+		t.edge_c[k] = -(t.edge_a[k] * a.x + t.edge_b[k] * a.y);
+	}
+
+	// Depth is affine in screen space; the plane is raised to its largest value over a pixel, so that
+	// the buffer never holds a depth nearer than the occluder surface
+	float const dz1 = v[1].z - v[0].z;
+	float const dz2 = v[2].z - v[0].z;
+	t.depth_a = (dz1 * (v[2].y - v[0].y) - dz2 * (v[1].y - v[0].y)) / area;
+	t.depth_b = (dz2 * (v[1].x - v[0].x) - dz1 * (v[2].x - v[0].x)) / area;
+	t.depth_c = v[0].z - t.depth_a * v[0].x - t.depth_b * v[0].y + 0.5f * (std::abs(t.depth_a) + std::abs(t.depth_b));
+
+	std::uint32_t const index = triangles.size();
+	triangles.push_back(t);
+
+	for (int ty = t.min_y / tile_height; ty <= t.max_y / tile_height; ++ty)
+		for (int tx = t.min_x / tile_width; tx <= t.max_x / tile_width; ++tx)
+			tile_triangles[ty * tiles_x + tx].push_back(index);
+}
+
+void occlusion_buffer::rasterize(thread_pool & pool)
+{
+	auto start = clock::now();
+
+	pool.parallel_for(tile_triangles.size(), 1, [this](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t tile = begin; tile < end; ++tile)
+			rasterize_tile(tile);
+	});
+
+	times.raster_ms = milliseconds_since(start);
+	start = clock::now();
+
+	for (std::size_t l = 1; l < levels.size(); ++l)
+	{
+		level const & source = levels[l - 1];
+		level & target = levels[l];
+		std::vector<float> const & source_min = l == 1 ? source.max : source.min;
+		for (int y = 0; y < target.height; ++y)
+		{
+			float const * min0 = source_min.data() + (2 * y) * source.width;
+			float const * min1 = min0 + source.width;
+			float const * max0 = source.max.data() + (2 * y) * source.width;
+			float const * max1 = max0 + source.width;
+			for (int x = 0; x < target.width; ++x)
+			{
+				target.min[y * target.width + x] = std::min({min0[2 * x], min0[2 * x + 1], min1[2 * x], min1[2 * x + 1]});
+				target.max[y * target.width + x] = std::max({max0[2 * x], max0[2 * x + 1], max1[2 * x], max1[2 * x + 1]});
+			}
+		}
+	}
+
+	times.pyramid_ms = milliseconds_since(start);
+}
+
+void occlusion_buffer::rasterize_tile(int tile)
+{
+	int const x0 = (tile % tiles_x) * tile_width;
+	int const y0 = (tile / tiles_x) * tile_height;
+	int const stride = width();
+	float * depth = levels[0].max.data();
+
+	for (int y = y0; y < y0 + tile_height; ++y)
+		std::fill(depth + y * stride + x0, depth + y * stride + x0 + tile_width, 1.f);
+
+	simd::floatv const zero = simd::splat(0.f);
+	simd::floatv const offsets = simd::load(lane_offsets);
+
+	for (std::uint32_t index : tile_triangles[tile])
+	{
+		triangle const & t = triangles[index];
+
+		// Spans start at a multiple of simd::width, which tile_width is a multiple of
+		int const begin_x = std::max(t.min_x, x0) / simd::width * simd::width;
+		int const end_x = std::min(t.max_x + 1, x0 + tile_width);
+		int const begin_y = std::max(t.min_y, y0);
+		int const end_y = std::min(t.max_y + 1, y0 + tile_height);
+
+		simd::floatv const a0 = simd::splat(t.edge_a[0]);
+		simd::floatv const a1 = simd::splat(t.edge_a[1]);
+		simd::floatv const a2 = simd::splat(t.edge_a[2]);
+		simd::floatv const za = simd::splat(t.depth_a);
+
+		for (int y = begin_y; y < end_y; ++y)
+		{
+			float const py = y + 0.5f;
+			simd::floatv const row0 = simd::splat(t.edge_b[0] * py + t.edge_c[0]);
+			simd::floatv const row1 = simd::splat(t.edge_b[1] * py + t.edge_c[1]);
+			simd::floatv const row2 = simd::splat(t.edge_b[2] * py + t.edge_c[2]);
+			simd::floatv const zrow = simd::splat(t.depth_b * py + t.depth_c);
+
+			float * row = depth + y * stride;
+			for (int x = begin_x; x < end_x; x += simd::width)
+			{
+				simd::floatv const px = simd::splat(static_cast<float>(x)) + offsets;
+
+				// Pixels on a shared edge are written by both triangles, which is harmless for a minimum
+				simd::maskv const inside = (a0 * px + row0 >= zero) & (a1 * px + row1 >= zero) & (a2 * px + row2 >= zero);
+				if (!simd::movemask(inside))
+					continue;
+
+				simd::floatv const current = simd::load(row + x);
+				simd::store(row + x, simd::select(inside, simd::min(za * px + zrow, current), current));
+			}
+		}
+	}
+}
+
+bool occlusion_buffer::visible(glm::vec3 const & min, glm::vec3 const & max) const
+{
+	// Projected coordinates are linear-fractional over the box, so their extremes lie at its corners
+	glm::vec2 ndc_min(std::numeric_limits<float>::infinity());
+	glm::vec2 ndc_max(-std::numeric_limits<float>::infinity());
+	float nearest = std::numeric_limits<float>::infinity();
+	for (int k = 0; k < 8; ++k)
+	{
+		glm::vec4 const p = view_projection * glm::vec4((k & 1) ? max.x : min.x, (k & 2) ? max.y : min.y, (k & 4) ? max.z : min.z, 1.f);
+
+		// A box crossing the near plane covers the camera's view of it
+		if (!(p.z >= -p.w))
+			return true;
+
+		glm::vec3 const ndc = glm::vec3(p) / p.w;
+		ndc_min = glm::min(ndc_min, glm::vec2(ndc));
+		ndc_max = glm::max(ndc_max, glm::vec2(ndc));
+		nearest = std::min(nearest, ndc.z);
+	}
+
+	return visible(ndc_min, ndc_max, nearest);
+}
+
+bool occlusion_buffer::visible(glm::vec2 const & ndc_min, glm::vec2 const & ndc_max, float nearest) const
+{
+	float const w = static_cast<float>(width());
+	float const h = static_cast<float>(height());
+	glm::vec2 const screen_min = (ndc_min * 0.5f + 0.5f) * glm::vec2(w, h);
+	glm::vec2 const screen_max = (ndc_max * 0.5f + 0.5f) * glm::vec2(w, h);
+
+	// Left to the frustum culling
+	if (screen_max.x < 0.f || screen_max.y < 0.f || screen_min.x >= w || screen_min.y >= h)
+		return true;
+
+	// Every pixel the rectangle touches; coordinates are clamped first, so truncation rounds down
+	int const x0 = static_cast<int>(std::max(screen_min.x, 0.f));
+	int const y0 = static_cast<int>(std::max(screen_min.y, 0.f));
+	int const x1 = static_cast<int>(std::min(screen_max.x, w - 1.f));
+	int const y1 = static_cast<int>(std::min(screen_max.y, h - 1.f));
+
+	// The finest level at which the rectangle spans at most 2x2 texels
+	std::size_t l = 0;
+	while (l + 1 < levels.size() && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1))
+		++l;
+
+	// The texels cover the rectangle, so their farthest depth bounds that of the pixels from above,
+	// and their nearest depth bounds it from below
+	auto farthest = [&](std::size_t l, int x, int y) { return levels[l].max[y * levels[l].width + x]; };
+	auto nearest_of = [&](std::size_t l, int x, int y) { return l == 0 ? levels[0].max[y * levels[0].width + x] : levels[l].min[y * levels[l].width + x]; };
+
+	float region_far = -std::numeric_limits<float>::infinity();
+	float region_near = std::numeric_limits<float>::infinity();
+	for (int y = y0 >> l; y <= (y1 >> l); ++y)
+		for (int x = x0 >> l; x <= (x1 >> l); ++x)
+		{
+			region_far = std::max(region_far, farthest(l, x, y));
+			region_near = std::min(region_near, nearest_of(l, x, y));
+		}
+
+	if (nearest > region_far)
+		return false;
+	if (nearest <= region_near || l == 0)
+		return true;
+
+	// Undecided: the box lies between the occluders of the region. Look two levels finer, where
+	// the texels cover the rectangle more tightly, for any of them farther than the box
+	l = l >= 2 ? l - 2 : 0;
+	for (int y = y0 >> l; y <= (y1 >> l); ++y)
+		for (int x = x0 >> l; x <= (x1 >> l); ++x)
+			if (farthest(l, x, y) >= nearest)
+				return true;
+	return false;
+}
+
+std::size_t occlusion_buffer::cull(aabb_set const & boxes, std::uint32_t * indices, std::size_t count, thread_pool & pool)
+{
+	auto const start = clock::now();
+
+	results.resize(count);
+	pool.parallel_for(count, 256, [&](std::size_t begin, std::size_t end)
+	{
+		simd::floatv m[4][4];
+		for (int c = 0; c < 4; ++c)
+			for (int r = 0; r < 4; ++r)
+				m[c][r] = simd::splat(view_projection[c][r]);
+
+		simd::floatv const zero = simd::splat(0.f);
+		simd::floatv const one = simd::splat(1.f);
+		simd::floatv const infinity = simd::splat(std::numeric_limits<float>::infinity());
+
+		// Projects simd::width boxes at once: every corner is the projected min corner plus some of
+		// the projected edges
+		std::size_t k = begin;
+		for (; k + simd::width <= end; k += simd::width)
+		{
+			float lanes[6][simd::width];
+			for (std::size_t lane = 0; lane < simd::width; ++lane)
+			{
+				std::uint32_t const i = indices[k + lane];
+				lanes[0][lane] = boxes.min_x[i];
+				lanes[1][lane] = boxes.min_y[i];
+				lanes[2][lane] = boxes.min_z[i];
+				lanes[3][lane] = boxes.max_x[i];
+				lanes[4][lane] = boxes.max_y[i];
+				lanes[5][lane] = boxes.max_z[i];
+			}
+
+			simd::floatv min[3], extent[3];
+			for (int a = 0; a < 3; ++a)
+			{
+				min[a] = simd::load(lanes[a]);
+				extent[a] = simd::load(lanes[3 + a]) - min[a];
+			}
+
+			simd::floatv base[4], edges[3][4];
+			for (int r = 0; r < 4; ++r)
+			{
+				base[r] = m[0][r] * min[0] + m[1][r] * min[1] + m[2][r] * min[2] + m[3][r];
+				for (int a = 0; a < 3; ++a)
+					edges[a][r] = m[a][r] * extent[a];
+			}
+
+			simd::floatv ndc_min[2] = {infinity, infinity};
+			simd::floatv ndc_max[2] = {zero - infinity, zero - infinity};
+			simd::floatv nearest = infinity;
+			simd::maskv behind = zero < zero;
+			for (int corner = 0; corner < 8; ++corner)
+			{
+				simd::floatv p[4] = {base[0], base[1], base[2], base[3]};
+				for (int a = 0; a < 3; ++a)
+					if (corner & (1 << a))
+						for (int r = 0; r < 4; ++r)
+							p[r] = p[r] + edges[a][r];
+
+				behind = behind | (p[2] + p[3] < zero);
+				simd::floatv const inverse_w = one / p[3];
+				for (int a = 0; a < 2; ++a)
+				{
+					ndc_min[a] = simd::min(ndc_min[a], p[a] * inverse_w);
+					ndc_max[a] = simd::max(ndc_max[a], p[a] * inverse_w);
+				}
+				nearest = simd::min(nearest, p[2] * inverse_w);
+			}
+
+			float out[5][simd::width];
+			simd::store(out[0], ndc_min[0]);
+			simd::store(out[1], ndc_min[1]);
+			simd::store(out[2], ndc_max[0]);
+			simd::store(out[3], ndc_max[1]);
+			simd::store(out[4], nearest);
+			unsigned const behind_lanes = simd::movemask(behind);
+			for (std::size_t lane = 0; lane < simd::width; ++lane)
+				results[k + lane] = ((behind_lanes >> lane) & 1u) || visible({out[0][lane], out[1][lane]}, {out[2][lane], out[3][lane]}, out[4][lane]);
+		}
+
+		for (; k < end; ++k)
+		{
+			std::uint32_t const i = indices[k];
+			results[k] = visible({boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]}, {boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]});
+		}
+	});
+
+	std::size_t result = 0;
+	for (std::size_t k = 0; k < count; ++k)
+	{
+		indices[result] = indices[k];
+		result += results[k];
+	}
+
+	times.test_ms = milliseconds_since(start);
+	return result;
+}
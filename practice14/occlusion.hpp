@@ -0,0 +1,98 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "culling.hpp"
+#include "thread_pool.hpp"
+
+// Depth-only software rasterizer for occlusion culling. Occluder triangles are clipped to the near
+// plane, projected and binned to screen tiles; the tiles are then rasterized in parallel with SIMD edge
+// functions into a low resolution depth buffer holding the nearest occluder depth of every pixel.
+// Min and max depth pyramids are built over it, and a box is occluded when its nearest depth lies
+// behind the farthest occluder depth of the pixels its projection covers. Occluders must lie inside
+// the objects they stand for, or visible objects may be culled.
+class occlusion_buffer
+{
+public:
+	static constexpr int tile_width = 32;
+	static constexpr int tile_height = 32;
+
+	struct timings
+	{
+		double setup_ms = 0.0;
+		double raster_ms = 0.0;
+		double pyramid_ms = 0.0;
+		double test_ms = 0.0;
+		std::size_t triangles = 0;
+	};
+
+	// Both dimensions must be powers of two and multiples of the tile size
+	occlusion_buffer(int width = 256, int height = 128);
+
+	int width() const { return levels[0].width; }
+	int height() const { return levels[0].height; }
+
+	// Clears the buffer and the occluders, and sets the camera of the next tests
+	void begin(glm::mat4 const & view_projection);
+
+	// Transforms, clips and bins the triangles of an occluder mesh; back faces are skipped, so
+	// occluders should be closed meshes with counterclockwise front faces
+	void add_occluder(std::vector<glm::vec3> const & vertices, std::vector<std::uint32_t> const & indices, glm::mat4 const & model);
+
+	// Rasterizes the binned occluders and builds the depth pyramids
+	void rasterize(thread_pool & pool);
+
+	// Whether any part of the box may be visible past the occluders
+	bool visible(glm::vec3 const & min, glm::vec3 const & max) const;
+
+	// Removes the indices of occluded boxes from indices[0 .. count), keeping the order, and returns the new count
+	std::size_t cull(aabb_set const & boxes, std::uint32_t * indices, std::size_t count, thread_pool & pool);
+
+	// Nearest occluder depth (NDC z) of every pixel, rows from the bottom up
+	float const * depth() const { return levels[0].max.data(); }
+
+	timings const & last_timings() const { return times; }
+
+private:
+	struct triangle
+	{
+		// Edge functions a * x + b * y + c, positive inside, and the depth plane
+		float edge_a[3], edge_b[3], edge_c[3];
+		float depth_a, depth_b, depth_c;
+		int min_x, min_y, max_x, max_y;
+	};
+
+	struct level
+	{
+		int width;
+		int height;
+		std::vector<float> min;
+		std::vector<float> max;
+	};
+
+	// The test of a box projected to the rectangle [ndc_min, ndc_max] with nearest depth `nearest`
+	bool visible(glm::vec2 const & ndc_min, glm::vec2 const & ndc_max, float nearest) const;
+
+	void setup_triangle(glm::vec4 const & p0, glm::vec4 const & p1, glm::vec4 const & p2);
+	void rasterize_tile(int tile);
+
+	glm::mat4 view_projection;
+	int tiles_x;
+	int tiles_y;
+
+	std::vector<triangle> triangles;
+	std::vector<std::vector<std::uint32_t>> tile_triangles;
+
+	// levels[0] is the depth buffer itself, in which min and max coincide; its min array is left unused
+	std::vector<level> levels;
+
+	std::vector<std::uint8_t> results;
+
+	timings times;
+};
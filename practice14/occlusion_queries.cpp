@@ -0,0 +1,112 @@
+#include "occlusion_queries.hpp"
+
+#include <algorithm>
+
+occlusion_queries::occlusion_queries(int visible_results, int skip_frames)
+	: visible_results(visible_results)
+	, skip_frames(skip_frames)
+{}
+
+occlusion_queries::~occlusion_queries()
+{
+	if (!queries.empty())
+		glDeleteQueries(queries.size(), queries.data());
+}
+
+void occlusion_queries::resize(std::size_t count)
+{
+	if (!queries.empty())
+		glDeleteQueries(queries.size(), queries.data());
+
+	queries.assign(2 * count, 0);
+	if (count > 0)
+		glGenQueries(queries.size(), queries.data());
+
+	for (auto & slot : issued)
+		slot.assign(count, 0);
+	results.assign(count, unknown);
+	streaks.assign(count, 0);
+	skips.assign(count, 0);
+}
+
+void occlusion_queries::collect()
+{
+	stats = {};
+
+	std::size_t const previous = 1 - current;
+	for (std::size_t group = 0; group < size(); ++group)
+	{
+		results[group] = unknown;
+		if (!issued[previous][group])
+			continue;
+
+		GLuint const query = queries[2 * group + previous];
+		GLuint available = GL_FALSE;
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			continue;
+
+		GLuint passed = GL_FALSE;
+		glGetQueryObjectuiv(query, GL_QUERY_RESULT, &passed);
+		results[group] = passed ? 1 : 0;
+
+		if (!passed)
+			streaks[group] = 0;
+		else if (++streaks[group] >= visible_results)
+		{
+			// Staggered, so that groups that became visible together do not all query again on the same frame
+			skips[group] = skip_frames + group % std::max(1, skip_frames / 2);
+			streaks[group] = 0;
+		}
+	}
+}
+
+bool occlusion_queries::begin_draw(std::size_t group)
+{
+	std::size_t const previous = 1 - current;
+	if (results[group] == 0)
+	{
+		++stats.skipped;
+		return false;
+	}
+
+	if (results[group] == 1 || !issued[previous][group])
+	{
+		++stats.unconditional;
+		return true;
+	}
+
+	// Renders anyway if the result is still not there when the GPU reaches the draw
+	glBeginConditionalRender(queries[2 * group + previous], GL_QUERY_NO_WAIT);
+	conditional = true;
+	++stats.conditional;
+	return true;
+}
+
+void occlusion_queries::end_draw()
+{
+	if (conditional)
+		glEndConditionalRender();
+	conditional = false;
+}
+
+void occlusion_queries::begin_query(std::size_t group)
+{
+	glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[2 * group + current]);
+	issued[current][group] = 1;
+	++stats.issued;
+}
+
+void occlusion_queries::end_query()
+{
+	glEndQuery(GL_ANY_SAMPLES_PASSED);
+}
+
+void occlusion_queries::end_frame()
+{
+	current = 1 - current;
+	std::fill(issued[current].begin(), issued[current].end(), 0);
+
+	for (int & skip : skips)
+		skip = std::max(0, skip - 1);
+}
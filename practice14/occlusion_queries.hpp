@@ -0,0 +1,76 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Hardware occlusion queries over groups of objects that never make the CPU wait for the GPU. A group is
+// drawn under conditional rendering on the query issued for it in the previous frame, and a new query then
+// draws its bounding box against the finished depth buffer. Results are read back only once the GPU reports
+// them available: a group whose previous result is known is drawn or skipped without conditional rendering,
+// and a group found visible by several results in a row goes a few frames without queries.
+class occlusion_queries
+{
+public:
+	struct statistics
+	{
+		std::size_t issued = 0;
+		std::size_t conditional = 0;
+		std::size_t unconditional = 0;
+		std::size_t skipped = 0;
+	};
+
+	// After `visible_results` visible results in a row, a group skips queries for about `skip_frames` frames
+	explicit occlusion_queries(int visible_results = 4, int skip_frames = 8);
+	~occlusion_queries();
+
+	occlusion_queries(occlusion_queries const &) = delete;
+	occlusion_queries & operator = (occlusion_queries const &) = delete;
+
+	std::size_t size() const { return streaks.size(); }
+
+	// Recreates the queries for `count` groups, forgetting all results
+	void resize(std::size_t count);
+
+	// Starts a frame by reading the results of the previous frame's queries that are already available
+	void collect();
+
+	// Returns false if the group is known to be hidden and should not be drawn; otherwise the group is drawn
+	// next, followed by end_draw(), under conditional rendering if its previous query has no result yet
+	bool begin_draw(std::size_t group);
+	void end_draw();
+
+	// Whether the group should be queried this frame
+	bool due(std::size_t group) const { return skips[group] == 0; }
+
+	// Brackets the draw of the group's bounding box
+	void begin_query(std::size_t group);
+	void end_query();
+
+	// Ends the frame; its queries are the ones the next frame draws with
+	void end_frame();
+
+	statistics const & last_statistics() const { return stats; }
+
+private:
+	static constexpr std::int8_t unknown = -1;
+
+	int visible_results;
+	int skip_frames;
+
+	// Two queries per group, queries[2 * group + slot], for the current and the previous frame
+	std::vector<GLuint> queries;
+	std::vector<std::uint8_t> issued[2];
+	std::size_t current = 0;
+
+	// Result of the previous frame's query of each group, or `unknown`
+	std::vector<std::int8_t> results;
+	std::vector<int> streaks;
+	std::vector<int> skips;
+
+	bool conditional = false;
+
+	statistics stats;
+};
@@ -0,0 +1,36 @@
+#include "parallel_culling.hpp"
+
+#include <algorithm>
+
+std::size_t parallel_culler::cull(frustum const & frustum, glm::vec3 const & eye, aabb_set const & boxes, std::uint32_t * visible, thread_pool & pool,
+	float max_distance)
+{
+	std::size_t const size = boxes.size();
+	std::size_t const chunk_count = (size + chunk_size - 1) / chunk_size;
+	scratch.resize(size);
+	offsets.resize(chunk_count + 1);
+
+	pool.parallel_for(chunk_count, 1, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t chunk = begin; chunk < end; ++chunk)
+		{
+			std::size_t const first = chunk * chunk_size;
+			offsets[chunk + 1] = ::cull(frustum, eye, max_distance, boxes, first, std::min(first + chunk_size, size), scratch.data() + first);
+		}
+	});
+
+	offsets[0] = 0;
+	for (std::size_t chunk = 0; chunk < chunk_count; ++chunk)
+		offsets[chunk + 1] += offsets[chunk];
+
+	pool.parallel_for(chunk_count, 1, [&](std::size_t begin, std::size_t end)
+	{
+		for (std::size_t chunk = begin; chunk < end; ++chunk)
+		{
+			std::uint32_t const * list = scratch.data() + chunk * chunk_size;
+			std::copy(list, list + (offsets[chunk + 1] - offsets[chunk]), visible + offsets[chunk]);
+		}
+	});
+
+	return offsets[chunk_count];
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+
+#include "culling.hpp"
+#include "thread_pool.hpp"
+
+// Frustum and distance culling of large box sets on a thread pool. The set is split into fixed-size
+// chunks that threads claim one at a time, so faster threads take over the work of slower ones. Every chunk
+// writes its visible boxes to its own range of a scratch list; a prefix sum over the chunk counts then gives
+// each chunk its place in the result, and the lists are copied there in parallel, without locks, keeping
+// the increasing box order of the single-threaded cull.
+class parallel_culler
+{
+public:
+	static constexpr std::size_t chunk_size = 4096;
+
+	// Writes the indices of boxes that intersect the frustum and are at most `max_distance` from `eye`,
+	// in increasing order, to `visible`, which must have room for boxes.size() entries, and returns their count
+	std::size_t cull(frustum const & frustum, glm::vec3 const & eye, aabb_set const & boxes, std::uint32_t * visible, thread_pool & pool,
+		float max_distance = std::numeric_limits<float>::infinity());
+
+private:
+	std::vector<std::uint32_t> scratch;
+
+	// Visible count of every chunk, turned into the chunk's offset in the result
+	std::vector<std::size_t> offsets;
+};
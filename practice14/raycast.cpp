@@ -0,0 +1,615 @@
+#include "raycast.hpp"
+#include "bvh.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+
+namespace
+{
+
+	constexpr float inf = std::numeric_limits<float>::infinity();
+
+	// Traversal stacks hold at most width - 1 entries per level of the tree and one for the root;
+	// deeper trees than this covers get their stack from the heap
+	constexpr std::size_t stack_size = 64 * wide_bvh::width;
+
+	float half_area(bvh::node const & n)
+	{
+		glm::vec3 const d = n.max - n.min;
+		return d.x * d.y + d.y * d.z + d.z * d.x;
+	}
+
+	// Wide node `index` to be filled with the subtree of binary node `source`, at level `depth` of the tree
+	struct collapse_task
+	{
+		std::uint32_t source;
+		std::uint32_t index;
+		std::size_t depth;
+	};
+
+	// Fills a wide node: binary children are opened, the largest surface first, until the node is full
+	// or only leaves are left; inner children get new nodes, which are added to `tasks`
+	void collapse(bvh const & binary, collapse_task const & task, std::vector<wide_bvh::node> & nodes, std::vector<collapse_task> & tasks)
+	{
+		std::uint32_t const source = task.source;
+		std::uint32_t const index = task.index;
+
+		std::array<std::uint32_t, wide_bvh::width> children;
+		std::size_t count = 0;
+		if (binary.nodes[source].leaf())
+			children[count++] = source;
+		else
+		{
+			children[count++] = binary.nodes[source].children;
+			children[count++] = binary.nodes[source].children + 1;
+		}
+
+		while (count < wide_bvh::width)
+		{
+			std::size_t largest = count;
+			float largest_area = -1.f;
+			for (std::size_t k = 0; k < count; ++k)
+			{
+				auto const & child = binary.nodes[children[k]];
+				if (!child.leaf() && half_area(child) > largest_area)
+				{
+					largest = k;
+					largest_area = half_area(child);
+				}
+			}
+
+			if (largest == count)
+				break;
+
+			std::uint32_t const opened = binary.nodes[children[largest]].children;
+			children[largest] = opened;
+			children[count++] = opened + 1;
+		}
+
+		for (std::size_t k = 0; k < wide_bvh::width; ++k)
+		{
+			if (k >= count)
+			{
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					nodes[index].bounds[axis][k] = inf;
+					nodes[index].bounds[3 + axis][k] = -inf;
+				}
+				nodes[index].first[k] = 0;
+				nodes[index].count[k] = 0;
+				continue;
+			}
+
+			auto const & child = binary.nodes[children[k]];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				nodes[index].bounds[axis][k] = child.min[axis];
+				nodes[index].bounds[3 + axis][k] = child.max[axis];
+			}
+
+			if (child.leaf())
+			{
+				nodes[index].first[k] = child.first;
+				nodes[index].count[k] = child.count;
+			}
+			else
+			{
+				std::uint32_t const node = nodes.size();
+				nodes.emplace_back();
+				nodes[index].first[k] = node;
+				nodes[index].count[k] = 0;
+				tasks.push_back({children[k], node, task.depth + 1});
+			}
+		}
+	}
+
+	// A child to visit: an inner node when count is zero, a leaf otherwise, entered by the rays at distance t
+	struct stack_entry
+	{
+		std::uint32_t first;
+		std::uint32_t count;
+		float t;
+	};
+
+	// Stack storage for traversing `hierarchy`: a local array, or heap memory when the tree is too deep for it
+	class traversal_stack
+	{
+	public:
+		explicit traversal_stack(wide_bvh const & hierarchy)
+		{
+			std::size_t const capacity = (wide_bvh::width - 1) * hierarchy.depth + 1;
+			if (capacity > stack_size)
+			{
+				heap.resize(capacity);
+				entries = heap.data();
+			}
+		}
+
+		traversal_stack(traversal_stack const &) = delete;
+		traversal_stack & operator = (traversal_stack const &) = delete;
+
+		stack_entry * data() { return entries; }
+
+	private:
+		stack_entry local[stack_size];
+		std::vector<stack_entry> heap;
+		stack_entry * entries = local;
+	};
+
+	// Pushes the children whose bits are set in `hits`, the nearest last so that it is visited first
+	void push_children(wide_bvh::node const & n, unsigned hits, float const * t_near, stack_entry * stack, std::size_t & size)
+	{
+		std::size_t const begin = size;
+		for (; hits != 0; hits &= hits - 1)
+		{
+			std::size_t const k = std::countr_zero(hits);
+			stack_entry const entry{n.first[k], n.count[k], t_near[k]};
+
+			std::size_t i = size++;
+			for (; i > begin && stack[i - 1].t < entry.t; --i)
+				stack[i] = stack[i - 1];
+			stack[i] = entry;
+		}
+	}
+
+	// A single ray with its direction's reciprocals and, per axis, the bounds its slabs start and end at
+	struct single_ray
+	{
+		glm::vec3 origin;
+		glm::vec3 direction;
+		glm::vec3 inverse;
+		int near[3];
+		int far[3];
+
+		single_ray(glm::vec3 const & origin, glm::vec3 const & direction)
+			: origin(origin)
+			, direction(direction)
+			, inverse(1.f / direction)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				bool const negative = std::signbit(direction[axis]);
+				near[axis] = negative ? 3 + axis : axis;
+				far[axis] = negative ? axis : 3 + axis;
+			}
+		}
+	};
+
+	// Slab test of all children of a node, simd::width children at a time; returns a bit per child entered
+	// before t_max and writes the entry distances. Empty slots are entered after they are left and so missed.
+	unsigned slab_test(wide_bvh::node const & n, single_ray const & r, float t_max, float * t_near)
+	{
+		unsigned hits = 0;
+		for (std::size_t k = 0; k < wide_bvh::width; k += simd::width)
+		{
+			simd::floatv entry = simd::splat(0.f);
+			simd::floatv exit = simd::splat(t_max);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				simd::floatv const origin = simd::splat(r.origin[axis]);
+				simd::floatv const inverse = simd::splat(r.inverse[axis]);
+
+				// The accumulated distance goes second, which min and max return for NaN, as 0 * inf gives
+				// for rays in the plane of a slab
+				entry = simd::max((simd::load(n.bounds[r.near[axis]] + k) - origin) * inverse, entry);
+				exit = simd::min((simd::load(n.bounds[r.far[axis]] + k) - origin) * inverse, exit);
+			}
+
+			hits |= simd::movemask(exit >= entry) << k;
+			simd::store(t_near + k, entry);
+		}
+		return hits;
+	}
+
+	// Visits the leaves the ray enters before t_max, nearer children first; `leaf(first, count)` may lower
+	// t_max, which prunes subtrees entered beyond it, and returns true to stop the traversal
+	template <typename Leaf>
+	void traverse(wide_bvh const & hierarchy, single_ray const & r, float const & t_max, Leaf && leaf)
+	{
+		if (hierarchy.nodes.empty())
+			return;
+
+		traversal_stack storage(hierarchy);
+		stack_entry * stack = storage.data();
+		std::size_t size = 0;
+		stack[size++] = {0, 0, 0.f};
+
+		float t_near[wide_bvh::width];
+		while (size > 0)
+		{
+			stack_entry const entry = stack[--size];
+			if (entry.t > t_max)
+				continue;
+
+			if (entry.count > 0)
+			{
+				if (leaf(entry.first, entry.count))
+					return;
+				continue;
+			}
+
+			auto const & n = hierarchy.nodes[entry.first];
+			push_children(n, slab_test(n, r, t_max, t_near), t_near, stack, size);
+		}
+	}
+
+	// The Möller–Trumbore test, written with the same operations in the same order as its packet version,
+	// so that both find the same hits
+	bool intersect(ray_mesh::triangle const & tri, single_ray const & r, float t_max, float & t, float & u, float & v)
+	{
+		glm::vec3 const p = glm::cross(r.direction, tri.edge2);
+		float const inverse_det = 1.f / glm::dot(tri.edge1, p);
+
+		glm::vec3 const s = r.origin - tri.vertex;
+		u = glm::dot(s, p) * inverse_det;
+		if (!(u >= 0.f))
+			return false;
+
+		glm::vec3 const q = glm::cross(s, tri.edge1);
+		v = glm::dot(r.direction, q) * inverse_det;
+		if (!(v >= 0.f && 1.f >= u + v))
+			return false;
+
+		t = glm::dot(tri.edge2, q) * inverse_det;
+		return 0.f < t && t < t_max;
+	}
+
+	single_ray to_local(glm::mat4 const & m, single_ray const & r)
+	{
+		glm::vec3 const origin = m[0].xyz() * r.origin.x + m[1].xyz() * r.origin.y + m[2].xyz() * r.origin.z + m[3].xyz();
+		glm::vec3 const direction = m[0].xyz() * r.direction.x + m[1].xyz() * r.direction.y + m[2].xyz() * r.direction.z;
+		return single_ray(origin, direction);
+	}
+
+	// simd::width rays as separate coordinate vectors; lanes without a ray have a negative t and never hit
+	struct packet
+	{
+		simd::floatv origin[3];
+		simd::floatv direction[3];
+		simd::floatv inverse[3];
+	};
+
+	struct packet_hits
+	{
+		simd::floatv t;
+		simd::floatv u;
+		simd::floatv v;
+		std::uint32_t instance[simd::width];
+		std::uint32_t triangle[simd::width];
+	};
+
+	float max_lane(simd::floatv x)
+	{
+		float lanes[simd::width];
+		simd::store(lanes, x);
+		return *std::max_element(lanes, lanes + simd::width);
+	}
+
+	// Slab test of one child against all rays of the packet; returns a bit per ray entering it before its
+	// current hit, and the nearest entry distance among them
+	unsigned slab_test(wide_bvh::node const & n, std::size_t k, packet const & p, simd::floatv t_max, float & t_near)
+	{
+		simd::floatv entry = simd::splat(0.f);
+		simd::floatv exit = t_max;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			simd::floatv const a = (simd::splat(n.bounds[axis][k]) - p.origin[axis]) * p.inverse[axis];
+			simd::floatv const b = (simd::splat(n.bounds[3 + axis][k]) - p.origin[axis]) * p.inverse[axis];
+			entry = simd::max(simd::min(a, b), entry);
+			exit = simd::min(simd::max(a, b), exit);
+		}
+
+		unsigned const hits = simd::movemask(exit >= entry);
+		if (hits != 0)
+		{
+			float lanes[simd::width];
+			simd::store(lanes, entry);
+			t_near = inf;
+			for (unsigned bits = hits; bits != 0; bits &= bits - 1)
+				t_near = std::min(t_near, lanes[std::countr_zero(bits)]);
+		}
+		return hits;
+	}
+
+	template <typename Leaf>
+	void traverse(wide_bvh const & hierarchy, packet const & p, packet_hits const & hits, Leaf && leaf)
+	{
+		if (hierarchy.nodes.empty())
+			return;
+
+		traversal_stack storage(hierarchy);
+		stack_entry * stack = storage.data();
+		std::size_t size = 0;
+		stack[size++] = {0, 0, 0.f};
+
+		float t_near[wide_bvh::width];
+		while (size > 0)
+		{
+			stack_entry const entry = stack[--size];
+			if (entry.t > max_lane(hits.t))
+				continue;
+
+			if (entry.count > 0)
+			{
+				leaf(entry.first, entry.count);
+				continue;
+			}
+
+			auto const & n = hierarchy.nodes[entry.first];
+			unsigned entered = 0;
+			for (std::size_t k = 0; k < wide_bvh::width; ++k)
+			{
+				if (n.first[k] == 0 && n.count[k] == 0)
+					continue;
+				if (slab_test(n, k, p, hits.t, t_near[k]) != 0)
+					entered |= 1u << k;
+			}
+			push_children(n, entered, t_near, stack, size);
+		}
+	}
+
+	void intersect(ray_mesh::triangle const & tri, std::uint32_t triangle, std::uint32_t instance, packet const & p, packet_hits & hits)
+	{
+		using simd::floatv;
+
+		floatv const e1[3] = {simd::splat(tri.edge1.x), simd::splat(tri.edge1.y), simd::splat(tri.edge1.z)};
+		floatv const e2[3] = {simd::splat(tri.edge2.x), simd::splat(tri.edge2.y), simd::splat(tri.edge2.z)};
+		floatv const * d = p.direction;
+
+		floatv const pv[3] = {d[1] * e2[2] - e2[1] * d[2], d[2] * e2[0] - e2[2] * d[0], d[0] * e2[1] - e2[0] * d[1]};
+		floatv const inverse_det = simd::splat(1.f) / (e1[0] * pv[0] + e1[1] * pv[1] + e1[2] * pv[2]);
+
+		floatv const s[3] = {p.origin[0] - simd::splat(tri.vertex.x), p.origin[1] - simd::splat(tri.vertex.y), p.origin[2] - simd::splat(tri.vertex.z)};
+		floatv const u = (s[0] * pv[0] + s[1] * pv[1] + s[2] * pv[2]) * inverse_det;
+
+		floatv const q[3] = {s[1] * e1[2] - e1[1] * s[2], s[2] * e1[0] - e1[2] * s[0], s[0] * e1[1] - e1[0] * s[1]};
+		floatv const v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inverse_det;
+		floatv const t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverse_det;
+
+		floatv const zero = simd::splat(0.f);
+		simd::maskv const hit = (u >= zero) & (v >= zero) & (simd::splat(1.f) >= u + v) & (zero < t) & (t < hits.t);
+		unsigned bits = simd::movemask(hit);
+		if (bits == 0)
+			return;
+
+		hits.t = simd::select(hit, t, hits.t);
+		hits.u = simd::select(hit, u, hits.u);
+		hits.v = simd::select(hit, v, hits.v);
+		for (; bits != 0; bits &= bits - 1)
+		{
+			int const lane = std::countr_zero(bits);
+			hits.instance[lane] = instance;
+			hits.triangle[lane] = triangle;
+		}
+	}
+
+	packet to_local(glm::mat4 const & m, packet const & p)
+	{
+		auto s = [&](int column, int row){ return simd::splat(m[column][row]); };
+
+		packet result;
+		for (int row = 0; row < 3; ++row)
+		{
+			result.origin[row] = s(0, row) * p.origin[0] + s(1, row) * p.origin[1] + s(2, row) * p.origin[2] + s(3, row);
+			result.direction[row] = s(0, row) * p.direction[0] + s(1, row) * p.direction[1] + s(2, row) * p.direction[2];
+			result.inverse[row] = simd::splat(1.f) / result.direction[row];
+		}
+		return result;
+	}
+
+}
+
+void wide_bvh::build(aabb_set const & boxes, thread_pool & pool)
+{
+	bvh binary;
+	binary.build(boxes, pool);
+
+	nodes.clear();
+	depth = 0;
+	primitives = std::move(binary.primitives);
+	if (binary.nodes.empty())
+		return;
+
+	nodes.emplace_back();
+	std::vector<collapse_task> tasks{{0, 0, 1}};
+	while (!tasks.empty())
+	{
+		collapse_task const task = tasks.back();
+		tasks.pop_back();
+		depth = std::max(depth, task.depth);
+		collapse(binary, task, nodes, tasks);
+	}
+}
+
+ray_mesh::ray_mesh(std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices, thread_pool & pool)
+	: min(inf)
+	, max(-inf)
+{
+	aabb_set boxes;
+	boxes.reserve(indices.size() / 3);
+	for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		glm::vec3 const & v0 = positions[indices[i]];
+		glm::vec3 const & v1 = positions[indices[i + 1]];
+		glm::vec3 const & v2 = positions[indices[i + 2]];
+		boxes.push_back(glm::min(v0, glm::min(v1, v2)), glm::max(v0, glm::max(v1, v2)));
+
+		min = glm::min(min, glm::min(v0, glm::min(v1, v2)));
+		max = glm::max(max, glm::max(v0, glm::max(v1, v2)));
+	}
+
+	hierarchy.build(boxes, pool);
+
+	triangles.resize(boxes.size());
+	for (std::size_t k = 0; k < triangles.size(); ++k)
+	{
+		std::size_t const i = 3 * hierarchy.primitives[k];
+		glm::vec3 const & v0 = positions[indices[i]];
+		triangles[k] = {v0, positions[indices[i + 1]] - v0, positions[indices[i + 2]] - v0};
+	}
+}
+
+std::uint32_t ray_caster::add_mesh(std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices, thread_pool & pool)
+{
+	meshes.emplace_back(positions, indices, pool);
+	return meshes.size() - 1;
+}
+
+void ray_caster::set_instances(std::vector<std::uint32_t> const & meshes, std::vector<glm::mat4> const & transforms, thread_pool & pool)
+{
+	instance_meshes = meshes;
+	world_to_local.resize(transforms.size());
+
+	aabb_set bounds;
+	bounds.reserve(transforms.size());
+	for (std::size_t i = 0; i < transforms.size(); ++i)
+	{
+		auto const & mesh = this->meshes[meshes[i]];
+
+		glm::vec3 min, max;
+		transform_bounds(transforms[i], mesh.min, mesh.max, min, max);
+		bounds.push_back(min, max);
+
+		world_to_local[i] = glm::inverse(transforms[i]);
+	}
+
+	instances.build(bounds, pool);
+}
+
+ray_hit ray_caster::cast(ray const & r, float t_max) const
+{
+	ray_hit hit;
+	hit.t = t_max;
+
+	single_ray const world(r.origin, r.direction);
+	traverse(instances, world, hit.t, [&](std::uint32_t first, std::uint32_t count)
+	{
+		for (std::uint32_t k = first; k < first + count; ++k)
+		{
+			std::uint32_t const instance = instances.primitives[k];
+			auto const & mesh = meshes[instance_meshes[instance]];
+			single_ray const local = to_local(world_to_local[instance], world);
+
+			traverse(mesh.hierarchy, local, hit.t, [&](std::uint32_t leaf_first, std::uint32_t leaf_count)
+			{
+				for (std::uint32_t j = leaf_first; j < leaf_first + leaf_count; ++j)
+				{
+					float t, u, v;
+					if (intersect(mesh.triangles[j], local, hit.t, t, u, v))
+						hit = {t, instance, mesh.hierarchy.primitives[j], u, v};
+				}
+				return false;
+			});
+		}
+		return false;
+	});
+
+	if (!hit.found())
+		hit.t = inf;
+	return hit;
+}
+
+bool ray_caster::occluded(ray const & r, float t_max) const
+{
+	bool found = false;
+
+	single_ray const world(r.origin, r.direction);
+	traverse(instances, world, t_max, [&](std::uint32_t first, std::uint32_t count)
+	{
+		for (std::uint32_t k = first; k < first + count && !found; ++k)
+		{
+			std::uint32_t const instance = instances.primitives[k];
+			auto const & mesh = meshes[instance_meshes[instance]];
+			single_ray const local = to_local(world_to_local[instance], world);
+
+			traverse(mesh.hierarchy, local, t_max, [&](std::uint32_t leaf_first, std::uint32_t leaf_count)
+			{
+				float t, u, v;
+				for (std::uint32_t j = leaf_first; j < leaf_first + leaf_count && !found; ++j)
+					found = intersect(mesh.triangles[j], local, t_max, t, u, v);
+				return found;
+			});
+		}
+		return found;
+	});
+
+	return found;
+}
+
+void ray_caster::cast(ray const * rays, std::size_t count, ray_hit * hits, float t_max) const
+{
+	for (std::size_t begin = 0; begin < count; begin += simd::width)
+	{
+		std::size_t const lanes = std::min(simd::width, count - begin);
+
+		// Lanes past the end repeat the first ray, so that their arithmetic stays finite
+		float coordinates[9][simd::width];
+		float limits[simd::width];
+		for (std::size_t lane = 0; lane < simd::width; ++lane)
+		{
+			ray const & r = rays[begin + (lane < lanes ? lane : 0)];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				coordinates[axis][lane] = r.origin[axis];
+				coordinates[3 + axis][lane] = r.direction[axis];
+				coordinates[6 + axis][lane] = 1.f / r.direction[axis];
+			}
+			limits[lane] = lane < lanes ? t_max : -1.f;
+		}
+
+		packet world;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			world.origin[axis] = simd::load(coordinates[axis]);
+			world.direction[axis] = simd::load(coordinates[3 + axis]);
+			world.inverse[axis] = simd::load(coordinates[6 + axis]);
+		}
+
+		packet_hits result;
+		result.t = simd::load(limits);
+		result.u = result.v = simd::splat(0.f);
+		std::fill(std::begin(result.instance), std::end(result.instance), ray_hit::none);
+		std::fill(std::begin(result.triangle), std::end(result.triangle), ray_hit::none);
+
+		traverse(instances, world, result, [&](std::uint32_t first, std::uint32_t leaf_count)
+		{
+			for (std::uint32_t k = first; k < first + leaf_count; ++k)
+			{
+				std::uint32_t const instance = instances.primitives[k];
+				auto const & mesh = meshes[instance_meshes[instance]];
+				packet const local = to_local(world_to_local[instance], world);
+
+				traverse(mesh.hierarchy, local, result, [&](std::uint32_t leaf_first, std::uint32_t leaf_count)
+				{
+					for (std::uint32_t j = leaf_first; j < leaf_first + leaf_count; ++j)
+						intersect(mesh.triangles[j], mesh.hierarchy.primitives[j], instance, local, result);
+				});
+			}
+		});
+
+		float t[simd::width], u[simd::width], v[simd::width];
+		simd::store(t, result.t);
+		simd::store(u, result.u);
+		simd::store(v, result.v);
+		for (std::size_t lane = 0; lane < lanes; ++lane)
+		{
+			if (result.instance[lane] == ray_hit::none)
+				hits[begin + lane] = ray_hit{};
+			else
+				hits[begin + lane] = {t[lane], result.instance[lane], result.triangle[lane], u[lane], v[lane]};
+		}
+	}
+}
+
+void ray_caster::cast(ray const * rays, std::size_t count, ray_hit * hits, thread_pool & pool, float t_max) const
+{
+	pool.parallel_for(count, 64 * simd::width, [&](std::size_t begin, std::size_t end)
+	{
+		cast(rays + begin, end - begin, hits + begin, t_max);
+	});
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <vector>
+#include <limits>
+#include <cstddef>
+#include <cstdint>
+
+#include "culling.hpp"
+#include "simd.hpp"
+#include "thread_pool.hpp"
+
+struct ray
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+};
+
+struct ray_hit
+{
+	static constexpr std::uint32_t none = -1;
+
+	// Distance along the ray in units of the length of its direction
+	float t = std::numeric_limits<float>::infinity();
+
+	std::uint32_t instance = none;
+	std::uint32_t triangle = none;
+
+	// Barycentric weights of the second and the third vertex of the triangle at the hit point
+	float u = 0.f;
+	float v = 0.f;
+
+	bool found() const { return instance != none; }
+};
+
+// Hierarchy for ray traversal: a bvh built with the binned surface area heuristic and collapsed so
+// that every node holds up to `width` children as separate coordinate arrays, which a single ray
+// tests with one slab test per simd vector
+struct wide_bvh
+{
+	static constexpr std::size_t width = simd::width < 4 ? 4 : simd::width;
+
+	struct node
+	{
+		// bounds[axis][k] is the minimum of child k along the axis and bounds[3 + axis][k] its maximum
+		float bounds[6][width];
+
+		// An inner child is node first[k] and has a zero count, a leaf covers primitives[first[k] .. first[k] + count[k]);
+		// unused slots have empty bounds and are neither, with both zero, as the root is nobody's child
+		std::uint32_t first[width];
+		std::uint32_t count[width];
+	};
+
+	std::vector<node> nodes;
+
+	// Box indices in leaf order
+	std::vector<std::uint32_t> primitives;
+
+	// Number of node levels, which bounds the size of traversal stacks
+	std::size_t depth = 0;
+
+	void build(aabb_set const & boxes, thread_pool & pool);
+};
+
+// Triangle mesh prepared for ray casting: a wide_bvh over its triangles, which are stored in the
+// hierarchy's leaf order as a vertex and two edges, as the Möller–Trumbore test takes them
+struct ray_mesh
+{
+	struct triangle
+	{
+		glm::vec3 vertex;
+		glm::vec3 edge1;
+		glm::vec3 edge2;
+	};
+
+	wide_bvh hierarchy;
+	std::vector<triangle> triangles;
+
+	glm::vec3 min;
+	glm::vec3 max;
+
+	// Triangles are given by triples of indices into `positions`, as in obj_data or a glTF index buffer
+	ray_mesh(std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices, thread_pool & pool);
+};
+
+// Ray queries against instanced meshes through a two-level hierarchy: a wide_bvh over the world bounds of
+// the instances, and the ray_mesh of each mesh, which rays enter in the instance's local space. Directions
+// are transformed without normalizing, so distances along a ray are the same in both spaces.
+class ray_caster
+{
+public:
+	// Adds a mesh given as in ray_mesh and returns its index
+	std::uint32_t add_mesh(std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices, thread_pool & pool);
+
+	// Replaces all instances and rebuilds the top level: instance i places mesh meshes[i] with transforms[i]
+	void set_instances(std::vector<std::uint32_t> const & meshes, std::vector<glm::mat4> const & transforms, thread_pool & pool);
+
+	std::size_t instance_count() const { return instance_meshes.size(); }
+
+	// The nearest hit along the ray closer than t_max, if any
+	ray_hit cast(ray const & r, float t_max = std::numeric_limits<float>::infinity()) const;
+
+	// Whether anything lies along the ray closer than t_max, for line of sight; stops at the first hit found
+	bool occluded(ray const & r, float t_max) const;
+
+	// Nearest hits of many rays, traced in packets of simd::width consecutive rays that share one traversal
+	// and are tested together against each node and triangle; fastest when neighbouring rays are coherent,
+	// such as camera rays through neighbouring pixels
+	void cast(ray const * rays, std::size_t count, ray_hit * hits, float t_max = std::numeric_limits<float>::infinity()) const;
+
+	// The same, with chunks of rays split across the pool
+	void cast(ray const * rays, std::size_t count, ray_hit * hits, thread_pool & pool, float t_max = std::numeric_limits<float>::infinity()) const;
+
+private:
+	std::vector<ray_mesh> meshes;
+
+	std::vector<std::uint32_t> instance_meshes;
+	std::vector<glm::mat4> world_to_local;
+	wide_bvh instances;
+};
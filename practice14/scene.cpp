@@ -0,0 +1,132 @@
+#include "scene.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+scene::scene(std::vector<gltf_model::node> const & nodes)
+	: subtree_ends(nodes.size())
+	, world(nodes.size())
+	, dirty(nodes.size(), 0)
+{
+	names.reserve(nodes.size());
+	parents.reserve(nodes.size());
+	meshes.reserve(nodes.size());
+	translations.reserve(nodes.size());
+	rotations.reserve(nodes.size());
+	scales.reserve(nodes.size());
+	instance_offsets.reserve(nodes.size() + 1);
+	instance_offsets.push_back(0);
+
+	for (auto const & node : nodes)
+	{
+		assert(node.parent == gltf_model::node::no_parent || node.parent < parents.size());
+
+		names.push_back(node.name);
+		parents.push_back(node.parent);
+		meshes.push_back(node.mesh ? *node.mesh : no_mesh);
+		translations.push_back(node.translation);
+		rotations.push_back(node.rotation);
+		scales.push_back(node.scale);
+
+		instance_transforms.insert(instance_transforms.end(), node.instances.begin(), node.instances.end());
+		instance_offsets.push_back(instance_transforms.size());
+	}
+
+	// A subtree ends where the next node outside of it starts
+	for (std::uint32_t i = node_count(); i --> 0;)
+	{
+		subtree_ends[i] = std::max(subtree_ends[i], i + 1);
+		if (parents[i] != no_parent)
+			subtree_ends[parents[i]] = std::max(subtree_ends[parents[i]], subtree_ends[i]);
+	}
+
+	for (std::uint32_t i = 0; i < node_count(); ++i)
+		if (parents[i] == no_parent)
+			mark_dirty(i);
+	update();
+}
+
+void scene::set_translation(std::uint32_t node, glm::vec3 const & translation)
+{
+	translations[node] = translation;
+	mark_dirty(node);
+}
+
+void scene::set_rotation(std::uint32_t node, glm::quat const & rotation)
+{
+	rotations[node] = rotation;
+	mark_dirty(node);
+}
+
+void scene::set_scale(std::uint32_t node, glm::vec3 const & scale)
+{
+	scales[node] = scale;
+	mark_dirty(node);
+}
+
+void scene::mark_dirty(std::uint32_t node)
+{
+	if (!dirty[node])
+	{
+		dirty[node] = 1;
+		dirty_nodes.push_back(node);
+	}
+}
+
+std::size_t scene::update()
+{
+	if (dirty_nodes.empty())
+		return 0;
+
+	std::sort(dirty_nodes.begin(), dirty_nodes.end());
+
+	std::size_t updated = 0;
+	std::uint32_t done = 0;
+	for (std::uint32_t root : dirty_nodes)
+	{
+		dirty[root] = 0;
+
+		// Nested inside a subtree that was just recomputed
+		if (root < done)
+			continue;
+
+		done = subtree_ends[root];
+		for (std::uint32_t i = root; i < done; ++i)
+		{
+			glm::mat4 local = glm::toMat4(rotations[i]);
+			local[0] *= scales[i].x;
+			local[1] *= scales[i].y;
+			local[2] *= scales[i].z;
+			local[3] = glm::vec4(translations[i], 1.f);
+
+			world[i] = (parents[i] == no_parent) ? local : world[parents[i]] * local;
+		}
+		updated += done - root;
+	}
+
+	dirty_nodes.clear();
+	return updated;
+}
+
+void collect_instances(scene const & scene, std::size_t mesh_count, std::vector<instance_batch> & batches)
+{
+	batches.resize(mesh_count);
+	for (auto & batch : batches)
+		batch.transforms.clear();
+
+	for (std::uint32_t i = 0; i < scene.node_count(); ++i)
+	{
+		if (scene.meshes[i] == scene::no_mesh)
+			continue;
+
+		auto & transforms = batches[scene.meshes[i]].transforms;
+
+		std::uint32_t const begin = scene.instance_offsets[i];
+		std::uint32_t const end = scene.instance_offsets[i + 1];
+		if (begin == end)
+			transforms.push_back(scene.world[i]);
+		else
+			for (std::uint32_t j = begin; j < end; ++j)
+				transforms.push_back(scene.world[i] * scene.instance_transforms[j]);
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "gltf_loader.hpp"
+
+// Node hierarchy flattened in depth-first order, so that parents precede their children and every
+// subtree is a contiguous range of nodes. Local transforms are stored as separate translation,
+// rotation and scale arrays next to the world matrices. Changing a local transform marks the node
+// dirty, and update() recomputes only the world matrices of dirty subtrees.
+struct scene
+{
+	static constexpr std::uint32_t no_parent = -1;
+	static constexpr std::uint32_t no_mesh = -1;
+
+	std::vector<std::string> names;
+	std::vector<std::uint32_t> parents;
+	std::vector<std::uint32_t> subtree_ends;
+	std::vector<std::uint32_t> meshes;
+
+	std::vector<glm::vec3> translations;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+
+	std::vector<glm::mat4> world;
+
+	// Node-relative EXT_mesh_gpu_instancing transforms of node i are
+	// instance_transforms[instance_offsets[i] .. instance_offsets[i + 1])
+	std::vector<std::uint32_t> instance_offsets;
+	std::vector<glm::mat4> instance_transforms;
+
+	explicit scene(std::vector<gltf_model::node> const & nodes);
+
+	std::size_t node_count() const { return parents.size(); }
+
+	void set_translation(std::uint32_t node, glm::vec3 const & translation);
+	void set_rotation(std::uint32_t node, glm::quat const & rotation);
+	void set_scale(std::uint32_t node, glm::vec3 const & scale);
+
+	// Recomputes world matrices of dirty subtrees; returns the number of recomputed nodes
+	std::size_t update();
+
+private:
+	void mark_dirty(std::uint32_t node);
+
+	std::vector<std::uint8_t> dirty;
+	std::vector<std::uint32_t> dirty_nodes;
+};
+
+// All draws of one mesh: world matrices of the nodes referencing it, expanded by their instance transforms
+struct instance_batch
+{
+	std::vector<glm::mat4> transforms;
+};
+
+// Groups every mesh reference of the scene by mesh, so that each mesh takes one instanced draw;
+// batches[mesh] is left empty for unreferenced meshes, and the storage of `batches` is reused between calls
+void collect_instances(scene const & scene, std::size_t mesh_count, std::vector<instance_batch> & batches);
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SIMD_SSE2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SIMD_SSE2
+#endif
+
+// Thin wrapper over the widest float vector available at compile time.
+// All operations are plain IEEE arithmetic (no approximate rsqrt/rcp), so results
+// are bit-identical between the vector and scalar paths and between CPUs.
+namespace simd
+{
+
+#if defined(__AVX__)
+
+    static constexpr std::size_t width = 8;
+
+    struct floatv { __m256 v; };
+
+    inline floatv load(float const * p) { return {_mm256_loadu_ps(p)}; }
+    inline void store(float * p, floatv a) { _mm256_storeu_ps(p, a.v); }
+    inline floatv splat(float x) { return {_mm256_set1_ps(x)}; }
+
+    inline floatv operator + (floatv a, floatv b) { return {_mm256_add_ps(a.v, b.v)}; }
+    inline floatv operator - (floatv a, floatv b) { return {_mm256_sub_ps(a.v, b.v)}; }
+    inline floatv operator * (floatv a, floatv b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    inline floatv operator / (floatv a, floatv b) { return {_mm256_div_ps(a.v, b.v)}; }
+
+    inline floatv min(floatv a, floatv b) { return {_mm256_min_ps(a.v, b.v)}; }
+    inline floatv max(floatv a, floatv b) { return {_mm256_max_ps(a.v, b.v)}; }
+    inline floatv sqrt(floatv a) { return {_mm256_sqrt_ps(a.v)}; }
+
+    // a with its sign flipped wherever b is negative
+    inline floatv mulsign(floatv a, floatv b) { return {_mm256_xor_ps(a.v, _mm256_and_ps(b.v, _mm256_set1_ps(-0.f)))}; }
+
+    // Per-lane comparison results; movemask() packs them into an integer, lane i into bit i
+    struct maskv { __m256 v; };
+
+    inline maskv operator < (floatv a, floatv b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+    inline maskv operator >= (floatv a, floatv b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+    inline maskv operator & (maskv a, maskv b) { return {_mm256_and_ps(a.v, b.v)}; }
+    inline maskv operator | (maskv a, maskv b) { return {_mm256_or_ps(a.v, b.v)}; }
+    inline unsigned movemask(maskv a) { return _mm256_movemask_ps(a.v); }
+
+    // a where the mask is set, b elsewhere
+    inline floatv select(maskv m, floatv a, floatv b) { return {_mm256_blendv_ps(b.v, a.v, m.v)}; }
+
+#elif defined(SIMD_SSE2)
+
+    static constexpr std::size_t width = 4;
+
+    struct floatv { __m128 v; };
+
+    inline floatv load(float const * p) { return {_mm_loadu_ps(p)}; }
+    inline void store(float * p, floatv a) { _mm_storeu_ps(p, a.v); }
+    inline floatv splat(float x) { return {_mm_set1_ps(x)}; }
+
+    inline floatv operator + (floatv a, floatv b) { return {_mm_add_ps(a.v, b.v)}; }
+    inline floatv operator - (floatv a, floatv b) { return {_mm_sub_ps(a.v, b.v)}; }
+    inline floatv operator * (floatv a, floatv b) { return {_mm_mul_ps(a.v, b.v)}; }
+    inline floatv operator / (floatv a, floatv b) { return {_mm_div_ps(a.v, b.v)}; }
+
+    inline floatv min(floatv a, floatv b) { return {_mm_min_ps(a.v, b.v)}; }
+    inline floatv max(floatv a, floatv b) { return {_mm_max_ps(a.v, b.v)}; }
+    inline floatv sqrt(floatv a) { return {_mm_sqrt_ps(a.v)}; }
+
+    inline floatv mulsign(floatv a, floatv b) { return {_mm_xor_ps(a.v, _mm_and_ps(b.v, _mm_set1_ps(-0.f)))}; }
+
+    struct maskv { __m128 v; };
+
+    inline maskv operator < (floatv a, floatv b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+    inline maskv operator >= (floatv a, floatv b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+    inline maskv operator & (maskv a, maskv b) { return {_mm_and_ps(a.v, b.v)}; }
+    inline maskv operator | (maskv a, maskv b) { return {_mm_or_ps(a.v, b.v)}; }
+    inline unsigned movemask(maskv a) { return _mm_movemask_ps(a.v); }
+
+    inline floatv select(maskv m, floatv a, floatv b) { return {_mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v))}; }
+
+#else
+
+    static constexpr std::size_t width = 1;
+
+    struct floatv { float v; };
+
+    inline floatv load(float const * p) { return {*p}; }
+    inline void store(float * p, floatv a) { *p = a.v; }
+    inline floatv splat(float x) { return {x}; }
+
+    inline floatv operator + (floatv a, floatv b) { return {a.v + b.v}; }
+    inline floatv operator - (floatv a, floatv b) { return {a.v - b.v}; }
+    inline floatv operator * (floatv a, floatv b) { return {a.v * b.v}; }
+    inline floatv operator / (floatv a, floatv b) { return {a.v / b.v}; }
+
+    inline floatv min(floatv a, floatv b) { return {a.v < b.v ? a.v : b.v}; }
+    inline floatv max(floatv a, floatv b) { return {a.v > b.v ? a.v : b.v}; }
+    inline floatv sqrt(floatv a) { return {std::sqrt(a.v)}; }
+
+    inline floatv mulsign(floatv a, floatv b) { return {std::signbit(b.v) ? -a.v : a.v}; }
+
+    struct maskv { bool v; };
+
+    inline maskv operator < (floatv a, floatv b) { return {a.v < b.v}; }
+    inline maskv operator >= (floatv a, floatv b) { return {a.v >= b.v}; }
+    inline maskv operator & (maskv a, maskv b) { return {a.v && b.v}; }
+    inline maskv operator | (maskv a, maskv b) { return {a.v || b.v}; }
+    inline unsigned movemask(maskv a) { return a.v ? 1u : 0u; }
+
+    inline floatv select(maskv m, floatv a, floatv b) { return m.v ? a : b; }
+
+#endif
+
+    // Fixed four-lane vector for per-matrix arithmetic (e.g. one matrix column), independent of simd::width
+#if defined(SIMD_SSE2)
+
+    struct float4 { __m128 v; };
+
+    inline float4 load4(float const * p) { return {_mm_loadu_ps(p)}; }
+    inline float4 load3(float const * p) { return {_mm_movelh_ps(_mm_loadl_pi(_mm_setzero_ps(), reinterpret_cast<__m64 const *>(p)), _mm_load_ss(p + 2))}; }
+    inline void store(float * p, float4 a) { _mm_storeu_ps(p, a.v); }
+    inline void store3(float * p, float4 a) { _mm_storel_pi(reinterpret_cast<__m64 *>(p), a.v); _mm_store_ss(p + 2, _mm_movehl_ps(a.v, a.v)); }
+    inline float4 splat4(float x) { return {_mm_set1_ps(x)}; }
+
+    inline float4 operator + (float4 a, float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+    inline float4 operator * (float4 a, float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+
+#else
+
+    struct float4 { float v[4]; };
+
+    inline float4 load4(float const * p) { return {{p[0], p[1], p[2], p[3]}}; }
+    inline float4 load3(float const * p) { return {{p[0], p[1], p[2], 0.f}}; }
+    inline void store(float * p, float4 a) { for (int i = 0; i < 4; ++i) p[i] = a.v[i]; }
+    inline void store3(float * p, float4 a) { for (int i = 0; i < 3; ++i) p[i] = a.v[i]; }
+    inline float4 splat4(float x) { return {{x, x, x, x}}; }
+
+    inline float4 operator + (float4 a, float4 b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+    inline float4 operator * (float4 a, float4 b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+
+#endif
+
+    inline floatv lerp(floatv a, floatv b, floatv t)
+    {
+        return a + (b - a) * t;
+    }
+
+    // Number of floats needed to hold `count` values padded to a whole number of vectors
+    inline std::size_t padded(std::size_t count)
+    {
+        return (count + width - 1) / width * width;
+    }
+
+}
@@ -0,0 +1,199 @@
+#include "temporal_culling.hpp"
+#include "simd.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+void temporal_culler::reset()
+{
+	has_previous = false;
+	rotation = 0.f;
+	motion = 0.f;
+	swept = 0.f;
+	std::fill(budgets.begin(), budgets.end(), -std::numeric_limits<float>::infinity());
+	std::fill(group_budgets.begin(), group_budgets.end(), -std::numeric_limits<float>::infinity());
+	std::fill(visible_bits.begin(), visible_bits.end(), 0);
+	std::fill(rejecting_planes.begin(), rejecting_planes.end(), no_plane);
+}
+
+std::size_t temporal_culler::cull(frustum const & frustum, glm::vec3 const & eye, aabb_set const & boxes, std::uint32_t * visible)
+{
+	std::size_t const size = boxes.size();
+	if (weights.size() != size)
+	{
+		weights.resize(size);
+		budgets.resize(size);
+		visible_bits.resize((size + 63) / 64);
+		rejecting_planes.resize(size);
+		group_weights.resize(visible_bits.size());
+		group_budgets.resize(visible_bits.size());
+		reset();
+	}
+
+	// With unit normals, plane values are distances
+	std::array<glm::vec4, 6> planes;
+	for (std::size_t j = 0; j < 6; ++j)
+		planes[j] = frustum.planes[j] / glm::length(glm::vec3(frustum.planes[j]));
+
+	// A point at distance r from the eye moves relative to plane j by at most
+	// |n' - n| r + |eye' - eye| + |(n' . eye' + d') - (n . eye + d)|
+	if (has_previous)
+	{
+		float max_rotation = 0.f;
+		float max_offset = 0.f;
+		for (std::size_t j = 0; j < 6; ++j)
+		{
+			glm::vec3 const n = planes[j];
+			glm::vec3 const previous_n = previous_planes[j];
+			max_rotation = std::max(max_rotation, glm::length(n - previous_n));
+			max_offset = std::max(max_offset, std::abs((glm::dot(n, eye) + planes[j].w) - (glm::dot(previous_n, previous_eye) + previous_planes[j].w)));
+		}
+		rotation += max_rotation;
+		motion += glm::length(eye - previous_eye) + max_offset;
+		swept += max_rotation * motion;
+	}
+
+	// Keep the sums small enough for float budgets to stay accurate
+	if (rotation > 16.f || motion > 4096.f || swept > 65536.f)
+		reset();
+
+	has_previous = true;
+	previous_planes = planes;
+	previous_eye = eye;
+
+	stats = {};
+
+	float const offset = swept + motion;
+	simd::floatv const rotation_v = simd::splat(rotation);
+	simd::floatv const offset_v = simd::splat(offset);
+
+	std::size_t count = 0;
+	auto visit = [&](std::size_t i, bool skipped)
+	{
+		if (skipped)
+		{
+			++stats.skipped;
+			if ((visible_bits[i / 64] >> (i % 64)) & 1u)
+				visible[count++] = i;
+		}
+		else if (test(i, boxes, eye, planes))
+			visible[count++] = i;
+	};
+
+	for (std::size_t group = 0; group < visible_bits.size(); ++group)
+	{
+		std::size_t const begin = group * 64;
+		std::size_t const end = std::min(begin + 64, size);
+
+		if (group_weights[group] * rotation + offset < group_budgets[group])
+		{
+			stats.skipped += end - begin;
+			for (std::uint64_t bits = visible_bits[group]; bits; bits &= bits - 1)
+				visible[count++] = begin + std::countr_zero(bits);
+			continue;
+		}
+
+		std::size_t i = begin;
+		for (; i + simd::width <= end; i += simd::width)
+		{
+			unsigned const skipped = simd::movemask(rotation_v * simd::load(weights.data() + i) + offset_v < simd::load(budgets.data() + i));
+			unsigned const lanes = (1u << simd::width) - 1;
+			if (skipped == lanes)
+			{
+				unsigned const bits = (visible_bits[group] >> (i - begin)) & lanes;
+				for (std::size_t lane = 0; lane < simd::width; ++lane)
+				{
+					visible[count] = i + lane;
+					count += (bits >> lane) & 1u;
+				}
+				stats.skipped += simd::width;
+				continue;
+			}
+
+			for (std::size_t lane = 0; lane < simd::width; ++lane)
+				visit(i + lane, (skipped >> lane) & 1u);
+		}
+
+		for (; i < end; ++i)
+			visit(i, weights[i] * rotation + offset < budgets[i]);
+
+		group_weights[group] = *std::max_element(weights.begin() + begin, weights.begin() + end);
+		group_budgets[group] = *std::min_element(budgets.begin() + begin, budgets.begin() + end);
+	}
+
+	return count;
+}
+
+bool temporal_culler::test(std::size_t i, aabb_set const & boxes, glm::vec3 const & eye, std::array<glm::vec4, 6> const & planes)
+{
+	float const min[3] = {boxes.min_x[i], boxes.min_y[i], boxes.min_z[i]};
+	float const max[3] = {boxes.max_x[i], boxes.max_y[i], boxes.max_z[i]};
+
+	// Distance of the p-vertex to plane j
+	auto distance = [&](std::size_t j)
+	{
+		glm::vec4 const & plane = planes[j];
+		return plane.x * (plane.x >= 0.f ? max[0] : min[0]) + plane.y * (plane.y >= 0.f ? max[1] : min[1])
+			+ plane.z * (plane.z >= 0.f ? max[2] : min[2]) + plane.w;
+	};
+
+	// Distance from the eye to the farthest corner
+	glm::vec3 far;
+	for (int k = 0; k < 3; ++k)
+		far[k] = std::max(std::abs(min[k] - eye[k]), std::abs(max[k] - eye[k]));
+	float const radius = glm::length(far);
+	weights[i] = radius - motion;
+	float const spent = weights[i] * rotation + swept + motion;
+
+	std::uint64_t & bits = visible_bits[i / 64];
+	std::uint64_t const bit = std::uint64_t(1) << (i % 64);
+
+	auto reject = [&](std::size_t j, float outside)
+	{
+		bits &= ~bit;
+		rejecting_planes[i] = j;
+		budgets[i] = spent + outside;
+		return false;
+	};
+
+	std::uint8_t const cached = rejecting_planes[i];
+	if (cached != no_plane)
+	{
+		float const d = distance(cached);
+		if (d < 0.f)
+		{
+			++stats.cached_plane;
+			return reject(cached, -d);
+		}
+	}
+
+	++stats.full_tests;
+
+	// Smallest distance of the p-vertex inside a plane, and the plane it is farthest outside of
+	float inside = std::numeric_limits<float>::infinity();
+	float outside = 0.f;
+	std::size_t rejecting = no_plane;
+	for (std::size_t j = 0; j < 6; ++j)
+	{
+		float const p = distance(j);
+		if (p < -outside)
+		{
+			outside = -p;
+			rejecting = j;
+		}
+		inside = std::min(inside, p);
+	}
+
+	if (rejecting != no_plane)
+		return reject(rejecting, outside);
+
+	// The box stays visible until some plane has moved past its p-vertex
+	bits |= bit;
+	rejecting_planes[i] = no_plane;
+	budgets[i] = spent + inside;
+	return true;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <array>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "culling.hpp"
+
+// Frustum culling that carries its results over between frames. Every box remembers whether it was
+// visible, which plane rejected it, and how far it was from changing state: the smallest distance of its
+// p-vertex inside a plane, or its distance outside of the rejecting plane. The culler bounds how far any plane could have moved
+// over a box since the box was tested, from the rotation of the plane normals and the motion of the
+// eye, and skips the box while that bound stays below its distance. Boxes that must be retested try
+// their last rejecting plane first. The result is that of cull(frustum, aabb_set, ...) without `exact`.
+class temporal_culler
+{
+public:
+	struct statistics
+	{
+		std::size_t skipped = 0;
+		std::size_t cached_plane = 0;
+		std::size_t full_tests = 0;
+	};
+
+	// Writes the indices of visible boxes, in increasing order, to `visible`, which must have room for
+	// boxes.size() entries, and returns their count. `eye` is the camera position of the frustum
+	std::size_t cull(frustum const & frustum, glm::vec3 const & eye, aabb_set const & boxes, std::uint32_t * visible);
+
+	// Retests every box on the next call; needed whenever boxes move
+	void reset();
+
+	// Work done by the last call
+	statistics const & last_statistics() const { return stats; }
+
+private:
+	static constexpr std::uint8_t no_plane = 0xff;
+
+	// Bounds on the motion of the planes, summed over frames since the last reset. rotation sums the
+	// largest change of a unit plane normal, motion the distance moved by the eye plus the largest change
+	// of a plane's distance to the eye, and swept sums rotation times motion so far; a box at distance r
+	// from the eye when motion was m0 is later at most r + motion - m0 away, so planes have moved over it
+	// by at most (r - m0) * rotation + swept + motion, minus the same sum at the time it was tested
+	float rotation = 0.f;
+	float motion = 0.f;
+	float swept = 0.f;
+
+	bool has_previous = false;
+	std::array<glm::vec4, 6> previous_planes;
+	glm::vec3 previous_eye;
+
+	// Box i is skipped while weights[i] * rotation + swept + motion < budgets[i]
+	std::vector<float> weights;
+	std::vector<float> budgets;
+	std::vector<std::uint64_t> visible_bits;
+	std::vector<std::uint8_t> rejecting_planes;
+
+	// The largest weight and smallest budget of the 64 boxes of each visible_bits word,
+	// so that a group in which no box needs a test is skipped with a single comparison
+	std::vector<float> group_weights;
+	std::vector<float> group_budgets;
+
+	bool test(std::size_t i, aabb_set const & boxes, glm::vec3 const & eye, std::array<glm::vec4, 6> const & planes);
+
+	statistics stats;
+};
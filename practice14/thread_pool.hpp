@@ -0,0 +1,57 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <type_traits>
+
+// Fixed set of worker threads running one data-parallel loop at a time.
+// The calling thread takes part in the work, and dispatching a loop never allocates.
+class thread_pool
+{
+public:
+    explicit thread_pool(std::size_t thread_count = std::thread::hardware_concurrency());
+    ~thread_pool();
+
+    thread_pool(thread_pool const &) = delete;
+    thread_pool & operator = (thread_pool const &) = delete;
+
+    // Number of threads doing the work, including the calling one
+    std::size_t size() const { return workers.size() + 1; }
+
+    // Calls f(begin, end) for consecutive chunks of [0, count) and returns once all of them are done
+    template <typename F>
+    void parallel_for(std::size_t count, std::size_t chunk_size, F && f)
+    {
+        using function = std::remove_reference_t<F>;
+        run(count, chunk_size, [](void * context, std::size_t begin, std::size_t end)
+        {
+            (*static_cast<function *>(context))(begin, end);
+        }, &f);
+    }
+
+private:
+    using task_function = void (*)(void *, std::size_t, std::size_t);
+
+    void run(std::size_t count, std::size_t chunk_size, task_function function, void * context);
+    void work();
+    void worker_loop();
+
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::size_t generation = 0;
+    std::size_t busy = 0;
+    bool stop = false;
+
+    task_function task = nullptr;
+    void * task_context = nullptr;
+    std::size_t task_count = 0;
+    std::size_t task_chunk_size = 1;
+    std::atomic<std::size_t> next{0};
+};
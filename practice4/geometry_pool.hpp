@@ -0,0 +1,72 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Vertices and indices of many meshes suballocated from one vertex buffer and one index buffer,
+// which share a single vertex format and a single VAO. Meshes are drawn with base-vertex calls,
+// so switching between them costs no VAO or buffer binds, and consecutive draws with the same
+// state collapse into one glMultiDrawElementsBaseVertex call.
+class geometry_pool
+{
+public:
+    struct attribute
+    {
+        GLuint index;
+        GLint size;
+        GLenum type;
+        bool normalized = false;
+        // Read with glVertexAttribIPointer
+        bool integer = false;
+        std::size_t offset;
+    };
+
+    // Where a mesh lives in the pool; indices are relative to base_vertex
+    struct range
+    {
+        GLint base_vertex = 0;
+        GLsizei index_count = 0;
+        std::size_t first_index = 0;
+    };
+
+    geometry_pool(std::size_t vertex_size, std::vector<attribute> const & attributes, std::size_t vertex_capacity, std::size_t index_capacity);
+    ~geometry_pool();
+
+    geometry_pool(geometry_pool const &) = delete;
+    geometry_pool & operator = (geometry_pool const &) = delete;
+
+    // Copies a mesh into the pool; throws when it doesn't fit
+    range add(void const * vertices, std::size_t vertex_count, std::uint32_t const * indices, std::size_t index_count);
+
+    void bind() const;
+
+    // The pool must be bound
+    void draw(range const & range, GLsizei instance_count = 1) const;
+    void draw(range const * ranges, std::size_t count);
+
+    GLuint vertex_buffer() const { return vbo; }
+    GLuint index_buffer() const { return ebo; }
+    GLuint vertex_array() const { return vao; }
+    std::size_t vertex_size() const { return stride; }
+    std::size_t vertex_count() const { return vertices_used; }
+    std::size_t index_count() const { return indices_used; }
+
+private:
+    std::size_t stride;
+    std::size_t vertex_capacity;
+    std::size_t index_capacity;
+    std::size_t vertices_used = 0;
+    std::size_t indices_used = 0;
+
+    GLuint vao;
+    GLuint vbo;
+    GLuint ebo;
+
+    // Argument arrays of the multi-draw call, reused between calls
+    std::vector<GLsizei> counts;
+    std::vector<void const *> offsets;
+    std::vector<GLint> base_vertices;
+};
@@ -15,6 +15,7 @@
 #include <map>
 
 #include "obj_parser.hpp"
+#include "geometry_pool.hpp"
 
 
 namespace mth
@@ -239,9 +240,7 @@ GLuint create_program(GLuint vertex_shader, GLuint fragment_shader)
 class bunny {
 public:
     obj_data *model_data;
-    GLuint vao;
-    GLuint vbo;
-    GLuint ebo;
+    geometry_pool::range range;
 
     float bunny_x = 0;
     float bunny_y = 0;
@@ -249,24 +248,7 @@ public:
 
     mth::matr<float> transform = mth::matr<float>::Identity();
 
-    bunny(obj_data *bunny) : model_data(bunny) {
-        glGenVertexArrays(1, &vao);
-
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, bunny->vertices.size() * sizeof(bunny->vertices[0]), bunny->vertices.data(), GL_STATIC_DRAW);
-
-        glBindVertexArray(vao);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void*)(0));
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void*)(12));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void*)(24));
-
-        glGenBuffers(1, &ebo);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, bunny->indices.size() * sizeof(bunny->indices[0]), bunny->indices.data(), GL_STATIC_DRAW);
+    bunny(obj_data *bunny, geometry_pool::range range) : model_data(bunny), range(range) {
     }
 
     void response(float dt, std::map<SDL_Keycode, bool> &button_down) {
@@ -339,10 +321,18 @@ int main() try
     std::string project_root = PROJECT_ROOT;
     obj_data bunny_data = parse_obj(project_root + "/bunny.obj");
 
+    // The bunnies share one copy of bunny_data in the geometry pool, and all draws use the pool's VAO
+    geometry_pool pool(sizeof(obj_data::vertex), {
+        {0, 3, GL_FLOAT, false, false, offsetof(obj_data::vertex, position)},
+        {1, 3, GL_FLOAT, false, false, offsetof(obj_data::vertex, normal)},
+        {2, 2, GL_FLOAT, false, false, offsetof(obj_data::vertex, texcoord)},
+    }, bunny_data.vertices.size(), bunny_data.indices.size());
+    auto const bunny_range = pool.add(bunny_data.vertices.data(), bunny_data.vertices.size(), bunny_data.indices.data(), bunny_data.indices.size());
+
     std::vector<bunny> obj;
-    obj.emplace_back(&bunny_data);
-    obj.emplace_back(&bunny_data);
-    obj.emplace_back(&bunny_data);
+    obj.emplace_back(&bunny_data, bunny_range);
+    obj.emplace_back(&bunny_data, bunny_range);
+    obj.emplace_back(&bunny_data, bunny_range);
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
@@ -404,15 +394,15 @@ int main() try
         obj[1].transform = mth::matr<float>::RotateY(time * 2);
         obj[2].transform = mth::matr<float>::RotateZ(time * 4);
         int cnt = -1;
+        pool.bind();
         for (auto &b: obj) {
             b.response(dt, button_down);
             b.transform = mth::matr<float>::Translate(b.bunny_x + cnt++, b.bunny_y, 0) * mth::matr<float>::Scale(scale) * b.transform;
 
-            glBindVertexArray(b.vao);
             glUniformMatrix4fv(model_location, 1, GL_TRUE, b.transform);
             glUniformMatrix4fv(view_location, 1, GL_TRUE, v);
             glUniformMatrix4fv(projection_location, 1, GL_TRUE, p);
-            glDrawElements(GL_TRIANGLES, b.model_data->indices.size(), GL_UNSIGNED_INT, (void*)(0));
+            pool.draw(b.range);
 
             b.transform = mth::matr<float>::Identity();
         }
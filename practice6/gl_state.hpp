@@ -0,0 +1,89 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+// Shadows the GL state that rendering code sets over and over (program, VAO, framebuffers, textures
+// per unit, enable bits, depth mask, viewport, clear color and uniform values) and only forwards
+// the calls that change it. State starts out unknown, so the first call of each kind always goes
+// through. Code that changes the same state with direct GL calls must call invalidate() afterwards.
+class gl_state
+{
+public:
+    struct statistics
+    {
+        // GL calls made by this layer, and calls skipped because they wouldn't change anything
+        std::size_t issued = 0;
+        std::size_t elided = 0;
+    };
+
+    void use_program(GLuint program);
+    void bind_vertex_array(GLuint vao);
+    // GL_FRAMEBUFFER binds both the draw and the read framebuffer
+    void bind_framebuffer(GLenum target, GLuint framebuffer);
+    void bind_texture(GLuint unit, GLenum target, GLuint texture);
+
+    void set_enabled(GLenum capability, bool enabled);
+    void enable(GLenum capability) { set_enabled(capability, true); }
+    void disable(GLenum capability) { set_enabled(capability, false); }
+    void depth_mask(bool enabled);
+    void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+    void clear_color(float r, float g, float b, float a);
+
+    // Uniforms of the current program, compared by value
+    void uniform(GLint location, int value);
+    void uniform(GLint location, float value);
+    void uniform(GLint location, glm::vec2 const & value);
+    void uniform(GLint location, glm::vec3 const & value);
+    void uniform(GLint location, glm::vec4 const & value);
+    void uniform(GLint location, glm::mat4 const & value);
+    void uniform(GLint location, glm::vec4 const * values, std::size_t count);
+
+    // Forgets everything, e.g. after a resize handler or a library that calls GL directly
+    void invalidate();
+
+    // Statistics since the previous call
+    statistics end_frame();
+
+private:
+    // Returns true if the value differs from the cached one (and caches it)
+    bool uniform_changed(GLint location, void const * data, std::size_t size);
+
+    bool count(bool changed);
+
+    static constexpr std::uint64_t unknown = ~std::uint64_t(0);
+
+    std::uint64_t program = unknown;
+    std::uint64_t vao = unknown;
+    std::uint64_t draw_framebuffer = unknown;
+    std::uint64_t read_framebuffer = unknown;
+    std::uint64_t active_unit = unknown;
+    std::uint64_t depth_write = unknown;
+    std::array<GLint, 4> current_viewport{-1, -1, -1, -1};
+    std::array<float, 4> current_clear_color{-1.f, -1.f, -1.f, -1.f};
+    bool clear_color_known = false;
+
+    struct texture_binding
+    {
+        GLuint unit;
+        GLenum target;
+        GLuint texture;
+    };
+    std::vector<texture_binding> textures;
+    std::vector<std::pair<GLenum, bool>> capabilities;
+
+    // Raw bytes of the last value per (program, location)
+    std::unordered_map<std::uint64_t, std::vector<unsigned char>> uniforms;
+
+    statistics stats;
+};
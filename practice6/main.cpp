@@ -27,6 +27,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "gl_state.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -315,6 +316,13 @@ int main() try
     float aspect_ratio;
     aspect_ratio = static_cast<float>(width) / height;
 
+    // The 4-view loop below sets the same state over and over; gl_state only forwards what changes
+    // and the call counts are printed once a second
+    gl_state state;
+    gl_state::statistics state_calls;
+    float stats_time = 0.f;
+    int stats_frames = 0;
+
     bool running = true;
     while (running)
     {
@@ -329,8 +337,8 @@ int main() try
                 width = event.window.data1;
                 height = event.window.data2;
                 aspect_ratio = static_cast<float>(width) / height;
-                glViewport(0, 0, width, height);
-                glBindTexture(GL_TEXTURE_2D, texture);
+                state.viewport(0, 0, width, height);
+                state.bind_texture(0, GL_TEXTURE_2D, texture);
                 glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width / 2, height / 2, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
                 glBindRenderbuffer(GL_RENDERBUFFER, depthbuffer);
                 glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width / 2, height / 2);
@@ -363,18 +371,18 @@ int main() try
         if (button_down[SDLK_RIGHT])
             model_angle += 2.f * dt;
 
-        glClearColor(0.8f, 0.8f, 1.f, 0.f);
+        state.clear_color(0.8f, 0.8f, 1.f, 0.f);
         glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 
         for (int i = 0; i < 4; i++) {
-            glClearColor((i + 1.f) / 5, (i * 1.f) / 3, (i * 0.2f), 0.f);
+            state.clear_color((i + 1.f) / 5, (i * 1.f) / 3, (i * 0.2f), 0.f);
 
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
-            glViewport(0, 0, width / 2, height / 2);
+            state.bind_framebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+            state.viewport(0, 0, width / 2, height / 2);
 
             glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            glEnable(GL_DEPTH_TEST);
-            glEnable(GL_CULL_FACE);
+            state.enable(GL_DEPTH_TEST);
+            state.enable(GL_CULL_FACE);
 
             float near = 0.1f;
             float far = 100.f;
@@ -396,33 +404,46 @@ int main() try
 
             glm::vec3 camera_position = (glm::inverse(view) * glm::vec4(0.f, 0.f, 0.f, 1.f)).xyz();
 
-            glUseProgram(dragon_program);
-            glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
-            glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
-            glUniformMatrix4fv(projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&(i == 0 ? projection : ortho)));
+            state.use_program(dragon_program);
+            state.uniform(model_location, model);
+            state.uniform(view_location, view);
+            state.uniform(projection_location, i == 0 ? projection : ortho);
 
-            glUniform3fv(camera_position_location, 1, (float*)(&camera_position));
+            state.uniform(camera_position_location, camera_position);
 
-            glBindVertexArray(dragon_vao);
+            state.bind_vertex_array(dragon_vao);
             glDrawElements(GL_TRIANGLES, dragon.indices.size(), GL_UNSIGNED_INT, nullptr);
 
-            glUseProgram(rectangle_program);
-            glUniform2f(center_location, -0.5f + (i % 2), -0.5f + (i < 2));
-            glUniform2f(size_location, 0.5f, 0.5f);
-            glUniform1i(mode_location, i);
-            glUniform1f(time_location, time);
+            state.use_program(rectangle_program);
+            state.uniform(center_location, glm::vec2(-0.5f + (i % 2), -0.5f + (i < 2)));
+            state.uniform(size_location, glm::vec2(0.5f, 0.5f));
+            state.uniform(mode_location, i);
+            state.uniform(time_location, time);
 
-            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-            glViewport(0, 0, width, height);
+            state.bind_framebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            state.viewport(0, 0, width, height);
 
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, texture);
-            glUniform1i(texture_location, 0);
+            state.bind_texture(0, GL_TEXTURE_2D, texture);
+            state.uniform(texture_location, 0);
 
-            glBindVertexArray(rectangle_vao);
+            state.bind_vertex_array(rectangle_vao);
             glDrawArrays(GL_TRIANGLES, 0, 6);
         }
 
+        auto const frame_calls = state.end_frame();
+        state_calls.issued += frame_calls.issued;
+        state_calls.elided += frame_calls.elided;
+        ++stats_frames;
+        stats_time += dt;
+        if (stats_time >= 1.f)
+        {
+            std::cout << "GL state calls: " << float(state_calls.issued) / stats_frames << " issued, "
+                << float(state_calls.elided) / stats_frames << " elided per frame" << std::endl;
+            state_calls = {};
+            stats_time = 0.f;
+            stats_frames = 0;
+        }
+
         SDL_GL_SwapWindow(window);
     }
 
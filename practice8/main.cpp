@@ -30,6 +30,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "shadow_culling.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -279,6 +280,11 @@ try
     std::string scene_path = project_root + "/buddha.obj";
     obj_data scene = parse_obj(scene_path);
 
+    // Reorders the scene's triangles so that spatially compact clusters of them can be drawn separately
+    mesh_clusters clusters(scene);
+    shadow_culling_scratch shadow_scratch;
+    std::vector<std::uint32_t> casters;
+
     GLuint scene_vao, scene_vbo, scene_ebo;
     glGenVertexArrays(1, &scene_vao);
     glBindVertexArray(scene_vao);
@@ -337,6 +343,13 @@ try
     float camera_distance = 1.5f;
     float camera_angle = glm::pi<float>();
 
+    float stats_time = 0.f;
+    int stats_frames = 0;
+    std::size_t stats_draws = 0;
+    std::size_t stats_casters = 0;
+    std::size_t stats_triangles = 0;
+    std::size_t stats_visible = 0;
+
     bool running = true;
     while (running)
     {
@@ -416,8 +429,26 @@ try
         glUniformMatrix4fv(model_light_loc, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(shadow_proj_loc, 1, GL_FALSE, reinterpret_cast<float *>(&light_proj));
 
+        // Only clusters that can cast a shadow onto what the camera sees go into the shadow map; casters
+        // between the light and its volume are kept, and depth clamping flattens them onto its near plane
+        stats_visible += cull_shadow_casters(clusters, light_proj * model, projection * view * model, shadow_scratch, casters);
+        stats_casters += casters.size();
+
+        glEnable(GL_DEPTH_CLAMP);
         glBindVertexArray(scene_vao);
-        glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
+        for (std::size_t k = 0; k < casters.size();)
+        {
+            // Runs of consecutive clusters are drawn with one call
+            auto const & first = clusters.clusters[casters[k]];
+            std::uint32_t count = first.count;
+            for (++k; k < casters.size() && casters[k] == casters[k - 1] + 1; ++k)
+                count += clusters.clusters[casters[k]].count;
+
+            glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, reinterpret_cast<void *>(first.first * sizeof(std::uint32_t)));
+            ++stats_draws;
+            stats_triangles += count / 3;
+        }
+        glDisable(GL_DEPTH_CLAMP);
 
         // scene
         glViewport(0, 0, width, height);
@@ -449,6 +480,21 @@ try
         glDisable(GL_DEPTH_TEST);
         glDrawArrays(GL_TRIANGLES, 0, 6);
 
+        ++stats_frames;
+        stats_time += dt;
+        if (stats_time >= 1.f)
+        {
+            std::cout << "shadow pass: " << stats_casters / stats_frames << " of " << clusters.clusters.size() << " clusters ("
+                << stats_visible / stats_frames << " visible), " << stats_triangles / stats_frames << " of " << scene.indices.size() / 3
+                << " triangles in " << stats_draws / stats_frames << " draws" << std::endl;
+            stats_time = 0.f;
+            stats_frames = 0;
+            stats_draws = 0;
+            stats_casters = 0;
+            stats_triangles = 0;
+            stats_visible = 0;
+        }
+
         SDL_GL_SwapWindow(window);
     }
 
@@ -27,6 +27,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "shadow_culling.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -317,6 +318,11 @@ int main() try
     std::string scene_path = project_root + "/bunny.obj";
     obj_data scene = parse_obj(scene_path);
 
+    // Reorders the scene's triangles so that spatially compact clusters of them can be drawn separately
+    mesh_clusters clusters(scene);
+    shadow_culling_scratch shadow_scratch;
+    std::vector<std::uint32_t> casters;
+
     auto [min, max] = scene_bb(scene);
     glm::vec3 center = (min + max) / 2.f;
     // make a bound box
@@ -388,6 +394,14 @@ int main() try
     float view_elevation = glm::radians(45.f);
     float view_azimuth = 0.f;
     float camera_distance = 1.5f;
+
+    float stats_time = 0.f;
+    int stats_frames = 0;
+    std::size_t stats_draws = 0;
+    std::size_t stats_casters = 0;
+    std::size_t stats_triangles = 0;
+    std::size_t stats_visible = 0;
+
     bool running = true;
     while (running)
     {
@@ -438,6 +452,17 @@ int main() try
 
         glm::mat4 model(1.f);
 
+        float near = 0.01f;
+        float far = 10.f;
+
+        glm::mat4 view(1.f);
+        view = glm::translate(view, {0.f, 0.f, -camera_distance});
+        view = glm::rotate(view, view_elevation, {1.f, 0.f, 0.f});
+        view = glm::rotate(view, view_azimuth, {0.f, 1.f, 0.f});
+
+        glm::mat4 projection = glm::mat4(1.f);
+        projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, near, far);
+
         glm::vec3 light_direction = glm::normalize(glm::vec3(std::cos(time * 0.5f), 1.f, std::sin(time * 0.5f)));
 
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadow_fbo);
@@ -480,8 +505,26 @@ int main() try
         glUniformMatrix4fv(shadow_model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(shadow_transform_location, 1, GL_FALSE, reinterpret_cast<float *>(&transform));
 
+        // Only clusters that can cast a shadow onto what the camera sees go into the shadow map; casters
+        // between the light and its volume are kept, and depth clamping flattens them onto its near plane
+        stats_visible += cull_shadow_casters(clusters, transform * model, projection * view * model, shadow_scratch, casters);
+        stats_casters += casters.size();
+
+        glEnable(GL_DEPTH_CLAMP);
         glBindVertexArray(vao);
-        glDrawElements(GL_TRIANGLES, scene.indices.size(), GL_UNSIGNED_INT, nullptr);
+        for (std::size_t k = 0; k < casters.size();)
+        {
+            // Runs of consecutive clusters are drawn with one call
+            auto const & first = clusters.clusters[casters[k]];
+            std::uint32_t count = first.count;
+            for (++k; k < casters.size() && casters[k] == casters[k - 1] + 1; ++k)
+                count += clusters.clusters[casters[k]].count;
+
+            glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, reinterpret_cast<void *>(first.first * sizeof(std::uint32_t)));
+            ++stats_draws;
+            stats_triangles += count / 3;
+        }
+        glDisable(GL_DEPTH_CLAMP);
 
         glBindTexture(GL_TEXTURE_2D, shadow_map);
         glGenerateMipmap(GL_TEXTURE_2D);
@@ -498,17 +541,6 @@ int main() try
         glEnable(GL_CULL_FACE);
         glCullFace(GL_BACK);
 
-        float near = 0.01f;
-        float far = 10.f;
-
-        glm::mat4 view(1.f);
-        view = glm::translate(view, {0.f, 0.f, -camera_distance});
-        view = glm::rotate(view, view_elevation, {1.f, 0.f, 0.f});
-        view = glm::rotate(view, view_azimuth, {0.f, 1.f, 0.f});
-
-        glm::mat4 projection = glm::mat4(1.f);
-        projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, near, far);
-
         glBindTexture(GL_TEXTURE_2D, shadow_map);
 
         glUseProgram(program);
@@ -529,6 +561,21 @@ int main() try
         glBindVertexArray(debug_vao);
         glDrawArrays(GL_TRIANGLES, 0, 6);
 
+        ++stats_frames;
+        stats_time += dt;
+        if (stats_time >= 1.f)
+        {
+            std::cout << "shadow pass: " << stats_casters / stats_frames << " of " << clusters.clusters.size() << " clusters ("
+                << stats_visible / stats_frames << " visible), " << stats_triangles / stats_frames << " of " << scene.indices.size() / 3
+                << " triangles in " << stats_draws / stats_frames << " draws" << std::endl;
+            stats_time = 0.f;
+            stats_frames = 0;
+            stats_draws = 0;
+            stats_casters = 0;
+            stats_triangles = 0;
+            stats_visible = 0;
+        }
+
         SDL_GL_SwapWindow(window);
     }
 
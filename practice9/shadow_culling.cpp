@@ -0,0 +1,178 @@
+#include "shadow_culling.hpp"
+
+#include <glm/common.hpp>
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace
+{
+
+    // Spreads the lower 10 bits of x to every third bit
+    std::uint32_t spread_bits(std::uint32_t x)
+    {
+        x = (x | (x << 16)) & 0x030000ffu;
+        x = (x | (x << 8)) & 0x0300f00fu;
+        x = (x | (x << 4)) & 0x030c30c3u;
+        x = (x | (x << 2)) & 0x09249249u;
+        return x;
+    }
+
+    glm::vec3 position(obj_data const & mesh, std::uint32_t index)
+    {
+        auto const & p = mesh.vertices[index].position;
+        return {p[0], p[1], p[2]};
+    }
+
+    // Bounds of the box [min, max] mapped by `transform`, which must not be a projection
+    void transform_bounds(glm::mat4 const & transform, glm::vec3 const & min, glm::vec3 const & max, glm::vec3 & result_min, glm::vec3 & result_max)
+    {
+        result_min = result_max = glm::vec3(transform[3]);
+        for (int i = 0; i < 3; ++i)
+        {
+            glm::vec3 const a = glm::vec3(transform[i]) * min[i];
+            glm::vec3 const b = glm::vec3(transform[i]) * max[i];
+            result_min += glm::min(a, b);
+            result_max += glm::max(a, b);
+        }
+    }
+
+}
+
+mesh_clusters::mesh_clusters(obj_data & mesh, std::size_t cluster_size)
+{
+    std::size_t const triangle_count = mesh.indices.size() / 3;
+    if (triangle_count == 0)
+        return;
+
+    glm::vec3 mesh_min(std::numeric_limits<float>::infinity());
+    glm::vec3 mesh_max(-std::numeric_limits<float>::infinity());
+    for (auto const & vertex : mesh.vertices)
+    {
+        glm::vec3 const p(vertex.position[0], vertex.position[1], vertex.position[2]);
+        mesh_min = glm::min(mesh_min, p);
+        mesh_max = glm::max(mesh_max, p);
+    }
+
+    // The same scale along all axes, so that clusters of flat meshes are not thin slices across them
+    glm::vec3 const extent = mesh_max - mesh_min;
+    float const scale = 1023.f / std::max({extent.x, extent.y, extent.z, 1e-9f});
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> codes(triangle_count);
+    for (std::size_t t = 0; t < triangle_count; ++t)
+    {
+        glm::vec3 const centroid = (position(mesh, mesh.indices[3 * t]) + position(mesh, mesh.indices[3 * t + 1]) + position(mesh, mesh.indices[3 * t + 2])) / 3.f;
+        glm::vec3 const cell = (centroid - mesh_min) * scale;
+        codes[t] = {spread_bits(cell.x) | (spread_bits(cell.y) << 1) | (spread_bits(cell.z) << 2), static_cast<std::uint32_t>(t)};
+    }
+    std::sort(codes.begin(), codes.end());
+
+    std::vector<std::uint32_t> indices(mesh.indices.size());
+    for (std::size_t t = 0; t < triangle_count; ++t)
+        for (int k = 0; k < 3; ++k)
+            indices[3 * t + k] = mesh.indices[3 * codes[t].second + k];
+    mesh.indices = std::move(indices);
+
+    for (std::size_t first = 0; first < triangle_count; first += cluster_size)
+    {
+        std::size_t const count = std::min(cluster_size, triangle_count - first);
+
+        cluster c;
+        c.min = glm::vec3(std::numeric_limits<float>::infinity());
+        c.max = glm::vec3(-std::numeric_limits<float>::infinity());
+        c.first = 3 * first;
+        c.count = 3 * count;
+        for (std::size_t i = c.first; i < c.first + c.count; ++i)
+        {
+            c.min = glm::min(c.min, position(mesh, mesh.indices[i]));
+            c.max = glm::max(c.max, position(mesh, mesh.indices[i]));
+        }
+        clusters.push_back(c);
+    }
+}
+
+clip_volume::clip_volume(glm::mat4 const & transform, glm::vec3 const & min, glm::vec3 const & max, bool near)
+{
+    // min[i] * w <= x_i <= max[i] * w expressed with the rows of the matrix
+    glm::mat4 const t = glm::transpose(transform);
+    for (int i = 0; i < 3; ++i)
+    {
+        if (i < 2 || near)
+            planes[plane_count++] = t[i] - min[i] * t[3];
+        planes[plane_count++] = max[i] * t[3] - t[i];
+    }
+}
+
+bool clip_volume::intersects(glm::vec3 const & min, glm::vec3 const & max) const
+{
+    // The box is outside if its corner farthest along some plane normal is outside of that plane
+    for (std::size_t j = 0; j < plane_count; ++j)
+    {
+        glm::vec4 const & plane = planes[j];
+        glm::vec3 const p(plane.x >= 0.f ? max.x : min.x, plane.y >= 0.f ? max.y : min.y, plane.z >= 0.f ? max.z : min.z);
+        if (plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w < 0.f)
+            return false;
+    }
+    return true;
+}
+
+std::size_t cull_shadow_casters(mesh_clusters const & mesh, glm::mat4 const & light_transform, glm::mat4 const & camera_view_projection,
+    shadow_culling_scratch & scratch, std::vector<std::uint32_t> & casters)
+{
+    casters.clear();
+
+    auto & bounds = scratch.bounds;
+    bounds.resize(mesh.clusters.size());
+    for (std::size_t i = 0; i < mesh.clusters.size(); ++i)
+        transform_bounds(light_transform, mesh.clusters[i].min, mesh.clusters[i].max, bounds[i].first, bounds[i].second);
+
+    // Grid over the light's [-1, 1] square holding the largest light-space depth of the visible receivers
+    // covering each cell, or -infinity; a caster can only shade a cell it covers at a smaller depth
+    constexpr int grid_size = 64;
+    auto & receiver_depth = scratch.receiver_depth;
+    receiver_depth.assign(grid_size * grid_size, -std::numeric_limits<float>::infinity());
+
+    auto cells = [](glm::vec3 const & min, glm::vec3 const & max, int & x0, int & y0, int & x1, int & y1)
+    {
+        auto cell = [](float x) { return std::clamp(static_cast<int>((x * 0.5f + 0.5f) * grid_size), 0, grid_size - 1); };
+        x0 = cell(min.x);
+        y0 = cell(min.y);
+        x1 = cell(max.x);
+        y1 = cell(max.y);
+    };
+
+    clip_volume const camera(camera_view_projection);
+    std::size_t visible = 0;
+    for (std::size_t i = 0; i < mesh.clusters.size(); ++i)
+    {
+        if (!camera.intersects(mesh.clusters[i].min, mesh.clusters[i].max))
+            continue;
+
+        ++visible;
+        int x0, y0, x1, y1;
+        cells(bounds[i].first, bounds[i].second, x0, y0, x1, y1);
+        for (int y = y0; y <= y1; ++y)
+            for (int x = x0; x <= x1; ++x)
+                receiver_depth[y * grid_size + x] = std::max(receiver_depth[y * grid_size + x], bounds[i].second.z);
+    }
+
+    clip_volume const light(light_transform, glm::vec3(-1.f), glm::vec3(1.f), false);
+    for (std::size_t i = 0; i < mesh.clusters.size(); ++i)
+    {
+        if (!light.intersects(mesh.clusters[i].min, mesh.clusters[i].max))
+            continue;
+
+        int x0, y0, x1, y1;
+        cells(bounds[i].first, bounds[i].second, x0, y0, x1, y1);
+        bool shades = false;
+        for (int y = y0; y <= y1 && !shades; ++y)
+            for (int x = x0; x <= x1 && !shades; ++x)
+                shades = receiver_depth[y * grid_size + x] >= bounds[i].first.z;
+
+        if (shades)
+            casters.push_back(i);
+    }
+
+    return visible;
+}
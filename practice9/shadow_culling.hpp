@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <array>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+#include "obj_parser.hpp"
+
+// Triangles of a mesh grouped into spatially compact clusters, so that passes can draw parts of it
+struct mesh_clusters
+{
+    struct cluster
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+
+        // Range of indices into the reordered index buffer
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    std::vector<cluster> clusters;
+
+    // Sorts the triangles of `mesh` along a Morton curve through the mesh bounds and splits them
+    // into clusters of `cluster_size` consecutive triangles; reorders mesh.indices accordingly
+    mesh_clusters(obj_data & mesh, std::size_t cluster_size = 1024);
+};
+
+// Convex part of space that a matrix maps into the box [min, max] of normalized device coordinates,
+// bounded by planes (n, d) with n.p + d >= 0 inside; like the planes of practice14's `frustum`,
+// unnormalized and read from the rows of the matrix
+struct clip_volume
+{
+    std::array<glm::vec4, 6> planes;
+    std::size_t plane_count = 0;
+
+    // Without `near`, the volume extends indefinitely toward negative z, as a light volume extruded toward the light
+    clip_volume(glm::mat4 const & transform, glm::vec3 const & min = glm::vec3(-1.f), glm::vec3 const & max = glm::vec3(1.f), bool near = true);
+
+    // Conservative: a box near an edge of the volume may be reported as intersecting although it lies outside
+    bool intersects(glm::vec3 const & min, glm::vec3 const & max) const;
+};
+
+// Scratch buffers of cull_shadow_casters, kept between calls so that culling every frame doesn't allocate
+struct shadow_culling_scratch
+{
+    // Light-space bounds of every cluster
+    std::vector<std::pair<glm::vec3, glm::vec3>> bounds;
+    std::vector<float> receiver_depth;
+};
+
+// Selects the clusters to draw into an orthographic shadow map: those that intersect the light volume
+// extruded toward the light, and whose shadow can fall onto clusters visible from the camera. Visible
+// clusters are marked on a coarse grid over the light's view with their largest depth, and a caster must
+// cover some marked cell nearer to the light than that depth. Writes cluster indices in increasing order
+// to `casters`, and returns the number of visible clusters
+std::size_t cull_shadow_casters(mesh_clusters const & mesh, glm::mat4 const & light_transform, glm::mat4 const & camera_view_projection,
+    shadow_culling_scratch & scratch, std::vector<std::uint32_t> & casters);